@@ -52,6 +52,7 @@ struct ircd::client
 	size_t content_consumed {0};
 	resource::request request;
 
+	size_t write_all(const vector_view<const const_buffer> &);
 	size_t write_all(const const_buffer &);
 	void close(const net::close_opts &, net::close_callback);
 	ctx::future<void> close(const net::close_opts & = {});
@@ -52,7 +52,7 @@ struct ircd::ctx::continuation
 
 	virtual void interrupted(ctx *const &) noexcept;
 
-	continuation();
+	continuation(const prof::reason & = prof::reason::IO);
 	virtual ~continuation() noexcept;
 };
 
@@ -74,10 +74,13 @@ struct ircd::ctx::to_asio
 
 	void interrupted(ctx *const &) noexcept final override;
 
-	to_asio(const function &handler = {});
+	to_asio(const function &handler = {},
+	        const prof::reason & = prof::reason::IO);
 };
 
 inline
-ircd::ctx::to_asio::to_asio(const function &handler)
-:handler{handler}
+ircd::ctx::to_asio::to_asio(const function &handler,
+                            const prof::reason &reason)
+:continuation{reason}
+,handler{handler}
 {}
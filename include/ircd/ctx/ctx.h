@@ -52,6 +52,7 @@ namespace ircd::ctx
 	string_view name(const ctx &);               // User's optional label for context
 	const size_t &stack_max(const ctx &);        // Returns stack size allocated for ctx
 	const size_t &stack_at(const ctx &);         // Stack at last sleep (also see this_ctx.h)
+	size_t stack_committed(const ctx &);         // Stack bytes resident in memory
 	const int64_t &notes(const ctx &);           // Peeks at internal semaphore count
 	const uint64_t &yields(const ctx &);         // Context switching counter
 	const ulong &cycles(const ctx &);            // Accumulated tsc (not counting cur slice)
@@ -73,6 +74,7 @@ namespace ircd::ctx
 }
 
 #include "this_ctx.h"
+#include "stack.h"
 #include "context.h"
 #include "prof.h"
 #include "list.h"
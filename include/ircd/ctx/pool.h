@@ -26,7 +26,7 @@ struct ircd::ctx::pool
 	size_t running;
 	size_t working;
 	struct dock dock;
-	std::deque<closure> queue;
+	std::deque<std::pair<closure, ulong>> queue; // job and rdtsc when queued
 	std::vector<context> ctxs;
 
 	void next();
@@ -27,9 +27,17 @@
 /// start doing some blocking flush under load, etc. The profiler will alert
 /// us of this so it doesn't silently degrade performance.
 ///
+/// Statistics are aggregated for all contexts sharing a name (i.e. all the
+/// contexts of a pool, all client request contexts, etc) so the contexts
+/// monopolizing the event loop can be found without an external profiler.
+/// These are collected in release builds only while ircd.ctx.prof.enable is
+/// set; all units are in tsc cycles.
+///
 namespace ircd::ctx::prof
 {
 	enum class event;
+	enum class reason;
+	struct stats;
 	struct settings extern settings;
 
 	const ulong &total_slice_cycles();
@@ -37,6 +45,11 @@ namespace ircd::ctx::prof
 	ulong cur_slice_cycles();
 
 	void mark(const event &);
+
+	string_view reflect(const reason &);
+	bool for_each(const std::function<bool (const string_view &name, const stats &)> &);
+	const stats *find(const string_view &name);
+	void reset();
 }
 
 enum class ircd::ctx::prof::event
@@ -52,6 +65,38 @@ enum class ircd::ctx::prof::event
 	CUR_TERMINATE,     // Current context detects termination
 };
 
+/// Why a context yielded. Counted and the time suspended accumulated by
+/// reason for each name.
+enum class ircd::ctx::prof::reason
+{
+	IO,                // Waiting on an asio operation (socket, fd, etc)
+	LOCK,              // Waiting for a notification (dock, mutex, future, etc)
+	SLEEP,             // Waiting with a deadline (sleep or timed wait)
+	YIELD,             // Requeued with this_ctx::yield()
+	_NUM_
+};
+
+/// Aggregate statistics for the contexts sharing a name. Histograms have
+/// a bucket for each power of two; bucket N counts samples in [2^N, 2^(N+1)).
+struct ircd::ctx::prof::stats
+{
+	using histogram = std::array<uint64_t, 64>;
+	using by_reason = std::array<uint64_t, num_of<reason>()>;
+
+	uint64_t contexts {0};             // Contexts entered with this name
+	uint64_t slices {0};               // Number of time slices executed
+	uint64_t cycles {0};               // Sum of all time slices
+	uint64_t slice_max {0};            // Longest single time slice
+	histogram slice {{0}};             // Time slice lengths
+	by_reason yields {{0}};            // Yields by reason
+	by_reason waited {{0}};            // Time suspended by reason
+	uint64_t jobs {0};                 // Pool jobs executed by this name
+	uint64_t queued {0};               // Sum of time jobs waited in the queue
+	uint64_t worked {0};               // Sum of time from job start to finish
+	histogram queue {{0}};             // Time jobs waited in the pool queue
+	histogram work {{0}};              // Time jobs took once started
+};
+
 struct ircd::ctx::prof::settings
 {
 	double stack_usage_warning;       // percentage
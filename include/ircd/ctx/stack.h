@@ -0,0 +1,42 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2018 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#pragma once
+#define HAVE_IRCD_CTX_STACK_H
+
+/// Stack memory for contexts.
+///
+/// Stacks are mapped directly from the kernel with a guard page below each
+/// one so an overflow faults rather than silently corrupting a neighbor. When
+/// a context exits its stack is kept on a free list for its size and handed
+/// to the next context spawned with that size. Idle stacks can be released
+/// to the kernel with MADV_FREE while their mapping is retained, so memory is
+/// only committed to the contexts actually running.
+///
+namespace ircd::ctx::stacks
+{
+	struct stats;
+
+	extern struct stats stats;
+
+	size_t committed();                          // Resident bytes of all stacks
+	size_t trim(const size_t &keep = 0);         // Unmap idle stacks over keep
+}
+
+struct ircd::ctx::stacks::stats
+{
+	size_t reserved {0};                         // Address space mapped (incl. guard)
+	size_t mapped {0};                           // Number of stacks mapped
+	size_t active {0};                           // Stacks in use by a context
+	size_t idle {0};                             // Stacks on a free list
+	size_t allocs {0};                           // Total stack allocations
+	size_t reuses {0};                           // Allocations from a free list
+	size_t advised {0};                          // Idle stacks released w/ MADV_FREE
+};
@@ -61,6 +61,11 @@ namespace ircd::db
 	void compact(column &, const std::pair<string_view, string_view> &, const int &to_level = -1);
 	void compact(column &, const int &level = -1);
 	void sort(column &, const bool &blocking = false);
+
+	// [SET] Bulk load. The deltas (SET only) are sorted in place by the
+	// column's comparator, written out as a table file and ingested by the
+	// column in one operation; for a duplicate key the last delta wins.
+	void ingest(column &, const vector_view<column::delta> &);
 }
 
 /// Columns add the ability to run multiple LevelDB's in synchrony under the same
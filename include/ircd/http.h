@@ -205,6 +205,9 @@ struct ircd::http::request::head
 	string_view connection;
 	string_view content_type;
 	string_view user_agent;
+	string_view range;
+	string_view if_none_match;
+	string_view accept_encoding;
 	size_t content_length {0};
 
 	string_view uri;       // full view of (path, query, fragmet)
@@ -294,6 +297,7 @@ enum ircd::http::code
 	PAYLOAD_TOO_LARGE                       = 413,
 	REQUEST_URI_TOO_LONG                    = 414,
 	UNSUPPORTED_MEDIA_TYPE                  = 415,
+	RANGE_NOT_SATISFIABLE                   = 416,
 	EXPECTATION_FAILED                      = 417,
 	IM_A_TEAPOT                             = 418,
 	UNPROCESSABLE_ENTITY                    = 422,
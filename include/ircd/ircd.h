@@ -58,6 +58,8 @@ namespace ircd
 #include "http.h"
 #include "fmt.h"
 #include "magics.h"
+#include "magick.h"
+#include "zip.h"
 #include "conf.h"
 #include "fs/fs.h"
 #include "ios.h"
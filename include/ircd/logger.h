@@ -79,6 +79,39 @@ enum ircd::log::facility
 	_NUM_
 };
 
+/// Asynchronous logfile writer. While running, file output composed by the
+/// main thread is copied into a preallocated ring buffer and written out in
+/// batches by a dedicated thread with writev(2). Records which don't fit in
+/// the ring are dropped and counted rather than stalling the event loop.
+/// Facilities marked in `sync` bypass the ring: the ring is drained and the
+/// record is written and synced to the device before slog() returns.
+namespace ircd::log::writer
+{
+	struct stats;
+
+	extern std::array<bool, num_of<facility>()> sync;
+	extern struct stats stats;
+
+	bool running();
+	void drain();
+	void start(const size_t &ring_size);
+	void stop();
+}
+
+struct ircd::log::writer::stats
+{
+	std::atomic<size_t> queued {0};           ///< Records accepted into ring
+	std::atomic<size_t> written {0};          ///< Records written by thread
+	std::atomic<size_t> bytes {0};            ///< Bytes written by thread
+	std::atomic<size_t> batches {0};          ///< writev(2) calls by thread
+	std::atomic<size_t> dropped {0};          ///< Records lost; ring full
+	std::atomic<size_t> dropped_bytes {0};    ///< Bytes lost; ring full
+	std::atomic<size_t> synced {0};           ///< Records bypassing the ring
+	std::atomic<size_t> errors {0};           ///< Failed writes to a file
+	std::atomic<size_t> ring_size {0};        ///< Capacity of the ring
+	std::atomic<size_t> ring_used {0};        ///< Ring bytes awaiting write
+};
+
 /// A named logger. Create an instance of this to help categorize log messages.
 /// All messages sent to this logger will be prefixed with the given name.
 /// Admins will use this to create masks to filter log messages. Instances
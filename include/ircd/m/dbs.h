@@ -17,6 +17,7 @@ namespace ircd::m::dbs
 {
 	struct init;
 	struct write_opts;
+	struct room_depth_lock;
 
 	// Database instance
 	extern std::shared_ptr<db::database> events;
@@ -32,6 +33,7 @@ namespace ircd::m::dbs
 	extern db::index room_events;      // room_id | depth, event_idx => state_root
 	extern db::index room_joined;      // room_id | origin, member => event_idx
 	extern db::index room_state;       // room_id | type, state_key => event_idx
+	extern db::index room_depth;       // room_id | lo depth => hi depth
 	extern db::column state_node;      // node_id => state::node
 
 	// Lowlevel util
@@ -54,6 +56,21 @@ namespace ircd::m::dbs
 	string_view room_events_key(const mutable_buffer &out, const id::room &, const uint64_t &depth);
 	std::pair<uint64_t, event::idx> room_events_key(const string_view &amalgam);
 
+	constexpr size_t ROOM_DEPTH_KEY_MAX_SIZE {id::MAX_SIZE + 1 + 8};
+	string_view room_depth_key(const mutable_buffer &out, const id::room &, const uint64_t &depth);
+	uint64_t room_depth_key(const string_view &amalgam);
+
+	// The run key at this depth marks a room whose runs cover its whole
+	// timeline: set with the room's create event or by a rebuild.
+	constexpr uint64_t ROOM_DEPTH_INDEXED {std::numeric_limits<uint64_t>::max()};
+
+	// [GET] Contiguous runs of depth present in the timeline of a room,
+	// visited from the highest run down; the gaps are between the runs.
+	// Returns false if the closure broke the iteration.
+	using depth_range_closure = std::function<bool (const int64_t &lo, const int64_t &hi)>;
+	bool room_depth_ranges(const id::room &, const depth_range_closure &);
+	bool room_depth_indexed(const id::room &);
+
 	// [GET] the state root for an event (with as much information as you have)
 	string_view state_root(const mutable_buffer &out, const id::room &, const event::idx &, const uint64_t &depth);
 	string_view state_root(const mutable_buffer &out, const id::room &, const event::id &, const uint64_t &depth);
@@ -66,6 +83,23 @@ namespace ircd::m::dbs
 	// [SET (txn)] Basic write suite
 	string_view write(db::txn &, const event &, const write_opts &);
 	void blacklist(db::txn &, const event::id &, const write_opts &);
+
+	// [GET] Room cache; loaded from the columns on first use and then kept
+	// current by committed(). Heads are visited by descending depth. The
+	// state is the committed present state (room_state column) only; it is
+	// read through m::room::state, which is its only consumer.
+	using head_closure = std::function<bool (const event::idx &, const event::id &, const int64_t &depth)>;
+	bool room_head_cached(const id::room &, const head_closure &);
+	std::tuple<id::event::buf, int64_t, event::idx> room_top_cached(const id::room &);
+	bool room_state_cached(const id::room &, const string_view &type, const string_view &state_key, const event::id::closure &);
+	bool room_state_cached(const id::room &, const string_view &type, const string_view &state_key, const event::closure_idx &);
+	std::pair<size_t, size_t> room_cache_stats(); // rooms, bytes
+	void room_cache_clear(const id::room &);
+	void room_cache_clear();
+
+	// [SET] Applies a write() to the room cache; call only once the txn
+	// carrying it has committed. Writers bypassing this must clear the room.
+	void committed(const event &, const write_opts &);
 }
 
 struct ircd::m::dbs::write_opts
@@ -81,6 +115,20 @@ struct ircd::m::dbs::write_opts
 	bool refs {true};
 };
 
+/// Serializes the writers of a room's depth runs. A txn from write() with
+/// op SET reads the runs it extends, so it must be composed and committed
+/// while this is held for the event's room; a concurrent writer would
+/// otherwise compose against runs which are no longer current.
+struct ircd::m::dbs::room_depth_lock
+{
+	std::string room_id;
+
+	room_depth_lock(const id::room &);
+	room_depth_lock(room_depth_lock &&) = delete;
+	room_depth_lock(const room_depth_lock &) = delete;
+	~room_depth_lock() noexcept;
+};
+
 /// Database Schema Descriptors
 ///
 namespace ircd::m::dbs::desc
@@ -138,6 +186,10 @@ namespace ircd::m::dbs::desc
 
 	// state btree node key-value store
 	extern const database::descriptor events__state_node;
+
+	// room depth range sequence
+	extern const db::prefix_transform events__room_depth__pfx;
+	extern const database::descriptor events__room_depth;
 }
 
 // Internal interface; not for public.
@@ -147,6 +199,7 @@ namespace ircd::m::dbs
 	void _index__room_events(db::txn &,  const event &, const write_opts &, const string_view &);
 	void _index__room_joined(db::txn &, const event &, const write_opts &);
 	void _index__room_head(db::txn &, const event &, const write_opts &);
+	void _index__room_depth(db::txn &, const event &, const write_opts &);
 	string_view _index_state(db::txn &, const event &, const write_opts &);
 	string_view _index_redact(db::txn &, const event &, const write_opts &);
 	string_view _index_ephem(db::txn &, const event &, const write_opts &);
@@ -19,6 +19,7 @@ namespace ircd::m
 	struct room_filter;
 	struct event_filter;
 	struct room_event_filter;
+	struct filter_matcher;
 
 	bool match(const event_filter &, const event &);
 	bool match(const room_event_filter &, const event &);
@@ -91,8 +92,83 @@ struct ircd::m::filter
 >
 {
 	using super_type::tuple;
+	struct compiled;
+
 	filter(const user &, const string_view &filter_id, const mutable_buffer &);
 	using super_type::operator=;
 };
 
+/// Compiled form of an event_filter or room_event_filter. The lists of the
+/// filter are unquoted once into hash sets, and patterns containing '*' are
+/// split into their literal segments, so testing an event costs a few hash
+/// lookups no matter how long the lists are. This holds views into the
+/// filter's JSON which must outlive it.
+struct ircd::m::filter_matcher
+{
+	/// A pattern with at least one '*'. The segments between the stars must
+	/// appear in order; the first and last are anchored unless the pattern
+	/// begins or ends with a star.
+	struct glob
+	{
+		std::vector<string_view> segments;
+		bool front {false};
+		bool back {false};
+
+		bool operator()(const string_view &) const;
+
+		glob(const string_view &pattern);
+	};
+
+	/// One of the string lists of a filter (types, senders, rooms, etc).
+	struct list
+	{
+		std::unordered_set<string_view> exact;
+		std::vector<glob> globs;
+
+		bool empty() const;
+		bool operator()(const string_view &) const;
+
+		list(const json::array &);
+		list() = default;
+	};
+
+	long limit {0};
+	int8_t contains_url {-1};                    // -1 when not given
+	list types, not_types;
+	list senders, not_senders;
+	list rooms, not_rooms;
+
+	bool operator()(const event &) const;
+
+	filter_matcher(const json::object &room_event_filter);
+	filter_matcher(const room_event_filter &);
+	filter_matcher(const event_filter &);
+	filter_matcher() = default;
+};
+
+/// Filter uploaded by a user, compiled once and shared by every request
+/// naming its filter_id. Filters are content-addressed and never change
+/// once stored, so the cache never needs invalidation.
+struct ircd::m::filter::compiled
+{
+	std::string source;
+	filter_matcher account_data;
+	filter_matcher presence;
+	filter_matcher::list rooms;
+	filter_matcher::list not_rooms;
+	filter_matcher state;
+	filter_matcher timeline;
+	filter_matcher ephemeral;
+	filter_matcher room_account_data;
+	bool include_leave {false};
+
+	bool room(const string_view &room_id) const;
+
+	static std::shared_ptr<const compiled> get(const user &, const string_view &filter_id);
+
+	compiled(std::string source);
+	compiled(compiled &&) = delete;
+	compiled(const compiled &) = delete;
+};
+
 #pragma GCC diagnostic pop
@@ -17,6 +17,7 @@ namespace ircd::m::hook
 
 	struct base;
 	struct maps;
+	struct defer;
 
 	template<class data = void> struct hook;
 	template<class data = void> struct site;
@@ -38,6 +39,7 @@ struct ircd::m::hook::base
 	json::strung _feature;
 	json::object feature;
 	m::event matching;
+	std::shared_ptr<struct defer> defer;
 	bool registered {false};
 	size_t matchers {0};
 	size_t calls {0};
@@ -46,6 +48,8 @@ struct ircd::m::hook::base
 	site *find_site() const;
 
  protected:
+	void quiesce() noexcept;
+
 	base(const json::members &);
 	base(base &&) = delete;
 	base(const base &) = delete;
@@ -76,6 +80,40 @@ struct ircd::m::hook::base::site
 	virtual ~site() noexcept;
 };
 
+/// A hook with `"_defer": true` in its feature is not called by the site in
+/// the evaluating context. The event is copied to the hook's queue instead and
+/// delivered from the hook pool after the site returns, so the hook does not
+/// hold up acceptance. Events reach each deferred hook in the order they were
+/// queued, one at a time. Queueing blocks while the total number of deferred
+/// events is at ircd.m.hook.defer.queue_max, except on the pool's own
+/// contexts, which must never wait on themselves. Only hooks without data
+/// can be deferred; a deferred hook<data> is called inline.
+struct ircd::m::hook::defer
+:std::enable_shared_from_this<defer>
+{
+	static ctx::pool pool;
+	static ctx::dock dock;
+	static size_t queued;
+	static size_t peak;
+	static size_t total;
+	static std::set<const ctx::ctx *> workers;
+
+	base *hook;
+	std::deque<std::string> queue;
+	ctx::ctx *runner {nullptr};
+	bool running {false};
+	size_t calls {0};
+
+	static bool drain(const milliseconds &timeout);
+	static void resize();
+
+	void run();
+	void operator()(const event &);
+
+	defer(base &hook);
+	~defer() noexcept;
+};
+
 template<>
 struct ircd::m::hook::hook<void>
 final
@@ -86,6 +124,7 @@ final
  public:
 	hook(const json::members &feature, decltype(function) function);
 	hook(decltype(function) function, const json::members &feature);
+	~hook() noexcept;
 };
 
 template<>
@@ -138,12 +177,16 @@ void
 ircd::m::hook::site<data>::operator()(const event &event,
                                       data d)
 {
-	match(event, [this, &event, &d]
+	// Passed by reference so the std::function doesn't allocate a closure
+	// larger than its local storage on every event.
+	const auto closure{[this, &event, &d]
 	(base &base)
 	{
 		call(dynamic_cast<hook<data> &>(base), event, d);
 		return true;
-	});
+	}};
+
+	match(event, std::cref(closure));
 }
 
 template<class data>
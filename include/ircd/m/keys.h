@@ -54,11 +54,20 @@ struct ircd::m::keys
 	using queries = vector_view<const m::v1::key::server_key>; // <server, key_id>
 	using closure = std::function<void (const json::object &)>;
 	using closure_bool = std::function<bool (const json::object &)>;
+	using pk_closure = std::function<void (const ed25519::pk &)>;
 
 	static void get(const string_view &server_name, const closure &);
 	static void get(const string_view &server_name, const string_view &key_id, const closure &);
 	static bool query(const string_view &query_server, const queries &, const closure_bool &);
 
+	// Decoded public key from memory, falling back to get(); for verifying.
+	static void public_key(const string_view &server_name, const string_view &key_id, const pk_closure &);
+
+	// Resolve many keys at once (notary first, then direct) ahead of verify;
+	// returns the number still unavailable.
+	static size_t prefetch(const queries &);
+	static size_t prefetch(const vector_view<const m::event> &);
+
 	using super_type::tuple;
 	using super_type::operator=;
 };
@@ -13,9 +13,34 @@
 
 namespace ircd::m
 {
+	struct visibility;
+
 	// The mxid argument is a string_view because it may be empty when no
 	// authentication is supplied (m::id cannot be empty because that's
 	// considered an invalid mxid). In that case the test is for public vis.
 	bool visible(const event &, const string_view &mxid);
 	bool visible(const id::event &, const string_view &mxid);
 }
+
+/// Visibility of a run of events in one room for one mxid. Visibility only
+/// changes where the room state changes, so the answer for the last state
+/// root is kept and reused for every following event with the same root;
+/// a page of timeline between two state events costs a single evaluation.
+/// Pass the state root when it is already at hand (room::messages has it).
+struct ircd::m::visibility
+{
+	std::string mxid;
+	std::string root;
+	bool result {false};
+	bool valid {false};
+	size_t evaluated {0};
+	size_t reused {0};
+
+	bool operator()(const event &, const string_view &state_root);
+	bool operator()(const event &);
+
+	// Evaluates each of the indexes into the respective position of out.
+	void operator()(const vector_view<const event::idx> &, const vector_view<bool> &out);
+
+	visibility(const string_view &mxid);
+};
@@ -27,6 +27,7 @@ namespace ircd::m::vm
 	extern log::log log;
 	extern ctx::shared_view<accepted> accept;
 	extern uint64_t current_sequence;
+	extern ctx::shared_mutex sequence_lock;
 	extern const opts default_opts;
 	extern const copts default_copts;
 
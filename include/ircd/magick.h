@@ -0,0 +1,99 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2018 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#pragma once
+#define HAVE_IRCD_MAGICK_H
+
+/// Image processing interface (GraphicsMagick).
+///
+/// The input is an encoded image in any format the library can decode; the
+/// result is the encoded output image viewed by the closure for the duration
+/// of the call. These calls are CPU bound and block the calling thread; they
+/// are safe to call from a ctx::offload() worker. When libircd is built
+/// without GraphicsMagick these throw not_available.
+namespace ircd::magick
+{
+	struct init;
+	struct dimensions;
+
+	IRCD_EXCEPTION(ircd::error, error)
+	IRCD_EXCEPTION(error, not_available)
+
+	using result_closure = std::function<void (const const_buffer &)>;
+
+	// Resize to fit within the dimensions preserving the aspect ratio.
+	void scale(const const_buffer &in, const dimensions &, const string_view &format, const result_closure &);
+
+	// Resize to cover the dimensions then crop to them from the center.
+	void crop(const const_buffer &in, const dimensions &, const string_view &format, const result_closure &);
+
+	const char *version();
+}
+
+struct ircd::magick::dimensions
+{
+	uint16_t width {0};
+	uint16_t height {0};
+};
+
+struct ircd::magick::init
+{
+	init();
+	~init() noexcept;
+};
+
+#ifndef RB_ENABLE_MAGICK
+//
+// Stub definitions for when GraphicsMagick isn't available because the
+// definition file is not compiled at all.
+//
+
+inline
+ircd::magick::init::init()
+{
+}
+
+inline
+ircd::magick::init::~init()
+noexcept
+{
+}
+
+inline void
+ircd::magick::scale(const const_buffer &,
+                    const dimensions &,
+                    const string_view &,
+                    const result_closure &)
+{
+	throw not_available
+	{
+		"GraphicsMagick support is not available"
+	};
+}
+
+inline void
+ircd::magick::crop(const const_buffer &,
+                   const dimensions &,
+                   const string_view &,
+                   const result_closure &)
+{
+	throw not_available
+	{
+		"GraphicsMagick support is not available"
+	};
+}
+
+inline const char *
+ircd::magick::version()
+{
+	return "DISABLED";
+}
+
+#endif // !RB_ENABLE_MAGICK
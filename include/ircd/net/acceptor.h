@@ -32,6 +32,7 @@ struct ircd::net::listener::acceptor
 	ip::tcp::acceptor a;
 	size_t accepting {0};
 	size_t handshaking {0};
+	net::handshakes handshakes;
 	bool interrupting {false};
 	ctx::dock joining;
 
@@ -30,8 +30,10 @@ struct ircd::net::dns
 	struct opts;
 	struct resolver;
 	struct cache;
+	struct stats;
 
 	struct cache static cache;
+	struct stats static stats;
 	struct resolver static *resolver;
 	struct opts static const opts_default;
 
@@ -96,11 +98,22 @@ struct ircd::net::dns::opts
 	bool nxdomain_exceptions {true};
 };
 
+/// Counters for resolutions made through net::dns
+struct ircd::net::dns::stats
+{
+	size_t hits {0};                   ///< Answered from the cache
+	size_t misses {0};                 ///< Sent to a nameserver
+	size_t coalesced {0};              ///< Joined an identical query in flight
+	size_t prefetched {0};             ///< Cache entry refreshed before expiry
+	size_t restored {0};               ///< Cache entries loaded at startup
+};
+
 /// (internal) DNS cache
 struct ircd::net::dns::cache
 {
 	static conf::item<seconds> min_ttl;
 	static conf::item<seconds> clear_nxdomain;
+	static conf::item<seconds> prefetch;
 
 	std::multimap<std::string, rfc1035::record::A, std::less<>> A;
 	std::multimap<std::string, rfc1035::record::SRV, std::less<>> SRV;
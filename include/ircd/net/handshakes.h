@@ -0,0 +1,37 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2018 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#pragma once
+#define HAVE_IRCD_NET_HANDSHAKES_H
+
+namespace ircd::net
+{
+	struct handshakes;
+
+	bool resumed(const socket &) noexcept;
+	milliseconds handshake_time(const socket &) noexcept;
+}
+
+/// Counters for the TLS handshakes completed by a listener or to a remote
+/// peer. The histogram bins the duration of each handshake by powers of four
+/// milliseconds: [0] is under 1ms, [1] under 4ms ... and the last bin holds
+/// everything beyond.
+struct ircd::net::handshakes
+{
+	static constexpr const size_t BINS {8};
+
+	size_t full {0};
+	size_t resumed {0};
+	std::array<size_t, BINS> hist {{0}};
+
+	void operator()(const socket &);
+
+	friend std::ostream &operator<<(std::ostream &, const handshakes &);
+};
@@ -46,6 +46,7 @@ namespace ircd::net
 #include "read.h"
 #include "write.h"
 #include "scope_timeout.h"
+#include "handshakes.h"
 
 namespace ircd::net
 {
@@ -60,6 +61,7 @@ namespace ircd::net
 	const_buffer peer_cert_der(const mutable_buffer &, const socket &);
 	const_buffer peer_cert_der_sha256(const mutable_buffer &, const socket &);
 	string_view peer_cert_der_sha256_b64(const mutable_buffer &, const socket &);
+	string_view alpn(const socket &) noexcept;
 }
 
 // Exports to ircd::
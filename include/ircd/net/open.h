@@ -99,6 +99,12 @@ struct ircd::net::open_opts
 
 	/// Option to allow expired certificates.
 	bool allow_expired { default_allow_expired };
+
+	/// Application protocols offered with ALPN in the handshake, in order of
+	/// preference and separated by commas (i.e "h2,http/1.1"). When empty no
+	/// ALPN extension is sent. The selection is available from alpn(socket)
+	/// after the open.
+	string_view alpn;
 };
 
 /// Constructor intended to provide implicit conversions (no-brackets required)
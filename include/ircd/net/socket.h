@@ -54,6 +54,8 @@ struct ircd::net::socket
 	bool timer_set {false};                      // boolean lockout
 	bool timedout {false};
 	bool fini {false};
+	steady_point handshake_began;                // handshake start
+	milliseconds handshake_time {0};             // handshake duration
 
 	void call_user(const eptr_handler &, const error_code &) noexcept;
 	void call_user(const ec_handler &, const error_code &) noexcept;
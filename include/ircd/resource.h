@@ -143,7 +143,7 @@ struct ircd::resource::response
 {
 	struct chunked;
 
-	response(client &, const http::code &, const string_view &content_type, const size_t &content_length, const string_view &headers = {});
+	response(client &, const http::code &, const string_view &content_type, const size_t &content_length, const string_view &headers = {}, const const_buffer &content = {});
 	response(client &, const string_view &str, const string_view &content_type, const http::code &, const vector_view<const http::header> &);
 	response(client &, const string_view &str, const string_view &content_type, const http::code & = http::OK, const string_view &headers = {});
 	response(client &, const json::object &str, const http::code & = http::OK);
@@ -15,12 +15,18 @@
 ///
 struct ircd::server::link
 {
+	struct http2;
+
 	static conf::item<size_t> tag_max_default;
 	static conf::item<size_t> tag_commit_max_default;
 
 	server::peer *peer;                          ///< backreference to peer
 	std::shared_ptr<net::socket> socket;         ///< link's socket
 	std::list<tag> queue;                        ///< link's work queue
+	std::unique_ptr<http2> h2;                   ///< HTTP/2 session if negotiated
+	microseconds ttfb {0};                       ///< EWMA time to first byte
+	microseconds rtt {0};                        ///< EWMA request completion
+	steady_point idle_since;                     ///< opened or queue last emptied
 	bool op_init {false};                        ///< link is connecting
 	bool op_fini {false};                        ///< link is disconnecting
 	bool op_write {false};                       ///< async operation state
@@ -46,6 +52,12 @@ struct ircd::server::link
 	void handle_close(std::exception_ptr);
 	void handle_open(std::exception_ptr);
 
+	void h2_open();
+	bool h2_submit(tag &);
+	void h2_flush();
+	void h2_handle_writable();
+	void h2_handle_readable();
+
   public:
 	// config related
 	size_t tag_max() const;
@@ -73,6 +85,9 @@ struct ircd::server::link
 	size_t write_total() const;
 	size_t read_total() const;
 
+	// expected completion of a request submitted now
+	microseconds expected(const microseconds &fallback) const;
+
 	// stats for tags
 	size_t tag_count() const;
 	size_t tag_committed() const;
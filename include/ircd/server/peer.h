@@ -26,6 +26,8 @@ struct ircd::server::peer
 	static conf::item<size_t> link_min_default;
 	static conf::item<size_t> link_max_default;
 	static conf::item<seconds> error_clear_default;
+	static conf::item<seconds> link_idle_timeout;
+	static constexpr const size_t LATENCY_SAMPLES {256};
 
 	net::ipport remote;
 	std::string hostname;
@@ -35,6 +37,12 @@ struct ircd::server::peer
 	std::string server_name;
 	size_t write_bytes {0};
 	size_t read_bytes {0};
+	net::handshakes handshakes;
+	microseconds ttfb {0};                       ///< EWMA time to first byte
+	microseconds rtt {0};                        ///< EWMA request completion
+	double concurrency {0.0};                    ///< EWMA tags in flight at submit
+	std::array<uint32_t, LATENCY_SAMPLES> latency {{0}}; ///< recent rtt (us) ring
+	size_t latency_count {0};                    ///< total samples into ring
 	bool op_resolve {false};
 	bool op_fini {false};
 
@@ -49,6 +57,7 @@ struct ircd::server::peer
 	void disperse(link &);
 	void del(link &);
 
+	void handle_latency(link &, const tag &);
 	void handle_head_recv(const link &, const tag &, const http::response::head &);
 	void handle_link_done(link &);
 	void handle_tag_done(link &, tag &) noexcept;
@@ -91,9 +100,13 @@ struct ircd::server::peer
 	size_t write_total() const;
 	size_t read_total() const;
 
+	// request completion time at percentile of recent samples
+	microseconds latency_percentile(const double &) const;
+
 	// link control panel
 	link &link_add(const size_t &num = 1);
 	link *link_get(const request &);
+	size_t link_reap();
 
 	// request panel
 	void submit(request &);
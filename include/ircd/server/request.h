@@ -146,6 +146,15 @@ struct ircd::server::request::opts
 	/// use that value with caution.
 	int16_t priority {0};
 
+	/// When true, a content buffer smaller than the content-length is used as
+	/// a window: content past the end of the buffer is received into it again
+	/// from the start rather than being discarded. The user must consume the
+	/// data with in.progress as it arrives; the second argument to progress
+	/// is then only a view of the window up to the end of the latest data.
+	/// This bounds the memory for a large response to the size of the buffer.
+	/// This does not apply to chunked encoded responses.
+	bool content_window {false};
+
 	/// Only applies when using dynamic content allocation with a chunked
 	/// encoded response. This will hint the chunk vector. Ideally it can be
 	/// set to the number of chunks expected in a response to avoid growth of
@@ -54,6 +54,8 @@ namespace ircd::server
 ///
 struct ircd::server::init
 {
+	ctx::context reaper;
+
 	void interrupt();
 	void close();
 	void wait();
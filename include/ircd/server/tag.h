@@ -36,6 +36,8 @@ struct ircd::server::tag
 		size_t chunk_read {0};         // content read after last chunk head
 		size_t chunk_length {0};       // -1 for chunk header mode
 		http::code status {(http::code)0};
+		steady_point started;          // first byte written to remote
+		steady_point head_recv;        // response head received
 	}
 	state;
 	ctx::promise<http::code> p;
@@ -53,6 +55,7 @@ struct ircd::server::tag
 	size_t content_remaining() const;
 
 	mutable_buffer make_read_discard_buffer() const;
+	mutable_buffer make_read_window_buffer() const;
 	mutable_buffer make_read_chunk_dynamic_content_buffer() const;
 	mutable_buffer make_read_chunk_dynamic_head_buffer() const;
 	mutable_buffer make_read_chunk_content_buffer() const;
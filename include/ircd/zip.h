@@ -0,0 +1,30 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2018 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#pragma once
+#define HAVE_IRCD_ZIP_H
+
+/// Content compression for HTTP content-encodings.
+///
+/// The result is a view of the output buffer. An empty result indicates the
+/// compressed content did not fit in the output buffer; a buffer the size of
+/// the input therefor yields a result only when compression is worthwhile.
+/// The encoders which libircd was built without always return an empty
+/// result; see has_gzip and has_brotli.
+namespace ircd::zip
+{
+	IRCD_EXCEPTION(ircd::error, error)
+
+	extern const bool has_gzip;
+	extern const bool has_brotli;
+
+	const_buffer gzip(const mutable_buffer &out, const const_buffer &in, const int &level = 9);
+	const_buffer brotli(const mutable_buffer &out, const const_buffer &in, const int &quality = 11);
+}
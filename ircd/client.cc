@@ -940,6 +940,15 @@ ircd::client::close(const net::close_opts &opts,
 	net::close(*sock, opts, std::move(callback));
 }
 
+size_t
+ircd::client::write_all(const vector_view<const const_buffer> &bufs)
+{
+	if(unlikely(!sock))
+		throw error{"No socket to client."};
+
+	return net::write_all(*sock, bufs);
+}
+
 size_t
 ircd::client::write_all(const const_buffer &buf)
 {
@@ -9,6 +9,7 @@
 // full license for this software is available in the LICENSE file.
 
 #include <RB_INC_X86INTRIN_H
+#include <RB_INC_SYS_MMAN_H
 #include <cxxabi.h>
 #include <ircd/asio.h>
 #include "ctx.h"
@@ -128,7 +129,7 @@ ircd::ctx::ctx::jump()
 /// if the context suspended and was notified. When a context wakes up the
 /// note counter is reset.
 bool
-ircd::ctx::ctx::wait()
+ircd::ctx::ctx::wait(const prof::reason &reason)
 {
 	namespace errc = boost::system::errc;
 
@@ -145,7 +146,7 @@ ircd::ctx::ctx::wait()
 	}};
 
 	boost::system::error_code ec;
-	alarm.async_wait(boost::asio::yield_context{to_asio{interruption}}[ec]);
+	alarm.async_wait(boost::asio::yield_context{to_asio{interruption, reason}}[ec]);
 
 	assert(ec == errc::operation_canceled || ec == errc::success);
 	assert(current == this);
@@ -169,11 +170,60 @@ ircd::ctx::ctx::note()
 	return true;
 }
 
+/// Yield (suspend) this context until notified without any timeout.
+///
+/// This has the same semantics as wait() but rather than yielding to an
+/// async_wait() on the alarm timer, the context suspends directly and is
+/// resumed from the ready queue when notified. This avoids the timer queue
+/// for the common case of waiting on a dock, mutex, etc without a deadline.
+bool
+ircd::ctx::ctx::park(const prof::reason &reason)
+{
+	assert(this->yc);
+	assert(current == this);
+
+	if(unlikely(!bool(sched::direct)))
+	{
+		alarm.expires_at(steady_clock::time_point::max());
+		return wait(reason);
+	}
+
+	if(--notes > 0)
+		return false;
+
+	const auto interruption{[this]
+	(ctx *const &interruptor) noexcept
+	{
+		wake();
+	}};
+
+	// Nothing else holds a reference to this coroutine while it's parked
+	// because there is no outstanding asio handler; we hold our own.
+	parked = yc->coro_.lock();
+	{
+		to_asio continuation{interruption, reason};
+		yc->ca_();
+	}
+
+	assert(!parked);
+	assert(current == this);
+	assert(notes == 1);  // notes = 1; set by continuation dtor on wakeup
+
+	interruption_point();
+	return true;
+}
+
 /// Wakes a context without a note (internal)
 void
 ircd::ctx::ctx::wake()
 try
 {
+	if(parked)
+	{
+		sched::push(*this);
+		return;
+	}
+
 	alarm.cancel();
 }
 catch(const boost::system::system_error &e)
@@ -246,6 +296,92 @@ ircd::ctx::ctx::interruption_point(std::nothrow_t)
 	else return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// ctx/sched
+//
+
+/// Linkage for the ready queue state
+decltype(ircd::ctx::sched::head)
+ircd::ctx::sched::head;
+
+decltype(ircd::ctx::sched::tail)
+ircd::ctx::sched::tail;
+
+decltype(ircd::ctx::sched::count)
+ircd::ctx::sched::count;
+
+decltype(ircd::ctx::sched::posted)
+ircd::ctx::sched::posted;
+
+decltype(ircd::ctx::sched::direct)
+ircd::ctx::sched::direct
+{
+	{ "name",     "ircd.ctx.sched.direct" },
+	{ "default",  true                    },
+};
+
+/// Appends a parked context to the ready queue. The first context added to an
+/// empty queue posts a single handler to the io_context to drain it; contexts
+/// readied meanwhile join that same handler rather than posting their own.
+void
+ircd::ctx::sched::push(ctx &c)
+noexcept
+{
+	assert(c.parked);
+	if(c.ready)
+		return;
+
+	c.ready = true;
+	c.ready_next = nullptr;
+	if(tail)
+		tail->ready_next = &c;
+	else
+		head = &c;
+
+	tail = &c;
+	++count;
+
+	if(!posted)
+	{
+		posted = true;
+		ios->post(&sched::drain);
+	}
+}
+
+/// Resumes every context which was in the ready queue when this was entered.
+/// Contexts readied while draining are left for the next handler so the ready
+/// queue can't starve the rest of the io_context.
+void
+ircd::ctx::sched::drain()
+{
+	assert(posted);
+	posted = false;
+	for(size_t i(count); i && head; --i)
+	{
+		ctx &c(*head);
+		head = c.ready_next;
+		if(!head)
+			tail = nullptr;
+
+		--count;
+		c.ready_next = nullptr;
+		c.ready = false;
+
+		// The coroutine is held here while it runs; if it parks again it
+		// takes a new reference for itself before suspending.
+		const auto coro(std::move(c.parked));
+		assert(coro);
+		(*coro)();
+	}
+
+	if(head && !posted)
+	{
+		posted = true;
+		ios->post(&sched::drain);
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // ctx/ctx.h
@@ -437,6 +573,18 @@ ircd::ctx::stack_max(const ctx &ctx)
 	return ctx.stack.max;
 }
 
+/// Returns the number of bytes of the stack for `ctx` resident in memory;
+/// this is generally the high watermark of the stack since it was mapped or
+/// last advised idle, regardless of how much is in use now.
+size_t
+ircd::ctx::stack_committed(const ctx &ctx)
+{
+	if(!started(ctx) || finished(ctx))
+		return 0;
+
+	return stacks::committed(ctx.stack.buf);
+}
+
 /// Returns the developer's optional name literal for `ctx`
 ircd::string_view
 ircd::ctx::name(const ctx &ctx)
@@ -476,6 +624,12 @@ ircd::ctx::this_ctx::wait_until(const std::chrono::steady_clock::time_point &tp,
                                 const std::nothrow_t &)
 {
 	auto &c(cur());
+	if(tp == std::chrono::steady_clock::time_point::max())
+	{
+		c.park();
+		return false;
+	}
+
 	c.alarm.expires_at(tp);
 	c.wait(); // now you're yielding with portals
 
@@ -506,8 +660,7 @@ void
 ircd::ctx::this_ctx::wait()
 {
 	auto &c(cur());
-	c.alarm.expires_at(std::chrono::steady_clock::time_point::max());
-	c.wait(); // now you're yielding with portals
+	c.park(); // now you're yielding with portals
 }
 
 /// Post the currently running context to the event queue and then suspend to
@@ -528,9 +681,10 @@ ircd::ctx::this_ctx::yield()
 	});
 
 	// All spurious notifications are ignored until `done`
+	auto &c(cur());
 	ios->post(restore); do
 	{
-		wait();
+		c.park(prof::reason::YIELD);
 	}
 	while(!done);
 }
@@ -703,12 +857,13 @@ noexcept
 // continuation
 //
 
-ircd::ctx::continuation::continuation()
+ircd::ctx::continuation::continuation(const prof::reason &reason)
 :self
 {
 	ircd::ctx::current
 }
 {
+	self->profile.reason = reason;
 	mark(prof::event::CUR_YIELD);
 	assert(!critical_asserted);
 	assert(self != nullptr);
@@ -776,9 +931,49 @@ noexcept
 
 namespace ircd::ctx
 {
+	template<class handler, class function> struct spawn_helper;
 	static void spawn(ctx *const c, context::function func);
 }
 
+/// This is the equivalent of boost::asio::spawn() except it supplies our own
+/// stack allocator to the coroutine, for which asio offers no interface. It
+/// reuses asio's own spawn_data and coro_entry_point so the yield_context
+/// given to the ctx is the same as one from asio::spawn().
+template<class handler,
+         class function>
+struct ircd::ctx::spawn_helper
+{
+	using data_type = boost::asio::detail::spawn_data<handler, function>;
+	using entry_type = boost::asio::detail::coro_entry_point<handler, function>;
+	using callee_type = typename boost::asio::basic_yield_context<handler>::callee_type;
+	using executor_type = typename boost::asio::associated_executor<handler>::type;
+
+	boost::asio::detail::shared_ptr<data_type> data;
+	boost::coroutines::attributes attributes;
+	stack::allocator allocator;
+
+	executor_type get_executor() const noexcept
+	{
+		return boost::asio::get_associated_executor(data->handler_);
+	}
+
+	void operator()()
+	{
+		const entry_type entry_point
+		{
+			data
+		};
+
+		const boost::asio::detail::shared_ptr<callee_type> coro
+		{
+			new callee_type(entry_point, attributes, allocator)
+		};
+
+		data->coro_ = coro;
+		(*coro)();
+	}
+};
+
 void
 ircd::ctx::spawn(ctx *const c,
                  context::function func)
@@ -794,7 +989,25 @@ ircd::ctx::spawn(ctx *const c,
 		std::bind(&ctx::operator(), c, ph::_1, std::move(func))
 	};
 
-	boost::asio::spawn(c->strand, std::move(bound), attrs);
+	auto handler
+	{
+		boost::asio::bind_executor(c->strand, &boost::asio::detail::default_spawn_handler)
+	};
+
+	using handler_type = decltype(handler);
+	using function_type = decltype(bound);
+	using helper_type = spawn_helper<handler_type, function_type>;
+	helper_type helper
+	{
+		boost::asio::detail::shared_ptr<typename helper_type::data_type>
+		{
+			new typename helper_type::data_type(std::move(handler), true, std::move(bound))
+		},
+		attrs,
+		stack::allocator{c},
+	};
+
+	boost::asio::dispatch(std::move(helper));
 }
 
 ircd::ctx::context::context(const char *const &name,
@@ -962,7 +1175,7 @@ noexcept
 void
 ircd::ctx::pool::operator()(closure closure)
 {
-	queue.push_back(std::move(closure));
+	queue.emplace_back(std::move(closure), __rdtsc());
 	dock.notify();
 }
 
@@ -1041,9 +1254,16 @@ try
 		--working;
 	});
 
-	const auto func(std::move(queue.front()));
+	const auto job(std::move(queue.front()));
 	queue.pop_front();
-	func();
+
+	const ulong started(__rdtsc());
+	const unwind profile([&job, &started]
+	{
+		prof::mark_job(cur(), job.second, started, __rdtsc());
+	});
+
+	job.first();
 }
 catch(const interrupted &e)
 {
@@ -1086,8 +1306,17 @@ ircd::ctx::debug_stats(const pool &pool)
 
 namespace ircd::ctx::prof
 {
+	using stats_map = std::map<std::string, struct stats, std::less<>>;
+
+	extern conf::item<bool> enable;
+
 	ulong _slice_start;      // Time slice state
 	ulong _slice_total;      // Monotonic accumulator
+	stats_map _stats;        // Aggregates by context name
+
+	static size_t bucket(const ulong &cycles);
+	static struct stats &stats_of(ctx &);
+	static void handle(const event &);
 
 	void check_stack();
 	void check_slice();
@@ -1110,9 +1339,30 @@ ircd::ctx::prof::settings
 	0UL,               // slice_assertion unused; warning sufficient for now...
 };
 
+decltype(ircd::ctx::prof::enable)
+ircd::ctx::prof::enable
+{
+	{ "name",     "ircd.ctx.prof.enable"  },
+	{ "default",  true                    },
+};
+
 #ifdef RB_DEBUG
 void
 ircd::ctx::prof::mark(const event &e)
+{
+	handle(e);
+}
+#else
+void
+ircd::ctx::prof::mark(const event &e)
+{
+	if(likely(bool(enable)))
+		handle(e);
+}
+#endif
+
+void
+ircd::ctx::prof::handle(const event &e)
 {
 	switch(e)
 	{
@@ -1123,13 +1373,94 @@ ircd::ctx::prof::mark(const event &e)
 		default:                                             break;
 	}
 }
-#else
+
+/// Records a pool job on the stats of the pool context which ran it; called
+/// by the pool when the job returns or throws.
 void
-ircd::ctx::prof::mark(const event &e)
+ircd::ctx::prof::mark_job(ctx &c,
+                          const ulong &queued,
+                          const ulong &started,
+                          const ulong &finished)
 {
-}
+#ifndef RB_DEBUG
+	if(!bool(enable))
+		return;
 #endif
 
+	auto &s(stats_of(c));
+	++s.jobs;
+	s.queued += started - queued;
+	s.worked += finished - started;
+	++s.queue[bucket(started - queued)];
+	++s.work[bucket(finished - started)];
+}
+
+string_view
+ircd::ctx::prof::reflect(const reason &r)
+{
+	switch(r)
+	{
+		case reason::IO:       return "IO";
+		case reason::LOCK:     return "LOCK";
+		case reason::SLEEP:    return "SLEEP";
+		case reason::YIELD:    return "YIELD";
+		case reason::_NUM_:    break;
+	}
+
+	return "?????";
+}
+
+bool
+ircd::ctx::prof::for_each(const std::function<bool (const string_view &, const stats &)> &closure)
+{
+	for(const auto &p : _stats)
+		if(!closure(p.first, p.second))
+			return false;
+
+	return true;
+}
+
+const ircd::ctx::prof::stats *
+ircd::ctx::prof::find(const string_view &name)
+{
+	const auto it(_stats.find(name));
+	return it != end(_stats)? &it->second : nullptr;
+}
+
+/// Zeroes the stats for every name. The entries themselves are kept because
+/// running contexts hold pointers to them.
+void
+ircd::ctx::prof::reset()
+{
+	for(auto &p : _stats)
+		p.second = stats{};
+}
+
+ircd::ctx::prof::stats &
+ircd::ctx::prof::stats_of(ctx &c)
+{
+	if(likely(c.profile.stats))
+		return *c.profile.stats;
+
+	const string_view name
+	{
+		c.name? c.name : "<noname>"
+	};
+
+	auto it(_stats.lower_bound(name));
+	if(it == end(_stats) || string_view{it->first} != name)
+		it = _stats.emplace_hint(it, std::string(name), stats{});
+
+	c.profile.stats = &it->second;
+	return it->second;
+}
+
+size_t
+ircd::ctx::prof::bucket(const ulong &cycles)
+{
+	return cycles? 63 - __builtin_clzl(cycles) : 0;
+}
+
 ulong
 ircd::ctx::prof::cur_slice_cycles()
 {
@@ -1152,6 +1483,7 @@ void
 ircd::ctx::prof::handle_cur_enter()
 {
 	slice_start();
+	++stats_of(cur()).contexts;
 }
 
 void
@@ -1163,6 +1495,8 @@ ircd::ctx::prof::handle_cur_leave()
 void
 ircd::ctx::prof::handle_cur_yield()
 {
+	auto &c(cur());
+	++stats_of(c).yields.at(size_t(c.profile.reason));
 	check_slice();
 	check_stack();
 }
@@ -1171,6 +1505,10 @@ void
 ircd::ctx::prof::handle_cur_continue()
 {
 	slice_start();
+
+	auto &c(cur());
+	if(likely(c.profile.suspended && c.profile.suspended <= _slice_start))
+		stats_of(c).waited.at(size_t(c.profile.reason)) += _slice_start - c.profile.suspended;
 }
 
 void
@@ -1189,8 +1527,15 @@ ircd::ctx::prof::check_slice()
 
 	auto &c(cur());
 	c.profile.cycles += last_cycles;
+	c.profile.suspended = _slice_start + last_cycles;
 	_slice_total += last_cycles;
 
+	auto &s(stats_of(c));
+	++s.slices;
+	s.cycles += last_cycles;
+	s.slice_max = std::max(s.slice_max, uint64_t(last_cycles));
+	++s.slice[bucket(last_cycles)];
+
 	if(unlikely(settings.slice_warning > 0 && last_cycles >= settings.slice_warning))
 		log::dwarning
 		{
@@ -1237,6 +1582,216 @@ ircd::ctx::prof::check_stack()
 	}
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// ctx/stack.h
+//
+
+namespace ircd::ctx::stacks
+{
+	extern conf::item<size_t> idle_max;
+	extern conf::item<bool> idle_advise;
+
+	std::map<size_t, std::vector<char *>> idle;
+	const size_t page_size(sysconf(_SC_PAGESIZE));
+
+	static size_t committed(const const_buffer &) noexcept;
+	static char *take(const size_t &size);
+	static void give(char *const &ptr, const size_t &size) noexcept;
+	static void unmap(char *const &ptr, const size_t &size) noexcept;
+}
+
+decltype(ircd::ctx::stacks::stats)
+ircd::ctx::stacks::stats
+{};
+
+decltype(ircd::ctx::stacks::idle_max)
+ircd::ctx::stacks::idle_max
+{
+	{ "name",     "ircd.ctx.stack.idle.max"  },
+	{ "default",  int64_t(64)                },
+};
+
+decltype(ircd::ctx::stacks::idle_advise)
+ircd::ctx::stacks::idle_advise
+{
+	{ "name",     "ircd.ctx.stack.idle.advise"  },
+	{ "default",  true                          },
+};
+
+void
+ircd::ctx::stack::allocator::allocate(boost::coroutines::stack_context &sc,
+                                      size_t size)
+{
+	const auto &page_size(stacks::page_size);
+	size = (size + page_size - 1) & ~(page_size - 1);
+	char *const ptr
+	{
+		stacks::take(size)
+	};
+
+	sc.size = size;
+	sc.sp = ptr + size;
+	if(c)
+		c->stack.buf = mutable_buffer
+		{
+			ptr, size
+		};
+}
+
+void
+ircd::ctx::stack::allocator::deallocate(boost::coroutines::stack_context &sc)
+noexcept
+{
+	assert(sc.sp);
+	char *const ptr
+	{
+		reinterpret_cast<char *>(sc.sp) - sc.size
+	};
+
+	stacks::give(ptr, sc.size);
+}
+
+/// Unmaps idle stacks leaving at most `keep` on the free list for each size.
+/// Returns the number of stacks unmapped.
+size_t
+ircd::ctx::stacks::trim(const size_t &keep)
+{
+	size_t ret(0);
+	for(auto &p : idle)
+	{
+		const auto &size(p.first);
+		auto &list(p.second);
+		for(; list.size() > keep; ++ret)
+		{
+			unmap(list.back(), size);
+			list.pop_back();
+			--stats.idle;
+		}
+	}
+
+	return ret;
+}
+
+size_t
+ircd::ctx::stacks::committed()
+{
+	size_t ret(0);
+	for(const auto *const &c : ctx::ctx::list)
+		ret += stack_committed(*c);
+
+	for(const auto &p : idle)
+		for(const auto &ptr : p.second)
+			ret += committed(const_buffer{ptr, p.first});
+
+	return ret;
+}
+
+char *
+ircd::ctx::stacks::take(const size_t &size)
+{
+	auto &list(idle[size]);
+	++stats.allocs;
+	if(!list.empty())
+	{
+		char *const ret(list.back());
+		list.pop_back();
+		++stats.reuses;
+		++stats.active;
+		--stats.idle;
+		return ret;
+	}
+
+	// The mapping is the stack plus one guard page below it where the
+	// stack grows into on overflow.
+	void *const map
+	{
+		::mmap(nullptr,
+		       size + page_size,
+		       PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+		       -1,
+		       0)
+	};
+
+	if(unlikely(map == MAP_FAILED))
+		throw std::bad_alloc{};
+
+	if(unlikely(::mprotect(map, page_size, PROT_NONE) != 0))
+	{
+		::munmap(map, size + page_size);
+		throw std::bad_alloc{};
+	}
+
+	stats.reserved += size + page_size;
+	++stats.mapped;
+	++stats.active;
+	return reinterpret_cast<char *>(map) + page_size;
+}
+
+void
+ircd::ctx::stacks::give(char *const &ptr,
+                        const size_t &size)
+noexcept
+{
+	assert(stats.active > 0);
+	--stats.active;
+
+	auto &list(idle[size]);
+	if(list.size() >= size_t(idle_max))
+	{
+		unmap(ptr, size);
+		return;
+	}
+
+	// The pages are left mapped but the kernel may reclaim them lazily; the
+	// next user of this stack takes a fault per page it touches again.
+	if(bool(idle_advise))
+	{
+		#ifdef MADV_FREE
+		const int advice(MADV_FREE);
+		#else
+		const int advice(MADV_DONTNEED);
+		#endif
+
+		if(likely(::madvise(ptr, size, advice) == 0))
+			++stats.advised;
+	}
+
+	list.emplace_back(ptr);
+	++stats.idle;
+}
+
+void
+ircd::ctx::stacks::unmap(char *const &ptr,
+                         const size_t &size)
+noexcept
+{
+	::munmap(ptr - page_size, size + page_size);
+	stats.reserved -= size + page_size;
+	--stats.mapped;
+}
+
+size_t
+ircd::ctx::stacks::committed(const const_buffer &buf)
+noexcept
+{
+	if(!data(buf) || !size(buf))
+		return 0;
+
+	const size_t pages(size(buf) / page_size);
+	std::vector<unsigned char> vec(pages);
+	auto *const ptr(const_cast<char *>(data(buf)));
+	if(unlikely(::mincore(ptr, size(buf), vec.data()) != 0))
+		return 0;
+
+	return page_size * std::count_if(begin(vec), end(vec), []
+	(const unsigned char &c)
+	{
+		return c & 0x01;
+	});
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // ctx_ole.h
@@ -14,9 +14,25 @@ namespace ircd::ctx
 	struct profile;
 }
 
+/// Ready queue of parked contexts (internal)
+namespace ircd::ctx::sched
+{
+	extern ctx *head;                      // next context to resume
+	extern ctx *tail;                      // last context to resume
+	extern size_t count;                   // contexts in the queue
+	extern bool posted;                    // drain() is queued with the ios
+	extern conf::item<bool> direct;        // park() with ready queue or alarm
+
+	void push(ctx &) noexcept;
+	void drain();
+}
+
 /// Internal structure aggregating any stack related state for the ctx
 struct ircd::ctx::stack
 {
+	struct allocator;
+
+	mutable_buffer buf;                    // assigned when allocated
 	uintptr_t base {0};                    // assigned when spawned
 	size_t max {0};                        // User given stack size
 	size_t at {0};                         // Updated for profiling at sleep
@@ -26,19 +42,40 @@ struct ircd::ctx::stack
 	{}
 };
 
+/// The StackAllocator concept for boost::coroutines. Instances are copied into
+/// the coroutine and deallocate() is called when the coroutine is destroyed,
+/// which may be after the ctx itself is gone; only allocate() touches the ctx.
+struct ircd::ctx::stack::allocator
+{
+	ctx *c {nullptr};
+
+	void allocate(boost::coroutines::stack_context &, size_t size);
+	void deallocate(boost::coroutines::stack_context &) noexcept;
+};
+
 /// Internal structure aggregating any profiling related state for the ctx
 struct ircd::ctx::profile
 {
 	ulong cycles {0};                            // monotonic counter (rdtsc)
 	uint64_t yields {0};                         // monotonic counter
+	ulong suspended {0};                         // rdtsc at the last yield
+	prof::reason reason {prof::reason::IO};      // reason for the last yield
+	prof::stats *stats {nullptr};                // stats for this name (lazy)
 };
 
+/// Profiling hooks internal to the context system
+namespace ircd::ctx::prof
+{
+	void mark_job(ctx &, const ulong &queued, const ulong &started, const ulong &finished);
+}
+
 /// Internal context implementation
 ///
 struct ircd::ctx::ctx
 :instance_list<ctx>
 {
 	using error_code = boost::system::error_code;
+	using coroutine_ptr = boost::asio::detail::shared_ptr<boost::asio::yield_context::callee_type>;
 
 	static uint64_t id_ctr;                      // monotonic
 
@@ -46,8 +83,11 @@ struct ircd::ctx::ctx
 	const char *name {nullptr};                  // User given name (optional)
 	context::flags flags {(context::flags)0};    // User given flags
 	boost::asio::io_service::strand strand;      // mutex/serializer
-	boost::asio::steady_timer alarm;             // acting semaphore (64B)
+	boost::asio::steady_timer alarm;             // timeout semaphore (64B)
 	boost::asio::yield_context *yc {nullptr};    // boost interface
+	coroutine_ptr parked;                        // own coroutine while parked
+	ctx *ready_next {nullptr};                   // link for the ready queue
+	bool ready {false};                          // indicates in the ready queue
 	continuation *cont {nullptr};                // valid when asleep; invalid when awake
 	int64_t notes {0};                           // norm: 0 = asleep; 1 = awake; inc by others; dec by self
 	ircd::ctx::stack stack;                      // stack related structure
@@ -62,9 +102,10 @@ struct ircd::ctx::ctx
 	bool termination_point(std::nothrow_t);      // Check for terminate
 	void interruption_point();                   // throws interrupted or terminated
 
-	bool wait();                                 // yield context to ios queue (returns on this resume)
+	bool wait(const prof::reason & = prof::reason::SLEEP); // yield context to ios queue (returns on this resume)
+	bool park(const prof::reason & = prof::reason::LOCK);  // yield context to ready queue (returns on this resume)
 	void jump();                                 // jump to context directly (returns on your resume)
-	void wake();                                 // jump to context by queueing with ios (use note())
+	void wake();                                 // jump to context by queueing (use note())
 	bool note();                                 // properly request wake()
 
 	void operator()(boost::asio::yield_context, const std::function<void ()>) noexcept;
@@ -25,6 +25,7 @@
 #include <rocksdb/filter_policy.h>
 #include <rocksdb/table.h>
 #include <rocksdb/sst_file_manager.h>
+#include <rocksdb/sst_file_writer.h>
 
 // ircd::db interfaces requiring complete RocksDB (frontside).
 #include <ircd/db/database/comparator.h>
@@ -5111,6 +5112,90 @@ ircd::db::compact(column &column,
 	};
 }
 
+void
+ircd::db::ingest(column &column,
+                 const vector_view<column::delta> &deltas)
+{
+	if(deltas.empty())
+		return;
+
+	database::column &c(column);
+	database &d(*c.d);
+	std::stable_sort(begin(deltas), end(deltas), [&c]
+	(const column::delta &a, const column::delta &b)
+	{
+		return c.cmp.Compare(slice(std::get<column::delta::KEY>(a)),
+		                     slice(std::get<column::delta::KEY>(b))) < 0;
+	});
+
+	static uint64_t ingest_id;
+	const std::string path
+	{
+		fmt::snstringf
+		{
+			fs::PATH_MAX, "%s/ingest_%s_%lu.sst",
+			db::path(name(d)),
+			name(c),
+			++ingest_id
+		}
+	};
+
+	ctx::interruption_point();
+	ctx::uninterruptible::nothrow ui;
+
+	size_t count(0);
+	rocksdb::SstFileWriter writer
+	{
+		rocksdb::EnvOptions{}, d.d->GetOptions(c), c
+	};
+
+	throw_on_error
+	{
+		writer.Open(path)
+	};
+
+	for(size_t i(0); i < deltas.size(); ++i)
+	{
+		const auto &delta(deltas.at(i));
+		assert(std::get<column::delta::OP>(delta) == op::SET);
+
+		// Equal keys are adjacent after the stable sort; keep the last.
+		if(i + 1 < deltas.size())
+			if(std::get<column::delta::KEY>(deltas.at(i + 1)) == std::get<column::delta::KEY>(delta))
+				continue;
+
+		throw_on_error
+		{
+			writer.Put(slice(std::get<column::delta::KEY>(delta)),
+			           slice(std::get<column::delta::VAL>(delta)))
+		};
+
+		++count;
+	}
+
+	throw_on_error
+	{
+		writer.Finish()
+	};
+
+	log::debug
+	{
+		log, "'%s':'%s' @%lu INGEST %zu keys from %s",
+		name(d),
+		name(c),
+		sequence(d),
+		count,
+		path
+	};
+
+	rocksdb::IngestExternalFileOptions opts;
+	opts.move_files = true;
+	throw_on_error
+	{
+		d.d->IngestExternalFile(c, {path}, opts)
+	};
+}
+
 void
 ircd::db::setopt(column &column,
                  const string_view &key,
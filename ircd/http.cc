@@ -87,6 +87,7 @@ ircd::http::reason
 	{ code::PAYLOAD_TOO_LARGE,                   "Payload Too Large"                               },
 	{ code::REQUEST_URI_TOO_LONG,                "Request URI Too Long"                            },
 	{ code::UNSUPPORTED_MEDIA_TYPE,              "Unsupported Media Type"                          },
+	{ code::RANGE_NOT_SATISFIABLE,               "Range Not Satisfiable"                           },
 	{ code::EXPECTATION_FAILED,                  "Expectation Failed"                              },
 	{ code::IM_A_TEAPOT,                         "Negative, I Am A Meat Popsicle"                  },
 	{ code::UNPROCESSABLE_ENTITY,                "Unprocessable Entity"                            },
@@ -303,6 +304,12 @@ ircd::http::request::head::head(parse::capstan &pc,
 			this->content_type = h.second;
 		else if(iequals(h.first, "user-agent"_sv))
 			this->user_agent = h.second;
+		else if(iequals(h.first, "range"_sv))
+			this->range = h.second;
+		else if(iequals(h.first, "if-none-match"_sv))
+			this->if_none_match = h.second;
+		else if(iequals(h.first, "accept-encoding"_sv))
+			this->accept_encoding = h.second;
 
 		if(c)
 			c(h);
@@ -180,6 +180,7 @@ noexcept try
 
 	fs::init _fs_;           // Local filesystem
 	magic::init _magic_;     // libmagic
+	magick::init _magick_;   // GraphicsMagick
 	ctx::ole::init _ole_;    // Thread OffLoad Engine
 	nacl::init _nacl_;       // nacl crypto
 	openssl::init _ossl_;    // openssl crypto
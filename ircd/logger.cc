@@ -12,10 +12,12 @@
 // <iostream> inclusion here runs std::ios_base::Init() statically as this unit
 // is initialized (GNU initialization order given in Makefile).
 
+#include <RB_INC_UNISTD_H
+#include <RB_INC_SYS_UIO_H
+
 namespace ircd::log
 {
 	// Option toggles
-	std::array<bool, num_of<facility>()> file_flush;
 	std::array<bool, num_of<facility>()> console_flush;
 	std::array<const char *, num_of<facility>()> console_ansi;
 
@@ -30,7 +32,7 @@ namespace ircd::log
 
 	// Logfile name and device
 	std::array<const char *, num_of<facility>()> fname;
-	std::array<std::ofstream, num_of<facility>()> file;
+	std::array<fs::fd, num_of<facility>()> file;
 
 	std::ostream &out_console
 	{
@@ -72,14 +74,14 @@ ircd::log::init()
 	file_out[INFO]           = true;
 	file_out[DEBUG]          = ircd::debugmode;
 
-	file_flush[CRITICAL]     = true;
-	file_flush[ERROR]        = true;
-	file_flush[DERROR]       = true;
-	file_flush[WARNING]      = true;
-	file_flush[DWARNING]     = true;
-	file_flush[NOTICE]       = false;
-	file_flush[INFO]         = false;
-	file_flush[DEBUG]        = false;
+	writer::sync[CRITICAL]   = true;
+	writer::sync[ERROR]      = false;
+	writer::sync[DERROR]     = false;
+	writer::sync[WARNING]    = false;
+	writer::sync[DWARNING]   = false;
+	writer::sync[NOTICE]     = false;
+	writer::sync[INFO]       = false;
+	writer::sync[DEBUG]      = false;
 
 	console_flush[CRITICAL]  = true;
 	console_flush[ERROR]     = true;
@@ -98,18 +100,22 @@ ircd::log::init()
 	console_ansi[NOTICE]    = "\033[1;37;46m";
 	console_ansi[INFO]      = "\033[1;37;42m";
 	console_ansi[DEBUG]     = "\033[1;30;47m";
+
+	writer::start(1_MiB);
 }
 
 void
 ircd::log::fini()
 {
 	flush();
+	writer::stop();
 	close();
 }
 
 void
 ircd::log::open()
 {
+	writer::drain();
 	for_each<facility>([](const facility &fac)
 	{
 		if(!fname[fac])
@@ -118,11 +124,7 @@ ircd::log::open()
 		if(!file_out[fac])
 			return;
 
-		if(file[fac].is_open())
-			file[fac].close();
-
-		file[fac].clear();
-		file[fac].exceptions(std::ios::badbit | std::ios::failbit);
+		file[fac] = fs::fd{};
 		open(fac);
 	});
 }
@@ -130,21 +132,17 @@ ircd::log::open()
 void
 ircd::log::close()
 {
+	writer::drain();
 	for_each<facility>([](const facility &fac)
 	{
-		if(file[fac].is_open())
-			file[fac].close();
+		file[fac] = fs::fd{};
 	});
 }
 
 void
 ircd::log::flush()
 {
-	for_each<facility>([](const facility &fac)
-	{
-		file[fac].flush();
-	});
-
+	writer::drain();
 	std::flush(out_console);
 	std::flush(err_console);
 }
@@ -153,8 +151,15 @@ void
 ircd::log::open(const facility &fac)
 try
 {
-	const auto &mode(std::ios::app);
-	file[fac].open(fname[fac], mode);
+	const fs::fd::opts opts
+	{
+		std::ios::out | std::ios::app
+	};
+
+	file[fac] = fs::fd
+	{
+		fname[fac], opts
+	};
 }
 catch(const std::exception &e)
 {
@@ -333,6 +338,314 @@ ircd::log::log::log(const string_view &name,
 	}
 }
 
+//
+// writer
+//
+
+namespace ircd::log::writer
+{
+	struct header;
+
+	static void write(const int &fd, struct ::iovec *iov, size_t cnt) noexcept;
+	static void write(const facility &, const string_view &) noexcept;
+	static bool push(const facility &, const string_view &) noexcept;
+	static void notify() noexcept;
+	static bool batch() noexcept;
+	static void wait() noexcept;
+	static void worker() noexcept;
+
+	// Ring buffer; head is only advanced by the main thread and tail is only
+	// advanced by the writer thread.
+	std::unique_ptr<char[]> buf;
+	size_t mask;
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+
+	// Writer thread state
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable dock;
+	std::atomic<bool> waiting;
+	std::atomic<bool> terminate;
+}
+
+/// Each record in the ring is prefixed by this header and the whole record
+/// is padded to the alignment of this header. A record never wraps around
+/// the end of the ring; instead a PAD record fills out the remaining space
+/// so that every message can be handed to writev(2) as one contiguous iov.
+struct ircd::log::writer::header
+{
+	static constexpr const uint32_t PAD
+	{
+		std::numeric_limits<uint32_t>::max()
+	};
+
+	uint32_t fac;
+	uint32_t len;
+
+	static size_t size(const size_t &len)
+	{
+		return (sizeof(header) + len + sizeof(header) - 1) & ~(sizeof(header) - 1);
+	}
+};
+
+decltype(ircd::log::writer::sync)
+ircd::log::writer::sync;
+
+decltype(ircd::log::writer::stats)
+ircd::log::writer::stats;
+
+void
+ircd::log::writer::start(const size_t &ring_size)
+{
+	if(running())
+		return;
+
+	if(!ring_size || (ring_size & (ring_size - 1)))
+		throw ircd::error
+		{
+			"Log writer ring size %zu must be a power of two", ring_size
+		};
+
+	buf.reset(new char[ring_size]);
+	mask = ring_size - 1;
+	head.store(0);
+	tail.store(0);
+	waiting.store(false);
+	terminate.store(false);
+	stats.ring_size = ring_size;
+	stats.ring_used = 0;
+	thread = std::thread{&worker};
+}
+
+void
+ircd::log::writer::stop()
+{
+	if(!running())
+		return;
+
+	drain();
+	terminate.store(true);
+	{
+		const std::lock_guard<std::mutex> lock{mutex};
+		dock.notify_all();
+	}
+
+	thread.join();
+	buf.reset();
+	stats.ring_size = 0;
+	stats.ring_used = 0;
+}
+
+/// Blocks the calling thread until the writer thread has written out every
+/// record in the ring. This is used before files are reopened or closed and
+/// ahead of any synchronous write so the file's order is preserved.
+void
+ircd::log::writer::drain()
+{
+	if(!running())
+		return;
+
+	notify();
+	while(tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed))
+		std::this_thread::yield();
+}
+
+bool
+ircd::log::writer::running()
+{
+	return thread.joinable();
+}
+
+/// Copies the record into the ring; called on the main thread only. The
+/// record is dropped if there's no room rather than waiting for the writer.
+bool
+ircd::log::writer::push(const facility &fac,
+                        const string_view &msg)
+noexcept
+{
+	const size_t cap(mask + 1);
+	const size_t need(header::size(size(msg)));
+	size_t pos(head.load(std::memory_order_relaxed));
+	const size_t used(pos - tail.load(std::memory_order_acquire));
+	const size_t off(pos & mask);
+	const size_t pad(off + need > cap? cap - off : 0);
+	if(unlikely(used + pad + need > cap))
+	{
+		stats.dropped++;
+		stats.dropped_bytes += size(msg);
+		return false;
+	}
+
+	if(pad)
+	{
+		auto &h(*reinterpret_cast<header *>(buf.get() + off));
+		h.fac = header::PAD;
+		h.len = pad - sizeof(header);
+		pos += pad;
+	}
+
+	char *const ptr(buf.get() + (pos & mask));
+	auto &h(*reinterpret_cast<header *>(ptr));
+	h.fac = fac;
+	h.len = size(msg);
+	memcpy(ptr + sizeof(header), data(msg), size(msg));
+
+	// The store must be sequentially consistent with the load of `waiting`
+	// in notify() against the inverse order in wait() to not lose a wakeup.
+	head.store(pos + need, std::memory_order_seq_cst);
+	stats.queued++;
+	notify();
+	return true;
+}
+
+/// Synchronous write on the calling thread after anything in the ring.
+void
+ircd::log::writer::write(const facility &fac,
+                         const string_view &msg)
+noexcept
+{
+	drain();
+	struct ::iovec iov
+	{
+		const_cast<char *>(data(msg)), size(msg)
+	};
+
+	const int &fd(file[fac]);
+	write(fd, &iov, 1);
+	if(sync[fac])
+	{
+		::fdatasync(fd);
+		stats.synced++;
+	}
+}
+
+void
+ircd::log::writer::notify()
+noexcept
+{
+	if(!waiting.load(std::memory_order_seq_cst))
+		return;
+
+	const std::lock_guard<std::mutex> lock{mutex};
+	dock.notify_one();
+}
+
+void
+ircd::log::writer::worker()
+noexcept
+{
+	while(!terminate.load(std::memory_order_relaxed))
+		if(!batch())
+			wait();
+
+	while(batch());
+}
+
+void
+ircd::log::writer::wait()
+noexcept
+{
+	std::unique_lock<std::mutex> lock{mutex};
+	waiting.store(true, std::memory_order_seq_cst);
+	dock.wait_for(lock, milliseconds(250), []
+	{
+		return terminate.load(std::memory_order_relaxed) ||
+		       head.load(std::memory_order_seq_cst) != tail.load(std::memory_order_relaxed);
+	});
+
+	waiting.store(false, std::memory_order_relaxed);
+}
+
+/// Gathers everything in the ring at the time of the call into one iov
+/// array per facility and writes each with writev(2). The ring space is
+/// released to the main thread after the batch is written.
+bool
+ircd::log::writer::batch()
+noexcept
+{
+	static const size_t iov_max
+	{
+		64
+	};
+
+	struct ::iovec iov[num_of<facility>()][iov_max];
+	size_t iovcnt[num_of<facility>()] {0};
+
+	const size_t start(tail.load(std::memory_order_relaxed));
+	const size_t stop(head.load(std::memory_order_acquire));
+	size_t pos(start), records(0);
+	while(pos != stop)
+	{
+		char *const ptr(buf.get() + (pos & mask));
+		const auto &h(*reinterpret_cast<const header *>(ptr));
+		if(h.fac == header::PAD)
+		{
+			pos += sizeof(header) + h.len;
+			continue;
+		}
+
+		assert(h.fac < num_of<facility>());
+		auto &cnt(iovcnt[h.fac]);
+		if(cnt >= iov_max)
+			break;
+
+		iov[h.fac][cnt++] = { ptr + sizeof(header), h.len };
+		pos += header::size(h.len);
+		++records;
+	}
+
+	for(size_t i(0); i < num_of<facility>(); ++i)
+		if(iovcnt[i])
+			write(file[i], iov[i], iovcnt[i]);
+
+	tail.store(pos, std::memory_order_release);
+	stats.written += records;
+	stats.ring_used = stop - pos;
+	return pos != start;
+}
+
+void
+ircd::log::writer::write(const int &fd,
+                         struct ::iovec *iov,
+                         size_t cnt)
+noexcept
+{
+	if(unlikely(fd < 0))
+		return;
+
+	while(cnt)
+	{
+		const ssize_t ret
+		{
+			::writev(fd, iov, cnt)
+		};
+
+		if(unlikely(ret < 0))
+		{
+			if(errno == EINTR)
+				continue;
+
+			stats.errors++;
+			return;
+		}
+
+		stats.batches++;
+		stats.bytes += ret;
+		for(size_t rem(ret); cnt; ++iov, --cnt)
+		{
+			if(rem < iov->iov_len)
+			{
+				iov->iov_base = reinterpret_cast<char *>(iov->iov_base) + rem;
+				iov->iov_len -= rem;
+				break;
+			}
+
+			rem -= iov->iov_len;
+		}
+	}
+}
+
 //
 // vlog
 //
@@ -419,11 +732,11 @@ noexcept
 {
 	// When all of these conditions are true there is no possible log output
 	// so we can bail real quick.
-	if(!file[fac].is_open() && !console_out[fac] && !console_err[fac])
+	if(file[fac] < 0 && !console_out[fac] && !console_err[fac])
 		return;
 
 	// Same for this set of conditions...
-	if((!file[fac].is_open() || !log.fmasked) && !log.cmasked)
+	if((file[fac] < 0 || !log.fmasked) && !log.cmasked)
 		return;
 
 	// Have to be on the main thread to call slog().
@@ -504,13 +817,13 @@ noexcept
 			std::flush(out_console);
 	}
 
-	// copy to file
-	if(log.fmasked && file[fac].is_open())
+	// copy to file; queued for the writer thread unless synchronous.
+	if(log.fmasked && file[fac] >= 0)
 	{
-		file[fac].clear();
-		write(file[fac]);
-		if(file_flush[fac])
-			std::flush(file[fac]);
+		if(!writer::running() || writer::sync[fac])
+			writer::write(fac, msg);
+		else
+			writer::push(fac, msg);
 	}
 }
 
@@ -51,6 +51,11 @@ decltype(ircd::m::dbs::room_state)
 ircd::m::dbs::room_state
 {};
 
+/// Linkage for a reference to the room_depth column
+decltype(ircd::m::dbs::room_depth)
+ircd::m::dbs::room_depth
+{};
+
 /// Linkage for a reference to the state_node column.
 decltype(ircd::m::dbs::state_node)
 ircd::m::dbs::state_node
@@ -86,6 +91,7 @@ ircd::m::dbs::init::init(std::string dbopts)
 	room_events = db::index{*events, desc::events__room_events.name};
 	room_joined = db::index{*events, desc::events__room_joined.name};
 	room_state = db::index{*events, desc::events__room_state.name};
+	room_depth = db::index{*events, desc::events__room_depth.name};
 	state_node = db::column{*events, desc::events__state_node.name};
 }
 
@@ -94,10 +100,490 @@ ircd::m::dbs::init::init(std::string dbopts)
 ircd::m::dbs::init::~init()
 noexcept
 {
+	room_cache_clear();
+
 	// Unref DB (should close)
 	events = {};
 }
 
+//
+// Room cache
+//
+
+namespace ircd::m::dbs
+{
+	struct room_cache_entry;
+
+	static room_cache_entry *_room_cache_find(const string_view &room_id);
+	static room_cache_entry &_room_cache_make(const string_view &room_id);
+	static room_cache_entry &_room_cache_load_head(const id::room &);
+	static std::pair<event::id::buf, event::idx> _room_cache_state(const id::room &, const string_view &type, const string_view &state_key);
+	static void _room_cache_account(room_cache_entry &, const ssize_t &);
+	static void _room_cache_account_head(room_cache_entry &);
+	static void _room_cache_shrink(const size_t &rooms, const size_t &bytes);
+
+	extern conf::item<size_t> room_cache_max;
+	extern conf::item<size_t> room_cache_bytes_max;
+	extern conf::item<size_t> room_cache_state_max;
+	extern uint64_t room_cache_gen;
+	extern size_t room_cache_bytes;
+}
+
+/// The room_head entries, top event and the present state entries which
+/// have been read for one room. Anything written for the room bumps gen; a
+/// load which yielded to the database is only kept if gen is unchanged when
+/// it completes, so a concurrent write can never be overwritten by the older
+/// result. The approximate memory held is accounted in bytes so the whole
+/// cache can be bounded by size as well as by number of rooms.
+struct ircd::m::dbs::room_cache_entry
+{
+	using head_type = std::tuple<std::string, event::idx, int64_t>;
+	using state_type = std::map<std::string, std::pair<std::string, event::idx>, std::less<>>;
+
+	static constexpr const size_t STATE_OVERHEAD
+	{
+		sizeof(state_type::value_type) + 32
+	};
+
+	uint64_t gen {++room_cache_gen};
+	steady_point used {now<steady_point>()};
+	size_t bytes {0};
+	size_t head_bytes {0};
+	bool head_loaded {false};
+	std::vector<head_type> head;
+	std::tuple<std::string, int64_t, event::idx> top {{}, -1, 0};
+	state_type state;
+};
+
+decltype(ircd::m::dbs::room_cache_max)
+ircd::m::dbs::room_cache_max
+{
+	{ "name",     "ircd.m.dbs.room_cache.max" },
+	{ "default",  1024L                       },
+};
+
+decltype(ircd::m::dbs::room_cache_bytes_max)
+ircd::m::dbs::room_cache_bytes_max
+{
+	{ "name",     "ircd.m.dbs.room_cache.bytes_max" },
+	{ "default",  long(64_MiB)                      },
+};
+
+decltype(ircd::m::dbs::room_cache_state_max)
+ircd::m::dbs::room_cache_state_max
+{
+	{ "name",     "ircd.m.dbs.room_cache.state_max" },
+	{ "default",  8192L                             },
+};
+
+decltype(ircd::m::dbs::room_cache_gen)
+ircd::m::dbs::room_cache_gen;
+
+decltype(ircd::m::dbs::room_cache_bytes)
+ircd::m::dbs::room_cache_bytes;
+
+static std::map<std::string, ircd::m::dbs::room_cache_entry, std::less<>>
+_room_cache;
+
+/// The mutex of each room a room_depth_lock is held or awaited for, and the
+/// number of those locks; the entry is erased with the last of them.
+static std::map<std::string, std::pair<ircd::ctx::mutex, size_t>, std::less<>>
+_room_depth_locks;
+
+void
+ircd::m::dbs::room_cache_clear(const id::room &room_id)
+{
+	const auto it
+	{
+		_room_cache.find(room_id)
+	};
+
+	if(it == end(_room_cache))
+		return;
+
+	assert(room_cache_bytes >= it->second.bytes);
+	room_cache_bytes -= it->second.bytes;
+	_room_cache.erase(it);
+}
+
+void
+ircd::m::dbs::room_cache_clear()
+{
+	_room_cache.clear();
+	room_cache_bytes = 0;
+}
+
+std::pair<size_t, size_t>
+ircd::m::dbs::room_cache_stats()
+{
+	return { _room_cache.size(), room_cache_bytes };
+}
+
+/// The txn for the event has committed; the room's cached head, top and any
+/// cached state key it wrote are brought up to date. Everything here mirrors
+/// what write() put in the txn, but nothing can reach the cache before the
+/// database has it, and a write which failed leaves no trace. There is no
+/// yield between the commit and this call, so a load racing the write either
+/// read the committed columns or is discarded by the gen bump.
+void
+ircd::m::dbs::committed(const event &event,
+                        const write_opts &opts)
+{
+	auto *const cache
+	{
+		_room_cache_find(at<"room_id"_>(event))
+	};
+
+	if(!cache)
+		return;
+
+	cache->gen = ++room_cache_gen;
+	if(cache->head_loaded)
+	{
+		auto &head(cache->head);
+		const auto uncache{[&head]
+		(const string_view &event_id)
+		{
+			head.erase(std::remove_if(begin(head), end(head), [&event_id]
+			(const auto &h)
+			{
+				return string_view{std::get<0>(h)} == event_id;
+			}), end(head));
+		}};
+
+		if(opts.head)
+		{
+			uncache(at<"event_id"_>(event));
+			if(opts.op == db::op::SET)
+			{
+				const auto &depth(at<"depth"_>(event));
+				const auto pos
+				{
+					std::find_if(begin(head), end(head), [&depth]
+					(const auto &h)
+					{
+						return std::get<2>(h) < depth;
+					})
+				};
+
+				head.emplace(pos, std::string(at<"event_id"_>(event)), opts.event_idx, depth);
+			}
+		}
+
+		if(opts.refs && opts.op == db::op::SET)
+		{
+			const m::event::prev &prev{event};
+			for(const json::array &p : json::get<"prev_events"_>(prev))
+				uncache(unquote(p.at(0)));
+		}
+
+		if(opts.op == db::op::SET && at<"depth"_>(event) > std::get<1>(cache->top))
+			cache->top = {std::string(at<"event_id"_>(event)), at<"depth"_>(event), opts.event_idx};
+		else if(opts.op == db::op::DELETE && at<"event_id"_>(event) == string_view{std::get<0>(cache->top)})
+			cache->head_loaded = false;
+
+		_room_cache_account_head(*cache);
+	}
+
+	// Only _index_state() reaches _index__room_state().
+	if(!opts.present || !defined(json::get<"state_key"_>(event)))
+		return;
+
+	thread_local char buf[ROOM_STATE_KEY_MAX_SIZE];
+	const string_view &key
+	{
+		room_state_key(buf, at<"room_id"_>(event), at<"type"_>(event), at<"state_key"_>(event))
+	};
+
+	const auto it
+	{
+		cache->state.find(key)
+	};
+
+	if(it == end(cache->state))
+		return;
+
+	const bool set
+	{
+		opts.op == db::op::SET && at<"type"_>(event) != "m.room.redaction"
+	};
+
+	const string_view &event_id
+	{
+		set? string_view{at<"event_id"_>(event)} : string_view{}
+	};
+
+	_room_cache_account(*cache, ssize_t(event_id.size()) - ssize_t(it->second.first.size()));
+	it->second.first = std::string{event_id};
+	it->second.second = set? opts.event_idx : 0;
+}
+
+bool
+ircd::m::dbs::room_head_cached(const id::room &room_id,
+                               const head_closure &closure)
+{
+	const auto &c
+	{
+		_room_cache_load_head(room_id)
+	};
+
+	// Copied because the closure may yield and the entry may change.
+	const auto head
+	{
+		c.head
+	};
+
+	for(const auto &h : head)
+		if(!closure(std::get<1>(h), std::get<0>(h), std::get<2>(h)))
+			return false;
+
+	return true;
+}
+
+std::tuple<ircd::m::id::event::buf, int64_t, ircd::m::event::idx>
+ircd::m::dbs::room_top_cached(const id::room &room_id)
+{
+	const auto &c
+	{
+		_room_cache_load_head(room_id)
+	};
+
+	return
+	{
+		std::get<0>(c.top), std::get<1>(c.top), std::get<2>(c.top)
+	};
+}
+
+bool
+ircd::m::dbs::room_state_cached(const id::room &room_id,
+                                const string_view &type,
+                                const string_view &state_key,
+                                const event::id::closure &closure)
+{
+	const auto ent
+	{
+		_room_cache_state(room_id, type, state_key)
+	};
+
+	if(!ent.second)
+		return false;
+
+	closure(ent.first);
+	return true;
+}
+
+bool
+ircd::m::dbs::room_state_cached(const id::room &room_id,
+                                const string_view &type,
+                                const string_view &state_key,
+                                const event::closure_idx &closure)
+{
+	const auto ent
+	{
+		_room_cache_state(room_id, type, state_key)
+	};
+
+	if(!ent.second)
+		return false;
+
+	closure(ent.second);
+	return true;
+}
+
+std::pair<ircd::m::event::id::buf, ircd::m::event::idx>
+ircd::m::dbs::_room_cache_state(const id::room &room_id,
+                                const string_view &type,
+                                const string_view &state_key)
+{
+	thread_local char buf[ROOM_STATE_KEY_MAX_SIZE];
+	const string_view key
+	{
+		room_state_key(buf, room_id, type, state_key)
+	};
+
+	auto &c
+	{
+		_room_cache_make(room_id)
+	};
+
+	const auto it
+	{
+		c.state.find(key)
+	};
+
+	if(it != end(c.state))
+		return
+		{
+			it->second.second?
+				event::id::buf{string_view{it->second.first}}:
+				event::id::buf{},
+			it->second.second
+		};
+
+	const auto gen(c.gen);
+	const std::string key_copy(key);
+	std::pair<event::id::buf, event::idx> ret {{}, 0};
+	room_state(key_copy, std::nothrow, [&ret]
+	(const string_view &value)
+	{
+		ret.second = byte_view<event::idx>(value);
+	});
+
+	if(ret.second && !event::fetch::event_id(ret.second, std::nothrow, [&ret]
+	(const event::id &event_id)
+	{
+		ret.first = event_id;
+	}))
+		ret.second = 0;
+
+	auto *const cp
+	{
+		_room_cache_find(room_id)
+	};
+
+	if(!cp || cp->gen != gen || cp->state.size() >= size_t(room_cache_state_max))
+		return ret;
+
+	const auto &event_id
+	{
+		ret.second? string_view{ret.first} : string_view{}
+	};
+
+	cp->state.emplace(key_copy, std::make_pair(std::string{event_id}, ret.second));
+	_room_cache_account(*cp, key_copy.size() + event_id.size() + room_cache_entry::STATE_OVERHEAD);
+	_room_cache_shrink(size_t(room_cache_max), size_t(room_cache_bytes_max));
+	return ret;
+}
+
+ircd::m::dbs::room_cache_entry &
+ircd::m::dbs::_room_cache_load_head(const id::room &room_id)
+{
+	auto &c
+	{
+		_room_cache_make(room_id)
+	};
+
+	if(c.head_loaded)
+		return c;
+
+	const auto gen(c.gen);
+	const std::string room_id_copy(room_id);
+	std::vector<room_cache_entry::head_type> head;
+	m::event::fetch event;
+	const m::room::head heads{m::room{room_id}};
+	heads.for_each(m::room::head::closure{[&head, &event]
+	(const event::idx &idx, const event::id &event_id)
+	{
+		seek(event, idx, std::nothrow);
+		if(event.valid)
+			head.emplace_back(std::string(event_id), idx, json::get<"depth"_>(event));
+	}});
+
+	std::sort(begin(head), end(head), []
+	(const auto &a, const auto &b)
+	{
+		return std::get<2>(a) > std::get<2>(b);
+	});
+
+	const auto top
+	{
+		m::top(std::nothrow, room_id)
+	};
+
+	auto *const cp
+	{
+		_room_cache_find(room_id_copy)
+	};
+
+	// A write raced the load; serve this one result without keeping it.
+	if(!cp || cp->gen != gen)
+	{
+		thread_local room_cache_entry tmp;
+		tmp.head = std::move(head);
+		tmp.top = {std::string(std::get<0>(top)), std::get<1>(top), std::get<2>(top)};
+		return tmp;
+	}
+
+	cp->head = std::move(head);
+	cp->top = {std::string(std::get<0>(top)), std::get<1>(top), std::get<2>(top)};
+	cp->head_loaded = true;
+	_room_cache_account_head(*cp);
+	return *cp;
+}
+
+ircd::m::dbs::room_cache_entry &
+ircd::m::dbs::_room_cache_make(const string_view &room_id)
+{
+	auto *const c
+	{
+		_room_cache_find(room_id)
+	};
+
+	if(c)
+		return *c;
+
+	_room_cache_shrink(size_t(room_cache_max) - 1, size_t(room_cache_bytes_max));
+	return _room_cache.emplace(std::string(room_id), room_cache_entry{}).first->second;
+}
+
+/// Evicts the least recently used rooms until there are no more than the
+/// given number of rooms holding no more than the given number of bytes.
+void
+ircd::m::dbs::_room_cache_shrink(const size_t &rooms,
+                                 const size_t &bytes)
+{
+	while(!_room_cache.empty() && (_room_cache.size() > rooms || room_cache_bytes > bytes))
+	{
+		const auto lru
+		{
+			std::min_element(begin(_room_cache), end(_room_cache), []
+			(const auto &a, const auto &b)
+			{
+				return a.second.used < b.second.used;
+			})
+		};
+
+		assert(room_cache_bytes >= lru->second.bytes);
+		room_cache_bytes -= lru->second.bytes;
+		_room_cache.erase(lru);
+	}
+}
+
+void
+ircd::m::dbs::_room_cache_account_head(room_cache_entry &c)
+{
+	size_t bytes(std::get<0>(c.top).size());
+	for(const auto &h : c.head)
+		bytes += std::get<0>(h).size() + sizeof(h);
+
+	_room_cache_account(c, ssize_t(bytes) - ssize_t(c.head_bytes));
+	c.head_bytes = bytes;
+}
+
+void
+ircd::m::dbs::_room_cache_account(room_cache_entry &c,
+                                  const ssize_t &delta)
+{
+	assert(delta >= 0 || c.bytes >= size_t(-delta));
+	c.bytes += delta;
+	room_cache_bytes += delta;
+}
+
+ircd::m::dbs::room_cache_entry *
+ircd::m::dbs::_room_cache_find(const string_view &room_id)
+{
+	const auto it
+	{
+		_room_cache.find(room_id)
+	};
+
+	if(it == end(_room_cache))
+		return nullptr;
+
+	it->second.used = now<steady_point>();
+	return &it->second;
+}
+
 //
 // Basic write suite
 //
@@ -144,6 +630,11 @@ ircd::m::dbs::write(db::txn &txn,
 	if(opts.head || opts.refs)
 		_index__room_head(txn, event, opts);
 
+	// Only maintained from here where each txn carries a single event. The
+	// runs are read from the column, so the caller holds room_depth_lock.
+	if(opts.op == db::op::SET)
+		_index__room_depth(txn, event, opts);
+
 	if(defined(json::get<"state_key"_>(event)))
 		return _index_state(txn, event, opts);
 
@@ -352,6 +843,103 @@ ircd::m::dbs::_index__room_events(db::txn &txn,
 	};
 }
 
+/// Extends the run of depths containing the event's depth in room_depth,
+/// joining the runs on either side when it fills the gap between them. The
+/// caller holds the room_depth_lock for the room until the txn commits, so
+/// the runs read here are current and never overlap.
+void
+ircd::m::dbs::_index__room_depth(db::txn &txn,
+                                 const event &event,
+                                 const write_opts &opts)
+{
+	const id::room &room_id
+	{
+		at<"room_id"_>(event)
+	};
+
+	const uint64_t depth
+	{
+		uint64_t(at<"depth"_>(event))
+	};
+
+	assert(_room_depth_locks.count(room_id));
+
+	// Every event of a room whose create event is written here is indexed.
+	char buf[ROOM_DEPTH_KEY_MAX_SIZE];
+	if(at<"type"_>(event) == "m.room.create")
+		db::txn::append
+		{
+			txn, room_depth,
+			{
+				db::op::SET,
+				room_depth_key(buf, room_id, ROOM_DEPTH_INDEXED),
+				byte_view<string_view>(ROOM_DEPTH_INDEXED)
+			}
+		};
+
+	// The runs iterate from the highest down, so the first run sought is
+	// either the one starting just above this depth or one at/below it.
+	auto it
+	{
+		room_depth.begin(room_depth_key(buf, room_id, depth + 1))
+	};
+
+	std::pair<uint64_t, uint64_t> above {0, 0}, below {0, 0};
+	bool has_above {false}, has_below {false};
+	for(; bool(it); ++it)
+	{
+		const uint64_t lo(room_depth_key(it->first));
+		const uint64_t hi(byte_view<uint64_t>(it->second));
+		if(lo == depth + 1 && !has_above)
+		{
+			above = {lo, hi};
+			has_above = true;
+			continue;
+		}
+
+		if(hi >= depth)
+			return;
+
+		if(hi + 1 == depth)
+		{
+			below = {lo, hi};
+			has_below = true;
+		}
+
+		break;
+	}
+
+	const uint64_t lo
+	{
+		has_below? below.first : depth
+	};
+
+	const uint64_t hi
+	{
+		has_above? above.second : depth
+	};
+
+	if(has_above)
+		db::txn::append
+		{
+			txn, room_depth,
+			{
+				db::op::DELETE,
+				room_depth_key(buf, room_id, above.first)
+			}
+		};
+
+	db::txn::append
+	{
+		txn, room_depth,
+		{
+			db::op::SET,
+			room_depth_key(buf, room_id, lo),
+			byte_view<string_view>(hi)
+		}
+	};
+}
+
 /// Adds the entry for the room_joined column into the txn.
 /// This only is affected if opts.present=true
 void
@@ -1235,6 +1823,170 @@ ircd::m::dbs::desc::events__state_node
 	true,
 };
 
+//
+// room_depth
+//
+
+/// Prefix transform for the events__room_depth. The prefix is the room_id
+/// and the suffix is the lowest depth of the run.
+///
+const ircd::db::prefix_transform
+ircd::m::dbs::desc::events__room_depth__pfx
+{
+	"_room_depth",
+
+	[](const string_view &key)
+	{
+		return has(key, "\0"_sv);
+	},
+
+	[](const string_view &key)
+	{
+		return split(key, "\0"_sv).first;
+	}
+};
+
+const ircd::database::descriptor
+ircd::m::dbs::desc::events__room_depth
+{
+	// name
+	"_room_depth",
+
+	// explanation
+	R"(### developer note:
+
+	key is "!room_id:origin\0" + the lowest depth of a run of contiguous
+	depths found in the room's timeline. The value is the highest depth of
+	that run. The depth in the key is inverted and big-endian so the runs
+	of a room sort from the highest down like room_events. A room with a
+	single run from its create event has no gaps. The key at the maximum
+	depth marks a room whose runs cover its whole timeline.
+
+	)",
+
+	// typing (key, value)
+	{
+		typeid(string_view), typeid(uint64_t)
+	},
+
+	// options
+	{},
+
+	// comparator
+	{},
+
+	// prefix transform
+	events__room_depth__pfx,
+
+	// cache size
+	16_MiB, //TODO: conf
+
+	// cache size for compressed assets
+	0, //TODO: conf
+
+	// bloom filter bits
+	0,
+
+	// expect queries hit
+	false,
+};
+
+ircd::string_view
+ircd::m::dbs::room_depth_key(const mutable_buffer &out_,
+                             const id::room &room_id,
+                             const uint64_t &depth)
+{
+	const uint64_t inv
+	{
+		hton(~depth)
+	};
+
+	const const_buffer depth_cb
+	{
+		reinterpret_cast<const char *>(&inv), sizeof(inv)
+	};
+
+	mutable_buffer out{out_};
+	consume(out, copy(out, room_id));
+	consume(out, copy(out, "\0"_sv));
+	consume(out, copy(out, depth_cb));
+	return { data(out_), data(out) };
+}
+
+uint64_t
+ircd::m::dbs::room_depth_key(const string_view &amalgam)
+{
+	assert(size(amalgam) == 1 + 8);
+	assert(amalgam.front() == '\0');
+
+	uint64_t inv;
+	memcpy(&inv, data(amalgam) + 1, sizeof(inv));
+	return ~ntoh(inv);
+}
+
+bool
+ircd::m::dbs::room_depth_ranges(const id::room &room_id,
+                                const depth_range_closure &closure)
+{
+	for(auto it(room_depth.begin(room_id)); bool(it); ++it)
+	{
+		const uint64_t lo(room_depth_key(it->first));
+		if(lo == ROOM_DEPTH_INDEXED)
+			continue;
+
+		const uint64_t hi(byte_view<uint64_t>(it->second));
+		if(!closure(lo, hi))
+			return false;
+	}
+
+	return true;
+}
+
+bool
+ircd::m::dbs::room_depth_indexed(const id::room &room_id)
+{
+	char buf[ROOM_DEPTH_KEY_MAX_SIZE];
+	return db::has(room_depth, room_depth_key(buf, room_id, ROOM_DEPTH_INDEXED));
+}
+
+//
+// room_depth_lock
+//
+
+ircd::m::dbs::room_depth_lock::room_depth_lock(const id::room &room_id)
+:room_id
+{
+	room_id
+}
+{
+	auto it
+	{
+		_room_depth_locks.lower_bound(this->room_id)
+	};
+
+	if(it == end(_room_depth_locks) || it->first != this->room_id)
+		it = _room_depth_locks.emplace_hint(it, std::piecewise_construct, std::forward_as_tuple(this->room_id), std::forward_as_tuple());
+
+	// The entry stays while counted, so the reference survives the wait.
+	auto &entry(it->second);
+	++entry.second;
+	entry.first.lock();
+}
+
+ircd::m::dbs::room_depth_lock::~room_depth_lock()
+noexcept
+{
+	const auto it
+	{
+		_room_depth_locks.find(room_id)
+	};
+
+	assert(it != end(_room_depth_locks));
+	it->second.first.unlock();
+	if(--it->second.second == 0)
+		_room_depth_locks.erase(it);
+}
+
 //
 // Direct column descriptors
 //
@@ -2038,4 +2790,8 @@ ircd::m::dbs::desc::events
 
 	events__event_bad,
 	events__room_head,
+
+	// (room_id, lo depth) => (hi depth)
+	// Runs of contiguous depth in the timeline of a room.
+	events__room_depth,
 };
@@ -32,6 +32,13 @@ me_offline_status_msg
 	{ "default",  "Catch ya on the flip side..."   }
 };
 
+ircd::conf::item<size_t>
+hook_defer_pool_size
+{
+	{ "name",     "ircd.m.hook.defer.pool_size" },
+	{ "default",  4L                            },
+};
+
 //
 // init::init
 //
@@ -43,6 +50,7 @@ try
 	origin
 }
 {
+	hook::defer::resize();
 	init_keys();
 	init_imports();
 	presence::set(me, "online", me_online_status_msg);
@@ -70,6 +78,13 @@ ircd::m::init::~init()
 noexcept try
 {
 	presence::set(me, "offline", me_offline_status_msg);
+	if(!hook::defer::drain(seconds(10)))
+		log::warning
+		{
+			log, "Dropping %zu deferred hook calls", hook::defer::queued
+		};
+
+	hook::defer::pool.join();
 	m::imports.clear();
 }
 catch(const m::error &e)
@@ -353,6 +368,12 @@ decltype(ircd::m::vm::current_sequence)
 ircd::m::vm::current_sequence
 {};
 
+/// Shared by each eval while it writes and commits its txn. The bulk
+/// importer holds it exclusively so no eval's txn interleaves with its own.
+decltype(ircd::m::vm::sequence_lock)
+ircd::m::vm::sequence_lock
+{};
+
 decltype(ircd::m::vm::default_opts)
 ircd::m::vm::default_opts
 {};
@@ -663,6 +684,56 @@ ircd::m::keys::query(const string_view &query_server,
 	return function(query_server, queries_, closure);
 }
 
+void
+ircd::m::keys::public_key(const string_view &server_name,
+                          const string_view &key_id,
+                          const pk_closure &closure)
+{
+	using prototype = void (const string_view &, const string_view &, const pk_closure &);
+
+	static import<prototype> function
+	{
+		"s_keys", "public_key__keys"
+	};
+
+	return function(server_name, key_id, closure);
+}
+
+size_t
+ircd::m::keys::prefetch(const queries &queries_)
+{
+	using prototype = size_t (const queries &);
+
+	static import<prototype> function
+	{
+		"s_keys", "prefetch__keys"
+	};
+
+	return function(queries_);
+}
+
+size_t
+ircd::m::keys::prefetch(const vector_view<const m::event> &events)
+{
+	std::vector<m::v1::key::server_key> queries;
+	queries.reserve(events.size());
+	for(const auto &event : events)
+	{
+		const json::object &signatures
+		{
+			json::get<"signatures"_>(event)
+		};
+
+		for(const auto &server : signatures)
+			for(const auto &key : json::object{server.second})
+				queries.emplace_back(unquote(server.first), unquote(key.first));
+	}
+
+	std::sort(begin(queries), end(queries));
+	queries.erase(std::unique(begin(queries), end(queries)), end(queries));
+	return prefetch(vector_view<const m::v1::key::server_key>(queries));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // m/visible.h
@@ -700,6 +771,96 @@ ircd::m::visible(const event &event,
 	return function(event, mxid);
 }
 
+//
+// visibility
+//
+
+ircd::m::visibility::visibility(const string_view &mxid)
+:mxid{mxid}
+{
+}
+
+void
+ircd::m::visibility::operator()(const vector_view<const event::idx> &idxs,
+                                const vector_view<bool> &out)
+{
+	assert(out.size() >= idxs.size());
+	for(size_t i(0); i < idxs.size() && i < out.size(); ++i)
+	{
+		m::state::id_buffer buf;
+		const string_view &state_root
+		{
+			dbs::state_root(buf, idxs[i])
+		};
+
+		if(valid && state_root == root)
+		{
+			out[i] = result;
+			++reused;
+			continue;
+		}
+
+		char room_id_buf[m::id::MAX_SIZE];
+		const string_view &room_id
+		{
+			m::get(std::nothrow, idxs[i], "room_id", room_id_buf)
+		};
+
+		m::event::id::buf event_id;
+		const bool found
+		{
+			m::event::fetch::event_id(idxs[i], std::nothrow, [&event_id]
+			(const event::id &event_id_)
+			{
+				event_id = event_id_;
+			})
+		};
+
+		if(!found || !room_id)
+		{
+			out[i] = false;
+			continue;
+		}
+
+		const m::event event
+		{
+			{ "event_id",  event_id  },
+			{ "room_id",   room_id   },
+		};
+
+		out[i] = operator()(event, state_root);
+	}
+}
+
+bool
+ircd::m::visibility::operator()(const event &event)
+{
+	m::state::id_buffer buf;
+	const string_view &state_root
+	{
+		dbs::state_root(buf, event)
+	};
+
+	return operator()(event, state_root);
+}
+
+bool
+ircd::m::visibility::operator()(const event &event,
+                                const string_view &state_root)
+{
+	if(valid && state_root == root)
+	{
+		++reused;
+		return result;
+	}
+
+	result = visible(event, mxid);
+	root = std::string(state_root);
+	valid = true;
+	++evaluated;
+	return result;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // m/receipt.h
@@ -929,19 +1090,7 @@ ircd::m::node::key(const string_view &key_id,
                    const ed25519_closure &closure)
 const
 {
-	key(key_id, key_closure{[&closure]
-	(const string_view &keyb64)
-	{
-		const ed25519::pk pk
-		{
-			[&keyb64](auto &buf)
-			{
-				b64decode(buf, unquote(keyb64));
-			}
-		};
-
-		closure(pk);
-	}});
+	m::keys::public_key(node_id.hostname(), key_id, closure);
 }
 
 void
@@ -1036,11 +1185,16 @@ ircd::m::events::rfor_each(const event::idx &start,
 		json::get<"limit"_>(filter)?: 32L
 	};
 
-	return rfor_each(start, [&filter, &closure, &limit]
+	const filter_matcher matcher
+	{
+		filter
+	};
+
+	return rfor_each(start, [&matcher, &closure, &limit]
 	(const event::idx &event_idx, const m::event &event)
 	-> bool
 	{
-		if(!match(filter, event))
+		if(!matcher(event))
 			return true;
 
 		if(!closure(event_idx, event))
@@ -1115,11 +1269,16 @@ ircd::m::events::for_each(const event::idx &start,
 		json::get<"limit"_>(filter)?: 32L
 	};
 
-	return for_each(start, [&filter, &closure, &limit]
+	const filter_matcher matcher
+	{
+		filter
+	};
+
+	return for_each(start, [&matcher, &closure, &limit]
 	(const event::idx &event_idx, const m::event &event)
 	-> bool
 	{
-		if(!match(filter, event))
+		if(!matcher(event))
 			return true;
 
 		if(!closure(event_idx, event))
@@ -1182,62 +1341,191 @@ ircd::m::events::for_each(const event::idx &start,
 // m/filter.h
 //
 
-//TODO: globular expression
-//TODO: tribool for contains_url; we currently ignore the false value.
 bool
 ircd::m::match(const room_event_filter &filter,
                const event &event)
 {
-	if(json::get<"contains_url"_>(filter) == true)
-		if(!at<"content"_>(event).has("url"))
-			return false;
+	return filter_matcher{filter}(event);
+}
+
+bool
+ircd::m::match(const event_filter &filter,
+               const event &event)
+{
+	return filter_matcher{filter}(event);
+}
+
+//
+// filter_matcher
+//
+
+ircd::m::filter_matcher::filter_matcher(const json::object &filter)
+:filter_matcher
+{
+	room_event_filter{filter}
+}
+{
+	// The tuple can't tell false from absent; the source can.
+	const string_view &contains_url_
+	{
+		filter.get("contains_url")
+	};
+
+	if(contains_url_)
+		contains_url = contains_url_ == "true";
+}
 
-	for(const auto &room_id : json::get<"not_rooms"_>(filter))
-		if(at<"room_id"_>(event) == unquote(room_id))
+ircd::m::filter_matcher::filter_matcher(const room_event_filter &filter)
+:limit{json::get<"limit"_>(filter)}
+,contains_url{json::get<"contains_url"_>(filter)? int8_t(1) : int8_t(-1)}
+,types{json::get<"types"_>(filter)}
+,not_types{json::get<"not_types"_>(filter)}
+,senders{json::get<"senders"_>(filter)}
+,not_senders{json::get<"not_senders"_>(filter)}
+,rooms{json::get<"rooms"_>(filter)}
+,not_rooms{json::get<"not_rooms"_>(filter)}
+{
+}
+
+ircd::m::filter_matcher::filter_matcher(const event_filter &filter)
+:limit{json::get<"limit"_>(filter)}
+,types{json::get<"types"_>(filter)}
+,not_types{json::get<"not_types"_>(filter)}
+,senders{json::get<"senders"_>(filter)}
+,not_senders{json::get<"not_senders"_>(filter)}
+{
+}
+
+/// The not_ lists take precedence over the positive lists; each positive
+/// list which is not empty must match as well.
+bool
+ircd::m::filter_matcher::operator()(const event &event)
+const
+{
+	const auto &type(json::get<"type"_>(event));
+	const auto &sender(json::get<"sender"_>(event));
+	const auto &room_id(json::get<"room_id"_>(event));
+
+	if(not_types(type) || not_senders(sender) || not_rooms(room_id))
+		return false;
+
+	if(!types.empty() && !types(type))
+		return false;
+
+	if(!senders.empty() && !senders(sender))
+		return false;
+
+	if(!rooms.empty() && !rooms(room_id))
+		return false;
+
+	if(contains_url != -1)
+	{
+		const json::object &content
+		{
+			json::get<"content"_>(event)
+		};
+
+		if(content.has("url") != bool(contains_url))
 			return false;
+	}
+
+	return true;
+}
+
+//
+// filter_matcher::list
+//
 
-	if(empty(json::get<"rooms"_>(filter)))
-		return match(event_filter{filter}, event);
+ircd::m::filter_matcher::list::list(const json::array &array)
+{
+	for(const string_view &item : array)
+	{
+		const string_view &value
+		{
+			unquote(item)
+		};
 
-	for(const auto &room_id : json::get<"rooms"_>(filter))
-		if(at<"room_id"_>(event) == unquote(room_id))
-			return match(event_filter{filter}, event);
+		if(has(value, '*'))
+			globs.emplace_back(value);
+		else
+			exact.emplace(value);
+	}
+}
+
+bool
+ircd::m::filter_matcher::list::operator()(const string_view &value)
+const
+{
+	if(exact.count(value))
+		return true;
+
+	for(const auto &glob : globs)
+		if(glob(value))
+			return true;
 
 	return false;
 }
 
-//TODO: globular expression
 bool
-ircd::m::match(const event_filter &filter,
-               const event &event)
+ircd::m::filter_matcher::list::empty()
+const
 {
-	for(const auto &type : json::get<"not_types"_>(filter))
-		if(at<"type"_>(event) == unquote(type))
-			return false;
+	return exact.empty() && globs.empty();
+}
+
+//
+// filter_matcher::glob
+//
 
-	for(const auto &sender : json::get<"not_senders"_>(filter))
-		if(at<"sender"_>(event) == unquote(sender))
+ircd::m::filter_matcher::glob::glob(const string_view &pattern)
+:front
+{
+	!startswith(pattern, '*')
+}
+,back
+{
+	!endswith(pattern, '*')
+}
+{
+	tokens(pattern, '*', [this]
+	(const string_view &segment)
+	{
+		segments.emplace_back(segment);
+	});
+}
+
+bool
+ircd::m::filter_matcher::glob::operator()(const string_view &value_)
+const
+{
+	string_view value{value_};
+	auto it(begin(segments));
+	auto end(std::end(segments));
+	if(front && it != end)
+	{
+		if(!startswith(value, *it))
 			return false;
 
-	if(empty(json::get<"senders"_>(filter)) && empty(json::get<"types"_>(filter)))
-		return true;
+		value = string_view{value.substr(size(*it))};
+		++it;
+	}
 
-	if(empty(json::get<"senders"_>(filter)))
+	if(back && it != end)
 	{
-		for(const auto &type : json::get<"types"_>(filter))
-			if(at<"type"_>(event) == unquote(type))
-				return true;
+		if(!endswith(value, *std::prev(end)))
+			return false;
 
-		return false;
+		value = string_view{value.substr(0, size(value) - size(*std::prev(end)))};
+		--end;
 	}
 
-	if(empty(json::get<"types"_>(filter)))
+	for(; it != end; ++it)
 	{
-		for(const auto &sender : json::get<"senders"_>(filter))
-			if(at<"sender"_>(event) == unquote(sender))
-				return true;
+		const auto pos(value.find(*it));
+		if(pos == value.npos)
+			return false;
 
-		return false;
+		value = string_view{value.substr(pos + size(*it))};
 	}
 
 	return true;
@@ -1269,6 +1557,129 @@ ircd::m::filter::filter(const user &user,
 	});
 }
 
+//
+// filter::compiled
+//
+
+namespace ircd::m
+{
+	extern conf::item<size_t> filter_cache_max;
+}
+
+decltype(ircd::m::filter_cache_max)
+ircd::m::filter_cache_max
+{
+	{ "name",     "ircd.m.filter.cache.max" },
+	{ "default",  1024L                     },
+};
+
+/// Keyed by the user_id and filter_id separated by a space. Each entry holds
+/// its position in _filter_cache_lru.
+static std::map<std::string, std::pair<std::shared_ptr<const ircd::m::filter::compiled>, std::list<ircd::string_view>::iterator>, std::less<>>
+_filter_cache;
+
+/// The keys of _filter_cache from the least to the most recently used; these
+/// are views of the keys in the map. The front is evicted when it is full.
+static std::list<ircd::string_view>
+_filter_cache_lru;
+
+/// An empty or unknown filter_id yields a filter which matches everything.
+std::shared_ptr<const ircd::m::filter::compiled>
+ircd::m::filter::compiled::get(const user &user,
+                               const string_view &filter_id)
+{
+	static const auto everything
+	{
+		std::make_shared<const compiled>(std::string{})
+	};
+
+	if(!filter_id)
+		return everything;
+
+	std::string key(user.user_id);
+	key += ' ';
+	key.append(data(filter_id), size(filter_id));
+
+	const auto it
+	{
+		_filter_cache.find(key)
+	};
+
+	if(it != end(_filter_cache))
+	{
+		_filter_cache_lru.splice(end(_filter_cache_lru), _filter_cache_lru, it->second.second);
+		return it->second.first;
+	}
+
+	std::string source
+	{
+		user.filter(std::nothrow, filter_id)
+	};
+
+	if(source.empty())
+		return everything;
+
+	const auto ret
+	{
+		std::make_shared<const compiled>(std::move(source))
+	};
+
+	// Another context may have cached it while the source was read.
+	auto pos
+	{
+		_filter_cache.lower_bound(key)
+	};
+
+	if(pos != end(_filter_cache) && pos->first == key)
+		return pos->second.first;
+
+	while(!_filter_cache.empty() && _filter_cache.size() >= size_t(filter_cache_max))
+	{
+		const auto lru
+		{
+			_filter_cache.find(_filter_cache_lru.front())
+		};
+
+		_filter_cache_lru.pop_front();
+		_filter_cache.erase(lru);
+		pos = _filter_cache.lower_bound(key);
+	}
+
+	pos = _filter_cache.emplace_hint(pos, std::move(key), std::make_pair(ret, end(_filter_cache_lru)));
+	pos->second.second = _filter_cache_lru.emplace(end(_filter_cache_lru), pos->first);
+	return ret;
+}
+
+ircd::m::filter::compiled::compiled(std::string source_)
+:source
+{
+	std::move(source_)
+}
+{
+	const json::object filter{source};
+	const json::object room{filter.get("room")};
+	account_data = filter_matcher{json::object{filter.get("account_data")}};
+	presence = filter_matcher{json::object{filter.get("presence")}};
+	rooms = filter_matcher::list{json::array{room.get("rooms")}};
+	not_rooms = filter_matcher::list{json::array{room.get("not_rooms")}};
+	state = filter_matcher{json::object{room.get("state")}};
+	timeline = filter_matcher{json::object{room.get("timeline")}};
+	ephemeral = filter_matcher{json::object{room.get("ephemeral")}};
+	room_account_data = filter_matcher{json::object{room.get("account_data")}};
+	include_leave = room.get("include_leave") == "true";
+}
+
+/// Whether the room-level rooms and not_rooms lists admit the room.
+bool
+ircd::m::filter::compiled::room(const string_view &room_id)
+const
+{
+	if(not_rooms(room_id))
+		return false;
+
+	return rooms.empty() || rooms(room_id);
+}
+
 //
 // room_filter
 //
@@ -2706,7 +3117,6 @@ ircd::m::txn::create_id(const mutable_buffer &out,
 // Internal utils
 namespace ircd::m
 {
-	static bool _hook_match(const m::event &matching, const m::event &);
 	static void _hook_fix_state_key(const json::members &, json::member &);
 	static void _hook_fix_room_id(const json::members &, json::member &);
 	static void _hook_fix_sender(const json::members &, json::member &);
@@ -2717,14 +3127,47 @@ namespace ircd::m
 // hook::maps
 //
 
+/// Dispatch table compiled from the matchers of every hook registered to a
+/// site. Each hook is assigned a bit; for each event key a hook can match on
+/// there is a sorted table of interned values to the set of hooks requiring
+/// that value, and a set of hooks which don't care about the key at all.
+/// Resolving the hooks for an event is then an intersection of one bitset
+/// per key, without allocation and independent of the number of hooks.
+/// Matching hooks are called in slot order. A new hook takes the lowest free
+/// slot, so this is registration order only until a hook is removed.
 struct ircd::m::hook::maps
 {
-	std::multimap<string_view, base *> origin;
-	std::multimap<string_view, base *> room_id;
-	std::multimap<string_view, base *> sender;
-	std::multimap<string_view, base *> state_key;
-	std::multimap<string_view, base *> type;
-	std::vector<base *> always;
+	static constexpr const size_t MAX {256};
+
+	using mask = std::bitset<MAX>;
+
+	enum key :uint
+	{
+		ORIGIN,
+		ROOM_ID,
+		SENDER,
+		STATE_KEY,
+		TYPE,
+		MEMBERSHIP,
+		MSGTYPE,
+		_NUM_
+	};
+
+	struct table
+	{
+		mask any;
+		std::vector<std::pair<std::string, mask>> value;
+
+		const mask *find(const string_view &) const;
+		mask &operator[](const string_view &);
+		void del(const size_t &pos);
+	};
+
+	std::vector<base *> slot;
+	mask registered;
+	std::array<table, key::_NUM_> tables;
+
+	static string_view value(const event &, const key &);
 
 	size_t match(const event &match, const std::function<bool (base &)> &) const;
 	size_t add(base &hook, const event &matching);
@@ -2747,34 +3190,47 @@ size_t
 ircd::m::hook::maps::add(base &hook,
                          const event &matching)
 {
-	size_t ret{0};
-	const auto map{[&hook, &ret]
-	(auto &map, const string_view &value)
+	auto it
 	{
-		map.emplace(value, &hook);
-		++ret;
-	}};
-
-	if(json::get<"origin"_>(matching))
-		map(origin, at<"origin"_>(matching));
+		std::find(begin(slot), end(slot), nullptr)
+	};
 
-	if(json::get<"room_id"_>(matching))
-		map(room_id, at<"room_id"_>(matching));
+	if(it == end(slot))
+	{
+		if(slot.size() >= MAX)
+			throw error
+			{
+				"Hook %p exceeds the maximum of %zu hooks for its site",
+				&hook,
+				MAX
+			};
 
-	if(json::get<"sender"_>(matching))
-		map(sender, at<"sender"_>(matching));
+		it = slot.emplace(end(slot), nullptr);
+	}
 
-	if(json::get<"state_key"_>(matching))
-		map(state_key, at<"state_key"_>(matching));
+	const size_t pos
+	{
+		size_t(std::distance(begin(slot), it))
+	};
 
-	if(json::get<"type"_>(matching))
-		map(type, at<"type"_>(matching));
+	size_t ret{0};
+	for(uint i(0); i < key::_NUM_; ++i)
+	{
+		const string_view &val
+		{
+			value(matching, key(i))
+		};
 
-	// Hook had no mappings which means it will match everything.
-	// We don't increment the matcher count for this case.
-	if(!ret)
-		always.emplace_back(&hook);
+		if(val)
+		{
+			tables[i][val].set(pos);
+			++ret;
+		}
+		else tables[i].any.set(pos);
+	}
 
+	*it = &hook;
+	registered.set(pos);
 	return ret;
 }
 
@@ -2782,39 +3238,33 @@ size_t
 ircd::m::hook::maps::del(base &hook,
                          const event &matching)
 {
-	size_t ret{0};
-	const auto unmap{[&hook, &ret]
-	(auto &map, const string_view &key)
+	const auto it
 	{
-		auto pit{map.equal_range(key)};
-		for(; pit.first != pit.second; ++pit.first)
-			if(pit.first->second == &hook)
-			{
-				++ret;
-				return map.erase(pit.first);
-			}
-
-		assert(0);
-		return end(map);
-	}};
-
-	// Unconditional attempt to remove from always.
-	std::remove(begin(always), end(always), &hook);
+		std::find(begin(slot), end(slot), &hook)
+	};
 
-	if(json::get<"origin"_>(matching))
-		unmap(origin, at<"origin"_>(matching));
+	assert(it != end(slot));
+	if(it == end(slot))
+		return 0;
 
-	if(json::get<"room_id"_>(matching))
-		unmap(room_id, at<"room_id"_>(matching));
+	const size_t pos
+	{
+		size_t(std::distance(begin(slot), it))
+	};
 
-	if(json::get<"sender"_>(matching))
-		unmap(sender, at<"sender"_>(matching));
+	size_t ret{0};
+	for(uint i(0); i < key::_NUM_; ++i)
+	{
+		if(value(matching, key(i)))
+			++ret;
 
-	if(json::get<"state_key"_>(matching))
-		unmap(state_key, at<"state_key"_>(matching));
+		tables[i].del(pos);
+	}
 
-	if(json::get<"type"_>(matching))
-		unmap(type, at<"type"_>(matching));
+	*it = nullptr;
+	registered.reset(pos);
+	while(!slot.empty() && !slot.back())
+		slot.pop_back();
 
 	return ret;
 }
@@ -2824,52 +3274,134 @@ ircd::m::hook::maps::match(const event &event,
                            const std::function<bool (base &)> &callback)
 const
 {
-	std::set<base *> matching
+	mask matching
 	{
-		begin(always), end(always)
+		registered
 	};
 
-	const auto site_match{[&matching]
-	(auto &map, const string_view &key)
+	const bool message
 	{
-		auto pit{map.equal_range(key)};
-		for(; pit.first != pit.second; ++pit.first)
-			matching.emplace(pit.first->second);
-	}};
-
-	if(json::get<"origin"_>(event))
-		site_match(origin, at<"origin"_>(event));
-
-	if(json::get<"room_id"_>(event))
-		site_match(room_id, at<"room_id"_>(event));
+		json::get<"type"_>(event) == "m.room.message"
+	};
 
-	if(json::get<"sender"_>(event))
-		site_match(sender, at<"sender"_>(event));
+	for(uint i(0); i < key::_NUM_ && matching.any(); ++i)
+	{
+		// The msgtype is only considered for messages.
+		if(key(i) == key::MSGTYPE && !message)
+			continue;
 
-	if(json::get<"type"_>(event))
-		site_match(type, at<"type"_>(event));
+		const auto &table
+		{
+			tables[i]
+		};
 
-	if(json::get<"state_key"_>(event))
-		site_match(state_key, at<"state_key"_>(event));
+		const mask *const match
+		{
+			table.find(value(event, key(i)))
+		};
 
-	auto it(begin(matching));
-	while(it != end(matching))
-	{
-		const base &hook(**it);
-		if(!_hook_match(hook.matching, event))
-			it = matching.erase(it);
-		else
-			++it;
+		matching &= match?
+			table.any | *match:
+			table.any;
 	}
 
+	// A callback may unregister hooks, so the slot vector is bounds-checked
+	// on every step and slots freed meanwhile are skipped.
 	size_t ret{0};
-	for(auto it(begin(matching)); it != end(matching); ++it, ++ret)
-		if(!callback(**it))
+	for(size_t pos(0); pos < slot.size() && matching.any(); ++pos)
+	{
+		if(!matching.test(pos))
+			continue;
+
+		matching.reset(pos);
+		if(!slot[pos])
+			continue;
+
+		++ret;
+		if(!callback(*slot[pos]))
 			return ret;
+	}
 
 	return ret;
 }
 
+ircd::string_view
+ircd::m::hook::maps::value(const event &event,
+                           const key &k)
+{
+	switch(k)
+	{
+		case ORIGIN:      return json::get<"origin"_>(event);
+		case ROOM_ID:     return json::get<"room_id"_>(event);
+		case SENDER:      return json::get<"sender"_>(event);
+		case STATE_KEY:   return json::get<"state_key"_>(event);
+		case TYPE:        return json::get<"type"_>(event);
+		case MEMBERSHIP:  return json::get<"membership"_>(event);
+		case MSGTYPE:     return unquote(json::get<"content"_>(event).get("msgtype"));
+		case _NUM_:       break;
+	}
+
+	assert(0);
+	return {};
+}
+
+//
+// hook::maps::table
+//
+
+const ircd::m::hook::maps::mask *
+ircd::m::hook::maps::table::find(const string_view &val)
+const
+{
+	if(!val)
+		return nullptr;
+
+	const auto it
+	{
+		std::lower_bound(begin(value), end(value), val, []
+		(const auto &a, const string_view &b)
+		{
+			return string_view{a.first} < b;
+		})
+	};
+
+	return it != end(value) && string_view{it->first} == val?
+		&it->second:
+		nullptr;
+}
+
+ircd::m::hook::maps::mask &
+ircd::m::hook::maps::table::operator[](const string_view &val)
+{
+	auto it
+	{
+		std::lower_bound(begin(value), end(value), val, []
+		(const auto &a, const string_view &b)
+		{
+			return string_view{a.first} < b;
+		})
+	};
+
+	if(it == end(value) || string_view{it->first} != val)
+		it = value.emplace(it, std::string{val}, mask{});
+
+	return it->second;
+}
+
+void
+ircd::m::hook::maps::table::del(const size_t &pos)
+{
+	any.reset(pos);
+	for(auto it(begin(value)); it != end(value);)
+	{
+		it->second.reset(pos);
+		if(it->second.none())
+			it = value.erase(it);
+		else
+			++it;
+	}
+}
+
 //
 // hook::base
 //
@@ -2895,6 +3427,12 @@ try
 {
 	feature
 }
+,defer
+{
+	feature.get("_defer") == "true"?
+		std::make_shared<struct defer>(*this):
+		nullptr
+}
 {
 	site *site;
 	if((site = find_site()))
@@ -2913,6 +3451,7 @@ catch(...)
 ircd::m::hook::base::~base()
 noexcept
 {
+	quiesce();
 	if(!registered)
 		return;
 
@@ -2921,6 +3460,28 @@ noexcept
 	site->del(*this);
 }
 
+/// Stops deferred delivery to this hook. Any queued events are dropped; if
+/// the hook is running from the pool right now the pool context is allowed
+/// to finish with it first. This must be called by the most derived hook
+/// before the function it calls is destroyed.
+void
+ircd::m::hook::base::quiesce()
+noexcept
+{
+	if(!defer || !defer->hook)
+		return;
+
+	defer->hook = nullptr;
+	defer::queued -= defer->queue.size();
+	defer->queue.clear();
+	defer::dock.notify_all();
+	if(ctx::current && defer->running && defer->runner != ctx::current)
+		defer::dock.wait([this]
+		{
+			return !defer->running;
+		});
+}
+
 ircd::m::hook::base::site *
 ircd::m::hook::base::find_site()
 const
@@ -3104,6 +3665,12 @@ ircd::m::hook::hook<void>::hook(decltype(function) function,
 {
 }
 
+ircd::m::hook::hook<void>::~hook()
+noexcept
+{
+	quiesce();
+}
+
 ircd::m::hook::site<void>::site(const json::members &feature)
 :base::site{feature}
 {
@@ -3115,7 +3682,11 @@ ircd::m::hook::site<void>::operator()(const event &event)
 	match(event, [this, &event]
 	(base &base)
 	{
-		call(dynamic_cast<hook<void> &>(base), event);
+		if(base.defer)
+			(*base.defer)(event);
+		else
+			call(dynamic_cast<hook<void> &>(base), event);
+
 		return true;
 	});
 }
@@ -3139,6 +3710,178 @@ catch(const std::exception &e)
 	};
 }
 
+//
+// hook::defer
+//
+
+ircd::conf::item<size_t>
+hook_defer_queue_max
+{
+	{ "name",     "ircd.m.hook.defer.queue_max" },
+	{ "default",  4096L                         },
+};
+
+decltype(ircd::m::hook::defer::pool)
+ircd::m::hook::defer::pool
+{
+	"m.hook.defer", 256_KiB
+};
+
+decltype(ircd::m::hook::defer::dock)
+ircd::m::hook::defer::dock;
+
+decltype(ircd::m::hook::defer::queued)
+ircd::m::hook::defer::queued;
+
+decltype(ircd::m::hook::defer::peak)
+ircd::m::hook::defer::peak;
+
+decltype(ircd::m::hook::defer::total)
+ircd::m::hook::defer::total;
+
+/// The pool contexts currently inside run().
+decltype(ircd::m::hook::defer::workers)
+ircd::m::hook::defer::workers;
+
+/// Waits for the deferred hooks to catch up; false if they didn't in time.
+bool
+ircd::m::hook::defer::drain(const milliseconds &timeout)
+{
+	return dock.wait_for(timeout, []
+	{
+		return queued == 0 && pool.active() == 0;
+	});
+}
+
+/// Brings the pool to ircd.m.hook.defer.pool_size. This is called at init,
+/// which is before the conf room is loaded, and again on every dispatch so a
+/// configured size takes effect. The pool only shrinks while no deferred hook
+/// is running, since the contexts removed are terminated.
+void
+ircd::m::hook::defer::resize()
+{
+	const size_t want
+	{
+		hook_defer_pool_size
+	};
+
+	if(pool.size() < want)
+		pool.add(want - pool.size());
+	else if(pool.size() > want && pool.active() == 0)
+		pool.del(pool.size() - want);
+}
+
+ircd::m::hook::defer::defer(base &hook)
+:hook{&hook}
+{
+}
+
+ircd::m::hook::defer::~defer()
+noexcept
+{
+	assert(queue.empty());
+}
+
+void
+ircd::m::hook::defer::operator()(const event &event)
+{
+	// Backpressure: the evaluating context waits here rather than letting
+	// the deferred work grow without bound. A deferred hook can itself reach
+	// a deferred site (e.g. presence committing ircd.presence); if the pool
+	// contexts waited here nothing would be left to drain the queues.
+	const bool worker
+	{
+		workers.count(ctx::current)
+	};
+
+	// Held so this outlives the wait even if the hook is destroyed during it.
+	const auto self
+	{
+		shared_from_this()
+	};
+
+	if(ctx::current && !worker && queued >= size_t(hook_defer_queue_max))
+		dock.wait([]
+		{
+			return queued < size_t(hook_defer_queue_max);
+		});
+
+	// The hook may have been quiesced or destroyed during the wait.
+	if(!hook)
+		return;
+
+	queue.emplace_back(json::strung{event});
+	peak = std::max(peak, ++queued);
+	++total;
+
+	if(running)
+		return;
+
+	running = true;
+	resize();
+	pool([self]
+	{
+		self->run();
+	});
+}
+
+void
+ircd::m::hook::defer::run()
+{
+	runner = ctx::current;
+	workers.emplace(runner);
+	const unwind stopped{[this]
+	{
+		workers.erase(runner);
+		runner = nullptr;
+		running = false;
+		dock.notify_all();
+	}};
+
+	while(hook && !queue.empty())
+	{
+		const std::string buf
+		{
+			std::move(queue.front())
+		};
+
+		queue.pop_front();
+		--queued;
+		dock.notify_all();
+
+		const m::event event
+		{
+			json::object{buf}
+		};
+
+		auto &hfn
+		{
+			dynamic_cast<m::hook::hook<void> &>(*hook)
+		};
+
+		++calls;
+		++hfn.calls;
+		try
+		{
+			hfn.function(event);
+		}
+		catch(const ctx::interrupted &e)
+		{
+			throw;
+		}
+		catch(const std::exception &e)
+		{
+			log::critical
+			{
+				"Unhandled deferred hookfn(%p) %s error :%s",
+				&hfn,
+				string_view{hfn.feature},
+				e.what()
+			};
+		}
+	}
+}
+
 //
 // hook internal
 //
@@ -3229,43 +3972,6 @@ ircd::m::_hook_fix_state_key(const json::members &members,
 	validate(id::USER, member.second);
 }
 
-bool
-ircd::m::_hook_match(const m::event &matching,
-                     const m::event &event)
-{
-	if(json::get<"origin"_>(matching))
-		if(at<"origin"_>(matching) != json::get<"origin"_>(event))
-			return false;
-
-	if(json::get<"room_id"_>(matching))
-		if(at<"room_id"_>(matching) != json::get<"room_id"_>(event))
-			return false;
-
-	if(json::get<"sender"_>(matching))
-		if(at<"sender"_>(matching) != json::get<"sender"_>(event))
-			return false;
-
-	if(json::get<"type"_>(matching))
-		if(at<"type"_>(matching) != json::get<"type"_>(event))
-			return false;
-
-	if(json::get<"state_key"_>(matching))
-		if(at<"state_key"_>(matching) != json::get<"state_key"_>(event))
-			return false;
-
-	if(json::get<"membership"_>(matching))
-		if(at<"membership"_>(matching) != json::get<"membership"_>(event))
-			return false;
-
-	if(json::get<"content"_>(matching))
-		if(json::get<"type"_>(event) == "m.room.message")
-			if(at<"content"_>(matching).has("msgtype"))
-				if(at<"content"_>(matching).get("msgtype") != json::get<"content"_>(event).get("msgtype"))
-					return false;
-
-	return true;
-}
-
 ///////////////////////////////////////////////////////////////////////////////
 //
 // m/import.h
@@ -737,11 +737,11 @@ const try
 			closure(unquote(event_id));
 		});
 
-	get(type, state_key, event::closure_idx{[&closure]
-	(const event::idx &idx)
-	{
-		event::fetch::event_id(idx, closure);
-	}});
+	if(!dbs::room_state_cached(room_id, type, state_key, closure))
+		throw m::NOT_FOUND
+		{
+			"(%s,%s) in %s", type, state_key, string_view{room_id}
+		};
 }
 catch(const db::not_found &e)
 {
@@ -762,19 +762,17 @@ ircd::m::room::state::get(const string_view &type,
 const try
 {
 	if(!present())
-		m::state::get(root_id, type, state_key, [&closure]
+		return m::state::get(root_id, type, state_key, [&closure]
 		(const string_view &event_id)
 		{
 			closure(index(unquote(event_id)));
 		});
 
-	auto &column{dbs::room_state};
-	char key[dbs::ROOM_STATE_KEY_MAX_SIZE];
-	column(dbs::room_state_key(key, room_id, type, state_key), [&closure]
-	(const string_view &value)
-	{
-		closure(byte_view<event::idx>(value));
-	});
+	if(!dbs::room_state_cached(room_id, type, state_key, closure))
+		throw m::NOT_FOUND
+		{
+			"(%s,%s) in %s", type, state_key, string_view{room_id}
+		};
 }
 catch(const db::not_found &e)
 {
@@ -821,11 +819,7 @@ const
 			closure(unquote(event_id));
 		});
 
-	return get(std::nothrow, type, state_key, event::closure_idx{[&closure]
-	(const event::idx &idx)
-	{
-		event::fetch::event_id(idx, std::nothrow, closure);
-	}});
+	return dbs::room_state_cached(room_id, type, state_key, closure);
 }
 
 bool
@@ -842,13 +836,7 @@ const
 			return closure(index(unquote(event_id), std::nothrow));
 		});
 
-	auto &column{dbs::room_state};
-	char key[dbs::ROOM_STATE_KEY_MAX_SIZE];
-	return column(dbs::room_state_key(key, room_id, type, state_key), std::nothrow, [&closure]
-	(const string_view &value)
-	{
-		closure(byte_view<event::idx>(value));
-	});
+	return dbs::room_state_cached(room_id, type, state_key, closure);
 }
 
 bool
@@ -871,9 +859,10 @@ const
 		(const string_view &event_id)
 		{});
 
-	auto &column{dbs::room_state};
-	char key[dbs::ROOM_STATE_KEY_MAX_SIZE];
-	return db::has(column, dbs::room_state_key(key, room_id, type, state_key));
+	return dbs::room_state_cached(room_id, type, state_key, event::closure_idx{[]
+	(const event::idx &)
+	{
+	}});
 }
 
 size_t
@@ -1773,6 +1762,146 @@ const
 // room::power
 //
 
+namespace ircd::m
+{
+	struct power_levels;
+
+	static std::shared_ptr<const power_levels> _power_levels(const room::power &);
+
+	extern conf::item<size_t> power_levels_cache_max;
+}
+
+/// Decoded content of one m.room.power_levels event. The maps index into
+/// the copy of the content held here. Entries are cached by the event_idx
+/// of the power_levels event, so accepting a new one simply makes the room
+/// resolve to a different entry.
+struct ircd::m::power_levels
+{
+	std::string content;
+	std::unordered_map<string_view, int64_t> levels;
+	std::unordered_map<string_view, int64_t> events;
+	std::unordered_map<string_view, int64_t> users;
+
+	power_levels(const string_view &content);
+};
+
+decltype(ircd::m::power_levels_cache_max)
+ircd::m::power_levels_cache_max
+{
+	{ "name",     "ircd.m.room.power.cache.max" },
+	{ "default",  1024L                         },
+};
+
+/// Each entry holds its position in _power_levels_lru.
+static std::map<ircd::m::event::idx, std::pair<std::shared_ptr<const ircd::m::power_levels>, std::list<ircd::m::event::idx>::iterator>>
+_power_levels_cache;
+
+/// The event_idx of the cached entries from the least to the most recently
+/// used. In a settled room the current power_levels is also the oldest, so
+/// age alone would evict the entries of the busiest rooms first.
+static std::list<ircd::m::event::idx>
+_power_levels_lru;
+
+ircd::m::power_levels::power_levels(const string_view &content_)
+:content
+{
+	content_
+}
+{
+	const auto decode{[]
+	(const json::object &object, auto &map)
+	{
+		for(const auto &member : object)
+		{
+			if(json::type(member.second) != json::NUMBER)
+				continue;
+
+			if(!try_lex_cast<int64_t>(member.second))
+				continue;
+
+			map.emplace(unquote(member.first), lex_cast<int64_t>(member.second));
+		}
+	}};
+
+	const json::object object
+	{
+		content
+	};
+
+	decode(object, levels);
+
+	const string_view &events_
+	{
+		object.get("events")
+	};
+
+	if(events_ && json::type(events_) == json::OBJECT)
+		decode(json::object{events_}, events);
+
+	const string_view &users_
+	{
+		object.get("users")
+	};
+
+	if(users_ && json::type(users_) == json::OBJECT)
+		decode(json::object{users_}, users);
+}
+
+std::shared_ptr<const ircd::m::power_levels>
+ircd::m::_power_levels(const room::power &power)
+{
+	event::idx event_idx{0};
+	const event::closure_idx set_idx{[&event_idx]
+	(const event::idx &idx)
+	{
+		event_idx = idx;
+	}};
+
+	power.state.get(std::nothrow, "m.room.power_levels", "", set_idx);
+
+	if(!event_idx)
+		return {};
+
+	const auto it
+	{
+		_power_levels_cache.find(event_idx)
+	};
+
+	if(it != end(_power_levels_cache))
+	{
+		_power_levels_lru.splice(end(_power_levels_lru), _power_levels_lru, it->second.second);
+		return it->second.first;
+	}
+
+	std::shared_ptr<const power_levels> ret;
+	m::get(std::nothrow, event_idx, "content", [&ret]
+	(const string_view &content)
+	{
+		ret = std::make_shared<const power_levels>(content);
+	});
+
+	if(!ret)
+		return ret;
+
+	// Another context may have cached it while the content was read.
+	if(_power_levels_cache.count(event_idx))
+		return _power_levels_cache.at(event_idx).first;
+
+	while(!_power_levels_cache.empty() && _power_levels_cache.size() >= size_t(power_levels_cache_max))
+	{
+		_power_levels_cache.erase(_power_levels_lru.front());
+		_power_levels_lru.pop_front();
+	}
+
+	const auto lru
+	{
+		_power_levels_lru.emplace(end(_power_levels_lru), event_idx)
+	};
+
+	_power_levels_cache.emplace(event_idx, std::make_pair(ret, lru));
+	return ret;
+}
+
 decltype(ircd::m::room::power::default_power_level)
 ircd::m::room::power::default_power_level
 {
@@ -1797,16 +1926,31 @@ ircd::m::room::power::operator()(const m::user::id &user_id,
                                  const string_view &type)
 const
 {
+	const auto levels
+	{
+		_power_levels(*this)
+	};
+
+	if(!levels)
+		return default_user_level >= (prop == "events"? default_event_level : default_power_level);
+
+	const auto get{[]
+	(const auto &map, const string_view &key, const int64_t &default_)
+	{
+		const auto it(map.find(key));
+		return it != end(map)? it->second : default_;
+	}};
+
 	const auto &user_level
 	{
-		level_user(user_id)
+		get(levels->users, user_id, default_user_level)
 	};
 
 	const auto &required_level
 	{
 		prop == "events"?
-			level_event(type):
-			level(prop)
+			get(levels->events, type, default_event_level):
+			get(levels->levels, prop, default_power_level)
 	};
 
 	return user_level >= required_level;
@@ -1814,78 +1958,38 @@ const
 
 int64_t
 ircd::m::room::power::level_user(const m::user::id &user_id)
-const try
+const
 {
-	int64_t ret
-	{
-		default_user_level
-	};
-
-	view([&user_id, &ret]
-	(const json::object &content)
-	{
-		const json::object &users
-		{
-			content.at("users")
-		};
+	const auto levels(_power_levels(*this));
+	if(!levels)
+		return default_user_level;
 
-		ret = users.at<int64_t>(user_id);
-	});
-
-	return ret;
-}
-catch(const json::error &e)
-{
-	return default_user_level;
+	const auto it(levels->users.find(user_id));
+	return it != end(levels->users)? it->second : default_user_level;
 }
 
 int64_t
 ircd::m::room::power::level_event(const string_view &type)
-const try
+const
 {
-	int64_t ret
-	{
-		default_event_level
-	};
-
-	view([&type, &ret]
-	(const json::object &content)
-	{
-		const json::object &events
-		{
-			content.at("events")
-		};
+	const auto levels(_power_levels(*this));
+	if(!levels)
+		return default_event_level;
 
-		ret = events.at<int64_t>(type);
-	});
-
-	return ret;
-}
-catch(const json::error &e)
-{
-	return default_event_level;
+	const auto it(levels->events.find(type));
+	return it != end(levels->events)? it->second : default_event_level;
 }
 
 int64_t
 ircd::m::room::power::level(const string_view &prop)
-const try
+const
 {
-	int64_t ret
-	{
-		default_power_level
-	};
-
-	view([&prop, &ret]
-	(const json::object &content)
-	{
-		ret = content.at<int64_t>(prop);
-	});
+	const auto levels(_power_levels(*this));
+	if(!levels)
+		return default_power_level;
 
-	return ret;
-}
-catch(const json::error &e)
-{
-	return default_power_level;
+	const auto it(levels->levels.find(prop));
+	return it != end(levels->levels)? it->second : default_power_level;
 }
 
 size_t
@@ -1933,58 +2037,18 @@ const
 
 bool
 ircd::m::room::power::has_event(const string_view &type)
-const try
-{
-	bool ret{false};
-	view([&type, &ret]
-	(const json::object &content)
-	{
-		const json::object &events
-		{
-			content.at("events")
-		};
-
-		const string_view &level
-		{
-			events.at(type)
-		};
-
-		ret = json::type(level) == json::NUMBER;
-	});
-
-	return ret;
-}
-catch(const json::error &)
+const
 {
-	return false;
+	const auto levels(_power_levels(*this));
+	return levels && levels->events.count(type);
 }
 
 bool
 ircd::m::room::power::has_user(const m::user::id &user_id)
-const try
-{
-	bool ret{false};
-	view([&user_id, &ret]
-	(const json::object &content)
-	{
-		const json::object &users
-		{
-			content.at("users")
-		};
-
-		const string_view &level
-		{
-			users.at(user_id)
-		};
-
-		ret = json::type(level) == json::NUMBER;
-	});
-
-	return ret;
-}
-catch(const json::error &)
+const
 {
-	return false;
+	const auto levels(_power_levels(*this));
+	return levels && levels->users.count(user_id);
 }
 
 bool
@@ -2007,16 +2071,8 @@ bool
 ircd::m::room::power::has_level(const string_view &prop)
 const
 {
-	bool ret{false};
-	view([&prop, &ret]
-	(const json::object &content)
-	{
-		const auto &value{content.get(prop)};
-		if(value && json::type(value) == json::NUMBER)
-			ret = true;
-	});
-
-	return ret;
+	const auto levels(_power_levels(*this));
+	return levels && levels->levels.count(prop);
 }
 
 void
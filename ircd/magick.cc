@@ -0,0 +1,297 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2018 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#include <RB_INC_MAGICK_API_H
+
+namespace ircd::magick
+{
+	struct exception;
+
+	static dimensions cover(const ::Image &, const dimensions &);
+	static dimensions fit(const ::Image &, const dimensions &);
+	static void encode(::Image &, const string_view &format, const result_closure &);
+	static void callex(const std::function<::Image *(::ExceptionInfo &)> &, const std::function<void (::Image &)> &);
+	static void limits();
+
+	extern conf::item<size_t> limit_pixels;
+}
+
+/// RAII wrapper around ExceptionInfo which throws when an error was set.
+struct ircd::magick::exception
+{
+	::ExceptionInfo info;
+
+	void check() const;
+
+	exception();
+	~exception() noexcept;
+};
+
+decltype(ircd::magick::limit_pixels)
+ircd::magick::limit_pixels
+{
+	{ "name",     "ircd.magick.limit.pixels" },
+	{ "default",  long(64 * 1000 * 1000)     },
+};
+
+ircd::magick::init::init()
+{
+	::InitializeMagick(nullptr);
+}
+
+ircd::magick::init::~init()
+noexcept
+{
+	::DestroyMagick();
+}
+
+const char *
+ircd::magick::version()
+{
+	unsigned long number;
+	return ::GetMagickVersion(&number);
+}
+
+void
+ircd::magick::scale(const const_buffer &in,
+                    const dimensions &dim,
+                    const string_view &format,
+                    const result_closure &closure)
+{
+	std::unique_ptr<::ImageInfo, void (*)(::ImageInfo *)> info
+	{
+		::CloneImageInfo(nullptr), ::DestroyImageInfo
+	};
+
+	limits();
+	callex([&info, &in](auto &ex)
+	{
+		return ::BlobToImage(info.get(), data(in), size(in), &ex);
+	},
+	[&dim, &format, &closure](::Image &image)
+	{
+		const auto to
+		{
+			fit(image, dim)
+		};
+
+		callex([&image, &to](auto &ex)
+		{
+			return ::ThumbnailImage(&image, to.width, to.height, &ex);
+		},
+		[&format, &closure](::Image &image)
+		{
+			encode(image, format, closure);
+		});
+	});
+}
+
+void
+ircd::magick::crop(const const_buffer &in,
+                   const dimensions &dim,
+                   const string_view &format,
+                   const result_closure &closure)
+{
+	std::unique_ptr<::ImageInfo, void (*)(::ImageInfo *)> info
+	{
+		::CloneImageInfo(nullptr), ::DestroyImageInfo
+	};
+
+	limits();
+	callex([&info, &in](auto &ex)
+	{
+		return ::BlobToImage(info.get(), data(in), size(in), &ex);
+	},
+	[&dim, &format, &closure](::Image &image)
+	{
+		const auto to
+		{
+			cover(image, dim)
+		};
+
+		callex([&image, &to](auto &ex)
+		{
+			return ::ThumbnailImage(&image, to.width, to.height, &ex);
+		},
+		[&dim, &format, &closure](::Image &image)
+		{
+			const unsigned long width
+			{
+				std::min(image.columns, (unsigned long)dim.width)
+			};
+
+			const unsigned long height
+			{
+				std::min(image.rows, (unsigned long)dim.height)
+			};
+
+			const ::RectangleInfo rect
+			{
+				width,
+				height,
+				long(image.columns - width) / 2,
+				long(image.rows - height) / 2,
+			};
+
+			callex([&image, &rect](auto &ex)
+			{
+				return ::CropImage(&image, &rect, &ex);
+			},
+			[&format, &closure](::Image &image)
+			{
+				encode(image, format, closure);
+			});
+		});
+	});
+}
+
+/// Encodes the image in the format (i.e "PNG" or "JPEG") into a blob which
+/// is viewed by the closure.
+void
+ircd::magick::encode(::Image &image,
+                     const string_view &format,
+                     const result_closure &closure)
+{
+	std::unique_ptr<::ImageInfo, void (*)(::ImageInfo *)> info
+	{
+		::CloneImageInfo(nullptr), ::DestroyImageInfo
+	};
+
+	strlcpy(image.magick, format);
+	strlcpy(info->magick, format);
+	info->quality = 85;
+
+	size_t len{0};
+	exception ex;
+	std::unique_ptr<void, void (*)(void *)> blob
+	{
+		::ImageToBlob(info.get(), &image, &len, &ex.info), ::MagickFree
+	};
+
+	ex.check();
+	if(unlikely(!blob))
+		throw error
+		{
+			"Failed to encode %s image", format
+		};
+
+	closure(const_buffer{reinterpret_cast<const char *>(blob.get()), len});
+}
+
+/// Calls a GraphicsMagick function which produces a new image; the image is
+/// passed to the second closure and destroyed afterward.
+void
+ircd::magick::callex(const std::function<::Image *(::ExceptionInfo &)> &func,
+                     const std::function<void (::Image &)> &closure)
+{
+	exception ex;
+	std::unique_ptr<::Image, void (*)(::Image *)> image
+	{
+		func(ex.info), ::DestroyImage
+	};
+
+	if(!image)
+		ex.check();
+
+	if(unlikely(!image))
+		throw error
+		{
+			"Image operation failed without an exception"
+		};
+
+	closure(*image);
+}
+
+/// Dimensions at least as large as `dim` in both axes with the aspect ratio
+/// of the image; the image is not enlarged.
+/// The limits are applied before each decode rather than once at init, which
+/// runs before the conf room is loaded; they are only pushed to the library
+/// when an item has changed since the last decode.
+void
+ircd::magick::limits()
+{
+	static size_t pixels;
+	if(pixels == size_t(limit_pixels))
+		return;
+
+	pixels = size_t(limit_pixels);
+	::SetMagickResourceLimit(PixelsResource, pixels);
+}
+
+ircd::magick::dimensions
+ircd::magick::cover(const ::Image &image,
+                    const dimensions &dim)
+{
+	const double ratio
+	{
+		std::max(double(dim.width) / image.columns, double(dim.height) / image.rows)
+	};
+
+	if(ratio >= 1.0)
+		return { uint16_t(std::min(image.columns, 65535UL)), uint16_t(std::min(image.rows, 65535UL)) };
+
+	return
+	{
+		uint16_t(std::max(std::lround(image.columns * ratio), long(dim.width))),
+		uint16_t(std::max(std::lround(image.rows * ratio), long(dim.height))),
+	};
+}
+
+/// Dimensions no larger than `dim` in either axis with the aspect ratio of
+/// the image; the image is not enlarged.
+ircd::magick::dimensions
+ircd::magick::fit(const ::Image &image,
+                  const dimensions &dim)
+{
+	const double ratio
+	{
+		std::min(double(dim.width) / image.columns, double(dim.height) / image.rows)
+	};
+
+	if(ratio >= 1.0)
+		return { uint16_t(std::min(image.columns, 65535UL)), uint16_t(std::min(image.rows, 65535UL)) };
+
+	return
+	{
+		uint16_t(std::max(std::lround(image.columns * ratio), 1L)),
+		uint16_t(std::max(std::lround(image.rows * ratio), 1L)),
+	};
+}
+
+//
+// exception
+//
+
+ircd::magick::exception::exception()
+{
+	::GetExceptionInfo(&info);
+}
+
+ircd::magick::exception::~exception()
+noexcept
+{
+	::DestroyExceptionInfo(&info);
+}
+
+void
+ircd::magick::exception::check()
+const
+{
+	if(info.severity < ErrorException)
+		return;
+
+	throw error
+	{
+		"%s%s%s",
+		info.reason?: "unknown error",
+		info.description? " :" : "",
+		info.description?: ""
+	};
+}
@@ -9,6 +9,24 @@
 // full license for this software is available in the LICENSE file.
 
 #include <ircd/asio.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+
+namespace ircd::net
+{
+	struct session_cache;
+	struct ticket_keys;
+
+	static int handle_new_session(SSL *, SSL_SESSION *) noexcept;
+	static int handle_ticket_key(SSL *, unsigned char *, unsigned char *, EVP_CIPHER_CTX *, HMAC_CTX *, int) noexcept;
+
+	extern conf::item<bool> ssl_session_enable;
+	extern conf::item<size_t> ssl_session_cache_max;
+	extern conf::item<seconds> ssl_ticket_rotate;
+	extern session_cache ssl_sessions;
+	extern ticket_keys ssl_ticket_keys;
+}
+
 
 namespace ircd::net
 {
@@ -44,6 +62,12 @@ ircd::net::init::init()
 
 	sslv23_client.set_verify_mode(asio::ssl::verify_peer);
 	sslv23_client.set_default_verify_paths();
+
+	// Sessions issued by remotes are kept in our own cache keyed by server
+	// name rather than OpenSSL's internal cache which has no such key.
+	SSL_CTX *const ctx(sslv23_client.native_handle());
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, handle_new_session);
 }
 
 /// Network subsystem shutdown
@@ -51,6 +75,7 @@ ircd::net::init::~init()
 noexcept
 {
 	wait_close_sockets();
+	ssl_sessions.clear();
 	assert(net::dns::resolver == resolver.get());
 	net::dns::resolver = nullptr;
 }
@@ -98,6 +123,22 @@ ircd::net::peer_cert_der_sha256(const mutable_buffer &buf,
 	};
 }
 
+/// The application protocol selected by the remote with ALPN during the
+/// handshake; empty if none was selected.
+ircd::string_view
+ircd::net::alpn(const socket &socket)
+noexcept
+{
+	const unsigned char *proto{nullptr};
+	unsigned int len{0};
+	const SSL &ssl(socket);
+	SSL_get0_alpn_selected(&ssl, &proto, &len);
+	return
+	{
+		reinterpret_cast<const char *>(proto), len
+	};
+}
+
 ircd::const_buffer
 ircd::net::peer_cert_der(const mutable_buffer &buf,
                          const socket &socket)
@@ -535,6 +576,312 @@ ircd::net::close(socket &socket,
 	socket.disconnect(opts, std::move(callback));
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// net/handshakes.h
+//
+
+/// Outbound sessions keyed by the server name used for SNI. When a peer is
+/// reconnected the last session it issued is offered for resumption rather
+/// than paying for a full handshake. The cache is bounded; when full the
+/// entry stored the longest ago is evicted.
+struct ircd::net::session_cache
+{
+	struct entry
+	{
+		SSL_SESSION *session {nullptr};
+		steady_point stored;
+	};
+
+	std::map<std::string, entry, std::less<>> map;
+
+	SSL_SESSION *find(const string_view &name) const;
+	void set(const string_view &name, SSL_SESSION *);
+	void clear() noexcept;
+
+	~session_cache() noexcept;
+};
+
+/// Keys for the stateless session tickets issued by listeners. A new key is
+/// generated each rotation period; tickets encrypted with the previous key
+/// are still accepted and are renewed on use.
+struct ircd::net::ticket_keys
+{
+	struct key
+	{
+		unsigned char name[16];
+		unsigned char aes[32];
+		unsigned char hmac[32];
+	};
+
+	key current, previous;
+	steady_point rotated;
+	bool valid {false};
+
+	void rotate();
+	const key *find(const unsigned char *const &name) const;
+	const key &get();
+};
+
+decltype(ircd::net::ssl_session_enable)
+ircd::net::ssl_session_enable
+{
+	{ "name",     "ircd.net.ssl.session.enable" },
+	{ "default",  true                          },
+};
+
+decltype(ircd::net::ssl_session_cache_max)
+ircd::net::ssl_session_cache_max
+{
+	{ "name",     "ircd.net.ssl.session.cache_max" },
+	{ "default",  4096L                            },
+};
+
+decltype(ircd::net::ssl_ticket_rotate)
+ircd::net::ssl_ticket_rotate
+{
+	{ "name",     "ircd.net.ssl.ticket.rotate" },
+	{ "default",  long(60 * 60 * 12)           },
+};
+
+decltype(ircd::net::ssl_sessions)
+ircd::net::ssl_sessions;
+
+decltype(ircd::net::ssl_ticket_keys)
+ircd::net::ssl_ticket_keys;
+
+bool
+ircd::net::resumed(const socket &socket)
+noexcept
+{
+	const SSL &ssl(socket);
+	return SSL_session_reused(const_cast<SSL *>(&ssl));
+}
+
+ircd::milliseconds
+ircd::net::handshake_time(const socket &socket)
+noexcept
+{
+	return socket.handshake_time;
+}
+
+//
+// handshakes
+//
+
+std::ostream &
+ircd::net::operator<<(std::ostream &s, const handshakes &h)
+{
+	static const string_view bin[]
+	{
+		"<1", "<4", "<16", "<64", "<256", "<1024", "<4096", ">4096"
+	};
+
+	s << "handshakes full:" << h.full << " resumed:" << h.resumed << " ms";
+	for(size_t i(0); i < h.BINS; ++i)
+		s << ' ' << bin[i] << ':' << h.hist[i];
+
+	return s;
+}
+
+void
+ircd::net::handshakes::operator()(const socket &socket)
+{
+	const auto ms
+	{
+		size_t(handshake_time(socket).count())
+	};
+
+	size_t i(0);
+	for(size_t lim(1); i < BINS - 1 && ms >= lim; lim *= 4)
+		++i;
+
+	++hist.at(i);
+	++(net::resumed(socket)? resumed : full);
+}
+
+//
+// session_cache
+//
+
+ircd::net::session_cache::~session_cache()
+noexcept
+{
+	clear();
+}
+
+void
+ircd::net::session_cache::clear()
+noexcept
+{
+	for(auto &p : map)
+		SSL_SESSION_free(p.second.session);
+
+	map.clear();
+}
+
+void
+ircd::net::session_cache::set(const string_view &name,
+                              SSL_SESSION *const session)
+{
+	auto it(map.lower_bound(name));
+	if(it != end(map) && it->first == name)
+		SSL_SESSION_free(it->second.session);
+	else
+	{
+		if(map.size() >= size_t(ssl_session_cache_max))
+		{
+			const auto oldest
+			{
+				std::min_element(begin(map), end(map), []
+				(const auto &a, const auto &b)
+				{
+					return a.second.stored < b.second.stored;
+				})
+			};
+
+			SSL_SESSION_free(oldest->second.session);
+			map.erase(oldest);
+		}
+
+		it = map.emplace_hint(it, std::string(name), entry{});
+	}
+
+	it->second.session = session;
+	it->second.stored = now<steady_point>();
+}
+
+SSL_SESSION *
+ircd::net::session_cache::find(const string_view &name)
+const
+{
+	const auto it(map.find(name));
+	if(it == end(map))
+		return nullptr;
+
+	SSL_SESSION *const session(it->second.session);
+	return SSL_SESSION_is_resumable(session)? session : nullptr;
+}
+
+/// Called by OpenSSL when the remote issues a session on an outbound
+/// connection; with TLS 1.3 this happens after the handshake. Returning 1
+/// takes ownership of the session.
+int
+ircd::net::handle_new_session(SSL *const ssl,
+                              SSL_SESSION *const session)
+noexcept try
+{
+	const char *const name
+	{
+		SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name)
+	};
+
+	if(!name || !ssl_session_enable)
+		return 0;
+
+	ssl_sessions.set(name, session);
+	return 1;
+}
+catch(const std::exception &e)
+{
+	log.error("Failed to cache SSL session :%s", e.what());
+	return 0;
+}
+
+//
+// ticket_keys
+//
+
+const ircd::net::ticket_keys::key &
+ircd::net::ticket_keys::get()
+{
+	const auto now
+	{
+		ircd::now<steady_point>()
+	};
+
+	if(!valid || now - rotated > seconds(ssl_ticket_rotate))
+		rotate();
+
+	return current;
+}
+
+const ircd::net::ticket_keys::key *
+ircd::net::ticket_keys::find(const unsigned char *const &name)
+const
+{
+	if(!valid)
+		return nullptr;
+
+	if(memcmp(name, current.name, sizeof(current.name)) == 0)
+		return &current;
+
+	if(memcmp(name, previous.name, sizeof(previous.name)) == 0)
+		return &previous;
+
+	return nullptr;
+}
+
+void
+ircd::net::ticket_keys::rotate()
+{
+	key next;
+	if(unlikely(RAND_bytes(reinterpret_cast<unsigned char *>(&next), sizeof(next)) != 1))
+		throw error
+		{
+			"Failed to generate session ticket key"
+		};
+
+	// The first key is also kept as the previous key so it is never matched
+	// by a name of zeroes.
+	previous = valid? current : next;
+	current = next;
+	rotated = now<steady_point>();
+	valid = true;
+	log.debug("Rotated session ticket keys");
+}
+
+/// Session ticket encryption for listeners. Returns 1 when the ticket was
+/// issued or is valid, 2 when it is valid but was made with the previous
+/// key so a fresh ticket should be issued, or 0 to refuse resumption.
+int
+ircd::net::handle_ticket_key(SSL *const ssl,
+                             unsigned char *const name,
+                             unsigned char *const iv,
+                             EVP_CIPHER_CTX *const cipher,
+                             HMAC_CTX *const hmac,
+                             const int enc)
+noexcept try
+{
+	if(enc)
+	{
+		const auto &key(ssl_ticket_keys.get());
+		if(RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+			return -1;
+
+		memcpy(name, key.name, sizeof(key.name));
+		EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes, iv);
+		HMAC_Init_ex(hmac, key.hmac, sizeof(key.hmac), EVP_sha256(), nullptr);
+		return 1;
+	}
+
+	// Expires the current key if it is due before deciding which key the
+	// ticket was made with.
+	const auto &current(ssl_ticket_keys.get());
+	const auto *const key(ssl_ticket_keys.find(name));
+	if(!key)
+		return 0;
+
+	HMAC_Init_ex(hmac, key->hmac, sizeof(key->hmac), EVP_sha256(), nullptr);
+	EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key->aes, iv);
+	return key == &current? 1 : 2;
+}
+catch(const std::exception &e)
+{
+	log.error("Session ticket key :%s", e.what());
+	return -1;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // net/open.h
@@ -1005,7 +1352,8 @@ ircd::net::listener::acceptor::timeout
 std::ostream &
 ircd::net::operator<<(std::ostream &s, const struct listener::acceptor &a)
 {
-	s << "'" << a.name << "' @ [" << string(a.ep.address()) << "]:" << a.ep.port();
+	s << "'" << a.name << "' @ [" << string(a.ep.address()) << "]:" << a.ep.port()
+	  << " " << a.handshakes;
 	return s;
 }
 
@@ -1199,6 +1547,7 @@ noexcept try
 
 	++handshaking;
 	sock->set_timeout(milliseconds(timeout));
+	sock->handshake_began = now<steady_point>();
 	sock->ssl.async_handshake(handshake_type, std::move(handshake));
 }
 catch(const ctx::interrupted &e)
@@ -1283,6 +1632,8 @@ noexcept try
 
 	check_handshake_error(ec, *sock);
 	sock->cancel_timeout();
+	sock->handshake_time = duration_cast<milliseconds>(now<steady_point>() - sock->handshake_began);
+	handshakes(*sock);
 	assert(bool(cb));
 	cb(sock);
 }
@@ -1361,6 +1712,15 @@ ircd::net::listener::acceptor::configure(const json::object &opts)
 		//| ssl.single_dh_use
 	);
 
+	// Resumption is offered with stateless tickets under keys which rotate
+	// (see: ticket_keys); the server-side session cache is also enabled for
+	// clients which don't support tickets.
+	SSL_CTX *const ctx(ssl.native_handle());
+	SSL_CTX_set_session_id_context(ctx, reinterpret_cast<const unsigned char *>(data(name)), std::min(size(name), size_t(SSL_MAX_SID_CTX_LENGTH)));
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_timeout(ctx, seconds(ssl_ticket_rotate).count());
+	SSL_CTX_set_tlsext_ticket_key_cb(ctx, handle_ticket_key);
+
 	//TODO: XXX
 	ssl.set_password_callback([this]
 	(const auto &size, const auto &purpose)
@@ -1808,8 +2168,55 @@ ircd::net::socket::handshake(const open_opts &opts,
 		std::bind(&socket::handle_verify, this, ph::_1, ph::_2, opts)
 	};
 
+	// The protocol list is sent in the wire format of length-prefixed names.
+	if(!empty(opts.alpn))
+	{
+		size_t len{0};
+		unsigned char protos[64];
+		tokens(opts.alpn, ',', [&protos, &len]
+		(const string_view &proto)
+		{
+			if(unlikely(size(proto) > 255 || len + 1 + size(proto) > sizeof(protos)))
+				throw error
+				{
+					"ALPN protocol list is too long"
+				};
+
+			protos[len++] = size(proto);
+			len += copy(mutable_buffer{reinterpret_cast<char *>(protos + len), size(proto)}, proto);
+		});
+
+		if(unlikely(SSL_set_alpn_protos(ssl.native_handle(), protos, len) != 0))
+			throw error
+			{
+				"Failed to set ALPN protocols '%s'", opts.alpn
+			};
+	}
+
+	// The server name is sent for SNI; it is also the key for the session
+	// cache so a previous session with this server can be offered.
+	const std::string server_name
+	{
+		common_name(opts)
+	};
+
+	error_code ec;
+	ip::address::from_string(server_name, ec);
+	if(!empty(server_name) && ec)
+	{
+		SSL_set_tlsext_host_name(ssl.native_handle(), server_name.c_str());
+		SSL_SESSION *const session
+		{
+			ssl_session_enable? ssl_sessions.find(server_name) : nullptr
+		};
+
+		if(session)
+			SSL_set_session(ssl.native_handle(), session);
+	}
+
 	set_timeout(opts.handshake_timeout);
 	ssl.set_verify_callback(std::move(verify_handler));
+	handshake_began = now<steady_point>();
 	ssl.async_handshake(handshake_type::client, std::move(handshake_handler));
 }
 
@@ -2329,11 +2736,14 @@ noexcept try
 	if(timedout && ec == operation_canceled && ec.category() == system_category())
 		ec = { timed_out, system_category() };
 
-	log.debug("socket(%p) local[%s] remote[%s] handshake %s",
+	handshake_time = duration_cast<milliseconds>(now<steady_point>() - handshake_began);
+	log.debug("socket(%p) local[%s] remote[%s] handshake %s %s in %ld$ms",
 	          this,
 	          string(local_ipport(*this)),
 	          string(remote_ipport(*this)),
-	          string(ec));
+	          net::resumed(*this)? "resumed" : "full",
+	          string(ec),
+	          handshake_time.count());
 
 	// This is the end of the asynchronous call chain; the user is called
 	// back with or without error here.
@@ -2637,6 +3047,11 @@ decltype(ircd::net::dns::cache)
 ircd::net::dns::cache
 {};
 
+/// Singleton instance of the DNS counters
+decltype(ircd::net::dns::stats)
+ircd::net::dns::stats
+{};
+
 /// Singleton instance of the internal boost resolver wrapper.
 decltype(ircd::net::dns::resolver)
 ircd::net::dns::resolver
@@ -2661,6 +3076,13 @@ ircd::net::dns::cache::min_ttl
 	{ "default",   900L                        },
 };
 
+decltype(ircd::net::dns::cache::prefetch)
+ircd::net::dns::cache::prefetch
+{
+	{ "name",     "ircd.net.dns.cache.prefetch" },
+	{ "default",   90L                          },
+};
+
 decltype(ircd::net::dns::prefetch_ipport)
 ircd::net::dns::prefetch_ipport{[]
 (std::exception_ptr, const auto &hostport, const auto &record)
@@ -2815,7 +3237,10 @@ ircd::net::dns::operator()(const hostport &hostport,
 {
 	if(opts.cache_check)
 		if(cache.get(hostport, opts, cb))
+		{
+			++stats.hits;
 			return;
+		}
 
 	assert(bool(ircd::net::dns::resolver));
 	(*resolver)(hostport, opts, std::move(cb));
@@ -3008,6 +3433,7 @@ ircd::net::dns::cache::get(const hostport &hp,
 	thread_local std::array<const rfc1035::record *, resolver::MAX_COUNT> record;
 	std::exception_ptr eptr;
 	size_t count{0};
+	time_t expires{std::numeric_limits<time_t>::max()};
 
 	//TODO: Better deduction
 	if(hp.service || opts.srv) // deduced SRV query
@@ -3052,6 +3478,7 @@ ircd::net::dns::cache::get(const hostport &hp,
 			if(count < record.size())
 				record.at(count++) = &rr;
 
+			expires = std::min(expires, rr.ttl);
 			++it;
 		}
 	}
@@ -3094,6 +3521,7 @@ ircd::net::dns::cache::get(const hostport &hp,
 			if(count < record.size())
 				record.at(count++) = &rr;
 
+			expires = std::min(expires, rr.ttl);
 			++it;
 		}
 	}
@@ -3101,10 +3529,36 @@ ircd::net::dns::cache::get(const hostport &hp,
 	assert(count || !eptr);        // no error if no cache response
 	assert(!eptr || count == 1);   // if error, should only be one entry.
 
-	if(count)
-		cb(std::move(eptr), hp, vector_view<const rfc1035::record *>(record.data(), count));
+	if(!count)
+		return false;
+
+	const bool refresh
+	{
+		!eptr && expires - ircd::time() < seconds(cache::prefetch).count()
+	};
+
+	cb(std::move(eptr), hp, vector_view<const rfc1035::record *>(record.data(), count));
+
+	// An entry still in use close to its expiration is refreshed in the
+	// background so it doesn't stall its users when it expires.
+	if(refresh && resolver) try
+	{
+		auto refresh_opts(opts);
+		refresh_opts.cache_check = false;
+		refresh_opts.cache_result = true;
+		(*resolver)(hp, refresh_opts, [](std::exception_ptr, const hostport &, const auto &)
+		{
+			// Do nothing; cache already updated if necessary
+		});
 
-	return count;
+		++stats.prefetched;
+	}
+	catch(const std::exception &e)
+	{
+		log.derror("DNS prefetch for '%s' :%s", host(hp), e.what());
+	}
+
+	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -3310,6 +3764,12 @@ ircd::net::dns::resolver::operator()(const hostport &hp,
                                      const opts &opts,
                                      callback &&callback)
 {
+	if(coalesce(hp, opts, callback))
+	{
+		++stats.coalesced;
+		return;
+	}
+
 	auto &tag
 	{
 		set_tag(hp, opts, std::move(callback))
@@ -3323,6 +3783,72 @@ ircd::net::dns::resolver::operator()(const hostport &hp,
 
 	tag.question = make_query(tag.qbuf, tag);
 	submit(tag);
+	++stats.misses;
+}
+
+/// When an identical question is already in flight the callback is chained
+/// onto that tag rather than sending another query; returns true if so.
+/// Each caller's callback still receives its own hostport.
+bool
+ircd::net::dns::resolver::coalesce(const hostport &hp,
+                                   const opts &opts,
+                                   callback &callback)
+{
+	if(tags.empty())
+		return false;
+
+	thread_local char qbuf[sizeof(tag::qbuf)];
+	const tag probe
+	{
+		hp, opts, dns::callback{}
+	};
+
+	// The first two bytes of a query are its id; the rest is compared.
+	const const_buffer question
+	{
+		make_query(qbuf, probe) + 2
+	};
+
+	const auto it
+	{
+		std::find_if(begin(tags), end(tags), [&opts, &question]
+		(const auto &p)
+		{
+			const auto &tag(p.second);
+			if(size(tag.question) != size(question) + 2)
+				return false;
+
+			if(tag.opts.cache_result != opts.cache_result)
+				return false;
+
+			if(tag.opts.nxdomain_exceptions != opts.nxdomain_exceptions)
+				return false;
+
+			return memcmp(data(tag.question) + 2, data(question), size(question)) == 0;
+		})
+	};
+
+	if(it == end(tags))
+		return false;
+
+	auto &tag(it->second);
+	tag.cb = [first(std::move(tag.cb)),
+	          second(std::move(callback)),
+	          hostname(std::string(host(hp))),
+	          servname(std::string(service(hp))),
+	          portnum(port(hp))]
+	(std::exception_ptr eptr, const hostport &hp, const vector_view<const rfc1035::record *> &rrs)
+	{
+		if(first)
+			first(eptr, hp, rrs);
+
+		hostport own{hostname, portnum};
+		own.service = servname.empty()? string_view{} : string_view{servname};
+		if(second)
+			second(std::move(eptr), own, rrs);
+	};
+
+	return true;
 }
 
 ircd::const_buffer
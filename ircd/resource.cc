@@ -927,28 +927,22 @@ ircd::resource::response::response(client &client,
 {
 	assert(empty(content) || !empty(content_type));
 
-	// Head gets sent
+	// Head and all content gets sent together
 	response
 	{
-		client, code, content_type, size(content), headers
+		client, code, content_type, size(content), headers, content
 	};
-
-	// All content gets sent
-	const size_t written
-	{
-		client.write_all(content)
-	};
-
-	assert(written == size(content));
 }
 
 ircd::resource::response::response(client &client,
                                    const http::code &code,
                                    const string_view &content_type,
                                    const size_t &content_length,
-                                   const string_view &headers)
+                                   const string_view &headers,
+                                   const const_buffer &content)
 {
 	assert(!content_length || !empty(content_type));
+	assert(size(content) <= content_length);
 
 	const auto request_time
 	{
@@ -985,9 +979,15 @@ ircd::resource::response::response(client &client,
 			"HTTP headers too large for buffer of %zu", sizeof(head_buf)
 		};
 
+	// Any content given here is gathered into the same write as the head.
+	const const_buffer iov[]
+	{
+		head.completed(), content
+	};
+
 	const size_t written
 	{
-		client.write_all(head.completed())
+		client.write_all(iov)
 	};
 
 	#ifdef RB_DEBUG
@@ -1017,5 +1017,5 @@ ircd::resource::response::response(client &client,
 	};
 	#endif
 
-	assert(written == size(head.completed()));
+	assert(written == size(head.completed()) + size(content));
 }
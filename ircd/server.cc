@@ -10,6 +10,10 @@
 
 #include <ircd/asio.h>
 
+#ifdef HAVE_LIBNGHTTP2
+#include <RB_INC_NGHTTP2_NGHTTP2_H
+#endif
+
 namespace ircd::server
 {
 	// Internal state
@@ -25,6 +29,9 @@ namespace ircd::server
 	void interrupt_all();
 	void close_all();
 	void wait_all();
+	[[noreturn]] void reaper_worker();
+
+	extern conf::item<bool> http2_enable;
 }
 
 decltype(ircd::server::log)
@@ -56,6 +63,20 @@ ircd::server::wait_all()
 	}
 }
 
+/// Periodically closes links which have been idle too long; see
+/// peer::link_reap().
+void
+ircd::server::reaper_worker()
+{
+	while(1)
+	{
+		ctx::sleep(seconds(peer::link_idle_timeout));
+		for(auto &p : peers)
+			if(!p.second->op_fini)
+				p.second->link_reap();
+	}
+}
+
 void
 ircd::server::close_all()
 {
@@ -123,6 +144,13 @@ ircd::server::create(const net::hostport &hostport)
 		}
 	};
 
+	// Offer HTTP/2 during the TLS handshake; links which negotiate it carry
+	// their tags as concurrent streams rather than a pipeline.
+	#ifdef HAVE_LIBNGHTTP2
+	if(http2_enable)
+		peer->open_opts.alpn = "h2,http/1.1";
+	#endif
+
 	// Async DNS resolve. The links for the new peer will be connected
 	// once the resolver calls back into peer::handle_resolve().
 	peer->resolve(peer->open_opts.hostport);
@@ -245,12 +273,17 @@ ircd::server::accumulate_peers(F&& closure)
 //
 
 ircd::server::init::init()
+:reaper
+{
+	"server reaper", 128_KiB, &reaper_worker, ctx::context::POST
+}
 {
 }
 
 ircd::server::init::~init()
 noexcept
 {
+	reaper.interrupt();
 	close();
 	wait();
 	peers.clear();
@@ -366,6 +399,13 @@ ircd::server::peer::link_max_default
 	{ "default",  2L                          }
 };
 
+decltype(ircd::server::peer::link_idle_timeout)
+ircd::server::peer::link_idle_timeout
+{
+	{ "name",     "ircd.server.peer.link_idle_timeout" },
+	{ "default",  60L                                  }
+};
+
 //
 // peer::peer
 //
@@ -470,6 +510,9 @@ try
 			"Peer is unable to take any requests: %s", err_msg()
 		};
 
+	// Measured concurrency scales the number of links kept for this peer.
+	concurrency += (double(tag_count() + 1) - concurrency) / 8.0;
+
 	link *const ret
 	{
 		link_get(request)
@@ -556,22 +599,25 @@ ircd::server::peer::link_get(const request &request)
 		if(!best_maxed && cand_maxed)
 			continue;
 
-		// Candidates's queue has less or same backlog of unsent requests, but
-		// now measure if candidate will take longer to process at least the
-		// write-side of those requests.
-		if(cand.write_remaining() > best->write_remaining())
+		// Prefer the link expected to complete this request soonest based on
+		// its observed latency and the work already queued on it.
+		const auto cand_expected(cand.expected(rtt));
+		const auto best_expected(best->expected(rtt));
+		if(cand_expected > best_expected)
 			continue;
 
-		// Candidate might be working through really large content; though
-		// this is a very sketchy measurement right now since we only *might*
-		// know about content-length for the *one* active tag occupying the
-		// socket.
-		if(cand.read_remaining() > best->read_remaining())
+		if(cand_expected < best_expected)
+		{
+			best = &cand;
 			continue;
+		}
 
-		// Coarse distribution based on who has more work; this is weak, should
-		// be replaced.
-		if(cand.tag_count() > best->tag_count())
+		// Without any latency history the links are distinguished by their
+		// backlog of unsent data and then the number of tags.
+		if(cand.write_remaining() > best->write_remaining())
+			continue;
+
+		if(cand.tag_count() >= best->tag_count())
 			continue;
 
 		best = &cand;
@@ -609,6 +655,41 @@ ircd::server::peer::link_get(const request &request)
 	return best;
 }
 
+/// Closes links which have had nothing to do for the idle timeout while the
+/// peer has more ready links than its minimum.
+size_t
+ircd::server::peer::link_reap()
+{
+	const auto now
+	{
+		ircd::now<steady_point>()
+	};
+
+	size_t ret(0);
+	for(auto &link : links)
+	{
+		if(link_ready() <= link_min())
+			break;
+
+		if(!link.ready() || link.tag_count())
+			continue;
+
+		if(now - link.idle_since < seconds(link_idle_timeout))
+			continue;
+
+		log.debug("peer(%p) link(%p) [%s]: closing after idle for %ld$s",
+		          this,
+		          &link,
+		          string(remote),
+		          duration_cast<seconds>(now - link.idle_since).count());
+
+		link.close();
+		++ret;
+	}
+
+	return ret;
+}
+
 ircd::server::link &
 ircd::server::peer::link_add(const size_t &num)
 {
@@ -762,6 +843,7 @@ noexcept try
 	          tag.state.content_length,
 	          link.tag_count() - 1);
 
+	handle_latency(link, tag);
 	if(link.tag_committed() >= link.tag_commit_max())
 		link.wait_writable();
 }
@@ -782,7 +864,10 @@ ircd::server::peer::handle_link_done(link &link)
 {
 	assert(link.tag_count() == 0);
 
-	if(link_ready() > link_min())
+	// Links between the minimum and maximum are kept around for reuse until
+	// they have been idle for a while; see link_reap().
+	link.idle_since = now<steady_point>();
+	if(link_ready() > link_max())
 	{
 		link.close();
 		return;
@@ -791,6 +876,73 @@ ircd::server::peer::handle_link_done(link &link)
 	link.wait_readable();
 }
 
+/// Accounts the timing of a completed tag to the link and peer averages.
+/// These are exponentially weighted moving averages in the manner of the
+/// TCP round-trip estimator (gain of 1/8).
+void
+ircd::server::peer::handle_latency(link &link,
+                                   const tag &tag)
+{
+	if(tag.state.status == http::code(0) || tag.state.started == steady_point{})
+		return;
+
+	const auto now
+	{
+		ircd::now<steady_point>()
+	};
+
+	const auto sample_rtt
+	{
+		duration_cast<microseconds>(now - tag.state.started)
+	};
+
+	const auto sample_ttfb
+	{
+		duration_cast<microseconds>(tag.state.head_recv - tag.state.started)
+	};
+
+	const auto ewma{[](microseconds &avg, const microseconds &sample)
+	{
+		avg = avg.count()? avg + (sample - avg) / 8 : sample;
+	}};
+
+	ewma(link.rtt, sample_rtt);
+	ewma(link.ttfb, sample_ttfb);
+	ewma(rtt, sample_rtt);
+	ewma(ttfb, sample_ttfb);
+
+	const auto sample
+	{
+		std::min(sample_rtt.count(), long(std::numeric_limits<uint32_t>::max()))
+	};
+
+	latency.at(latency_count++ % latency.size()) = sample;
+}
+
+ircd::microseconds
+ircd::server::peer::latency_percentile(const double &pct)
+const
+{
+	const size_t count
+	{
+		std::min(latency_count, latency.size())
+	};
+
+	if(!count)
+		return microseconds{0};
+
+	std::array<uint32_t, LATENCY_SAMPLES> sorted;
+	std::copy(begin(latency), begin(latency) + count, begin(sorted));
+
+	const size_t pos
+	{
+		std::min(size_t(pct / 100.0 * count), count - 1)
+	};
+
+	std::nth_element(begin(sorted), begin(sorted) + pos, begin(sorted) + count);
+	return microseconds{sorted[pos]};
+}
+
 /// This is called when a tag on a link receives an HTTP response head.
 /// We can use this to learn information from the tag's request and the
 /// response head etc.
@@ -1081,14 +1233,29 @@ size_t
 ircd::server::peer::link_min()
 const
 {
-	return link_min_default;
+	// Enough links to carry the measured concurrency without queueing
+	// behind the commit limit, within the configured range.
+	const size_t want
+	{
+		size_t(std::ceil(concurrency / size_t(link::tag_commit_max_default)))
+	};
+
+	return std::clamp(want, size_t(link_min_default), std::max(size_t(link_min_default), size_t(link_max_default)));
 }
 
 size_t
 ircd::server::peer::link_max()
 const
 {
-	return link_max_default;
+	// Headroom for bursts above the measured concurrency; never beyond the
+	// configured maximum.
+	const size_t want
+	{
+		size_t(std::ceil(concurrency * 2 / size_t(link::tag_commit_max_default))) + 1
+	};
+
+	const auto min(link_min());
+	return std::clamp(want, min, std::max(min, size_t(link_max_default)));
 }
 
 bool
@@ -1124,6 +1291,669 @@ const
 	});
 }
 
+//
+// link::http2
+//
+
+namespace ircd::server
+{
+	extern conf::item<bool> http2_enable;
+	extern conf::item<size_t> http2_streams_max;
+	extern conf::item<size_t> http2_window;
+}
+
+decltype(ircd::server::http2_enable)
+ircd::server::http2_enable
+{
+	{ "name",     "ircd.server.http2.enable" },
+	{ "default",  true                       },
+};
+
+decltype(ircd::server::http2_streams_max)
+ircd::server::http2_streams_max
+{
+	{ "name",     "ircd.server.http2.streams_max" },
+	{ "default",  100L                            },
+};
+
+decltype(ircd::server::http2_window)
+ircd::server::http2_window
+{
+	{ "name",     "ircd.server.http2.window" },
+	{ "default",  long(1_MiB)                },
+};
+
+#ifdef HAVE_LIBNGHTTP2
+
+/// HTTP/2 session state for a link which negotiated h2 with ALPN. Each tag
+/// on the link is one stream. The tag's HTTP/1.1 request head is translated
+/// to HPACK headers when the stream is submitted; the response headers are
+/// translated back to an HTTP/1.1 head and received by the tag exactly as
+/// on an HTTP/1.1 link. A response without a content-length is presented to
+/// the tag as chunked encoding with one chunk per DATA frame. This keeps all
+/// of the user's buffer options (contiguous, dynamic, window, progress)
+/// working without a second implementation of them.
+struct ircd::server::link::http2
+{
+	struct stream
+	{
+		server::tag *tag {nullptr};
+		std::string head;
+		bool chunked {false};
+		bool done {false};
+	};
+
+	server::link *link;
+	nghttp2_session *session {nullptr};
+	std::map<int32_t, stream> streams;
+	std::string out;
+	size_t out_pos {0};
+
+	stream *find(const int32_t &id);
+	void feed(stream &, const int32_t &id, const_buffer);
+	void finish(stream &, const int32_t &id);
+
+	static int on_header(nghttp2_session *, const nghttp2_frame *, const uint8_t *, size_t, const uint8_t *, size_t, uint8_t, void *) noexcept;
+	static int on_frame_recv(nghttp2_session *, const nghttp2_frame *, void *) noexcept;
+	static int on_data_chunk_recv(nghttp2_session *, uint8_t, int32_t, const uint8_t *, size_t, void *) noexcept;
+	static int on_stream_close(nghttp2_session *, int32_t, uint32_t, void *) noexcept;
+	static ssize_t read_content(nghttp2_session *, int32_t, uint8_t *, size_t, uint32_t *, nghttp2_data_source *, void *) noexcept;
+
+	http2(server::link &);
+	http2(http2 &&) = delete;
+	http2(const http2 &) = delete;
+	~http2() noexcept;
+};
+
+ircd::server::link::http2::http2(server::link &link)
+:link{&link}
+{
+	nghttp2_session_callbacks *callbacks;
+	if(unlikely(nghttp2_session_callbacks_new(&callbacks) != 0))
+		throw error
+		{
+			"Failed to allocate HTTP/2 callbacks"
+		};
+
+	const unwind free{[&callbacks]
+	{
+		nghttp2_session_callbacks_del(callbacks);
+	}};
+
+	nghttp2_session_callbacks_set_on_header_callback(callbacks, on_header);
+	nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, on_frame_recv);
+	nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, on_data_chunk_recv);
+	nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, on_stream_close);
+	if(unlikely(nghttp2_session_client_new(&session, callbacks, this) != 0))
+		throw error
+		{
+			"Failed to create HTTP/2 session"
+		};
+
+	const nghttp2_settings_entry settings[]
+	{
+		{ NGHTTP2_SETTINGS_ENABLE_PUSH,             0                          },
+		{ NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS,  uint32_t(http2_streams_max) },
+		{ NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE,     uint32_t(http2_window)      },
+	};
+
+	nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, settings, sizeof(settings) / sizeof(settings[0]));
+	nghttp2_session_set_local_window_size(session, NGHTTP2_FLAG_NONE, 0, int32_t(http2_window) * 4);
+}
+
+ircd::server::link::http2::~http2()
+noexcept
+{
+	// Streams are forgotten first so any callbacks made by the deletion
+	// don't reach tags which may already be gone.
+	streams.clear();
+	nghttp2_session_del(session);
+}
+
+ircd::server::link::http2::stream *
+ircd::server::link::http2::find(const int32_t &id)
+{
+	const auto it
+	{
+		streams.find(id)
+	};
+
+	return it != end(streams)? &it->second : nullptr;
+}
+
+/// Passes received data to the tag through its read buffers the same way
+/// the HTTP/1.1 link receives from the socket.
+void
+ircd::server::link::http2::feed(stream &stream,
+                                const int32_t &id,
+                                const_buffer buffer)
+try
+{
+	auto &tag(*stream.tag);
+	while(!empty(buffer) && !stream.done && tag.request)
+	{
+		const mutable_buffer dst
+		{
+			tag.make_read_buffer()
+		};
+
+		const size_t copied
+		{
+			copy(dst, buffer)
+		};
+
+		tag.read_buffer(const_buffer{data(dst), copied}, stream.done, *link);
+		consume(buffer, copied);
+	}
+}
+catch(const std::exception &e)
+{
+	stream.done = true;
+	stream.tag->set_exception(std::current_exception());
+	nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, id, NGHTTP2_INTERNAL_ERROR);
+}
+
+/// The remote ended the stream.
+void
+ircd::server::link::http2::finish(stream &stream,
+                                  const int32_t &id)
+{
+	static const string_view last_chunk
+	{
+		"0\r\n\r\n"
+	};
+
+	if(stream.chunked)
+		feed(stream, id, last_chunk);
+
+	if(!stream.done && stream.tag->request)
+		stream.tag->set_exception(error
+		{
+			"HTTP/2 stream %d ended before the end of content", id
+		});
+
+	stream.done = true;
+}
+
+int
+ircd::server::link::http2::on_header(nghttp2_session *const session,
+                                     const nghttp2_frame *const frame,
+                                     const uint8_t *const name_,
+                                     const size_t name_len,
+                                     const uint8_t *const value_,
+                                     const size_t value_len,
+                                     const uint8_t flags,
+                                     void *const user_data)
+noexcept try
+{
+	auto &h2(*static_cast<http2 *>(user_data));
+	auto *const stream(h2.find(frame->hd.stream_id));
+	if(!stream || frame->hd.type != NGHTTP2_HEADERS || stream->done)
+		return 0;
+
+	// Trailers after the content are not passed on.
+	if(frame->headers.cat == NGHTTP2_HCAT_HEADERS && stream->tag->state.status != http::code(0))
+		return 0;
+
+	const string_view name{reinterpret_cast<const char *>(name_), name_len};
+	const string_view value{reinterpret_cast<const char *>(value_), value_len};
+	if(name == ":status")
+	{
+		const auto code
+		{
+			http::code(lex_cast<ushort>(value))
+		};
+
+		stream->head = "HTTP/1.1 ";
+		stream->head += value;
+		stream->head += " ";
+		stream->head += http::status(code);
+		stream->head += "\r\n";
+		return 0;
+	}
+
+	stream->head += name;
+	stream->head += ": ";
+	stream->head += value;
+	stream->head += "\r\n";
+	return 0;
+}
+catch(const std::exception &e)
+{
+	return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+}
+
+int
+ircd::server::link::http2::on_frame_recv(nghttp2_session *const session,
+                                         const nghttp2_frame *const frame,
+                                         void *const user_data)
+noexcept try
+{
+	auto &h2(*static_cast<http2 *>(user_data));
+	auto *const stream(h2.find(frame->hd.stream_id));
+	if(!stream)
+		return 0;
+
+	const bool headers_end
+	{
+		frame->hd.type == NGHTTP2_HEADERS &&
+		(frame->hd.flags & NGHTTP2_FLAG_END_HEADERS) &&
+		!empty(stream->head) &&
+		stream->tag->state.status == http::code(0)
+	};
+
+	// Informational responses are discarded; the final head is given to the
+	// tag with a chunked transfer-encoding if no content-length was sent.
+	if(headers_end && startswith(stream->head, "HTTP/1.1 1"))
+		stream->head.clear();
+	else if(headers_end)
+	{
+		stream->chunked = !has(stream->head, "\r\ncontent-length: ");
+		if(stream->chunked)
+			stream->head += "transfer-encoding: chunked\r\n";
+
+		stream->head += "\r\n";
+		const std::string head{std::move(stream->head)};
+		h2.feed(*stream, frame->hd.stream_id, string_view{head});
+	}
+
+	if(frame->hd.flags & NGHTTP2_FLAG_END_STREAM)
+		if(frame->hd.type == NGHTTP2_HEADERS || frame->hd.type == NGHTTP2_DATA)
+			h2.finish(*stream, frame->hd.stream_id);
+
+	return 0;
+}
+catch(const std::exception &e)
+{
+	return NGHTTP2_ERR_CALLBACK_FAILURE;
+}
+
+int
+ircd::server::link::http2::on_data_chunk_recv(nghttp2_session *const session,
+                                              const uint8_t flags,
+                                              const int32_t stream_id,
+                                              const uint8_t *const data,
+                                              const size_t len,
+                                              void *const user_data)
+noexcept try
+{
+	auto &h2(*static_cast<http2 *>(user_data));
+	auto *const stream(h2.find(stream_id));
+	if(!stream || !len)
+		return 0;
+
+	const const_buffer content
+	{
+		reinterpret_cast<const char *>(data), len
+	};
+
+	if(!stream->chunked)
+	{
+		h2.feed(*stream, stream_id, content);
+		return 0;
+	}
+
+	char chunk_head[24];
+	h2.feed(*stream, stream_id, string_view{fmt::sprintf{chunk_head, "%zx\r\n", len}});
+	h2.feed(*stream, stream_id, content);
+	h2.feed(*stream, stream_id, "\r\n"_sv);
+	return 0;
+}
+catch(const std::exception &e)
+{
+	return NGHTTP2_ERR_CALLBACK_FAILURE;
+}
+
+/// The stream is finished in both directions; the tag is removed from the
+/// link's queue here.
+int
+ircd::server::link::http2::on_stream_close(nghttp2_session *const session,
+                                           const int32_t stream_id,
+                                           const uint32_t error_code,
+                                           void *const user_data)
+noexcept try
+{
+	auto &h2(*static_cast<http2 *>(user_data));
+	auto &link(*h2.link);
+	auto *const stream(h2.find(stream_id));
+	if(!stream)
+		return 0;
+
+	auto &tag(*stream->tag);
+	if(!stream->done && tag.request)
+		tag.set_exception(error
+		{
+			"HTTP/2 stream %d closed :%s", stream_id, nghttp2_http2_strerror(error_code)
+		});
+
+	h2.streams.erase(stream_id);
+	const auto it
+	{
+		std::find_if(begin(link.queue), end(link.queue), [&tag]
+		(const auto &t)
+		{
+			return &t == &tag;
+		})
+	};
+
+	assert(it != end(link.queue));
+	assert(link.peer);
+	link.peer->handle_tag_done(link, tag);
+	link.queue.erase(it);
+	return 0;
+}
+catch(const std::exception &e)
+{
+	return NGHTTP2_ERR_CALLBACK_FAILURE;
+}
+
+/// Data provider for a stream's request content.
+ssize_t
+ircd::server::link::http2::read_content(nghttp2_session *const session,
+                                        const int32_t stream_id,
+                                        uint8_t *const buf,
+                                        const size_t length,
+                                        uint32_t *const data_flags,
+                                        nghttp2_data_source *const source,
+                                        void *const user_data)
+noexcept
+{
+	auto &h2(*static_cast<http2 *>(user_data));
+	auto *const stream(h2.find(stream_id));
+	if(!stream || !stream->tag->request)
+		return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+
+	auto &tag(*stream->tag);
+	const const_buffer content
+	{
+		tag.make_write_content_buffer()
+	};
+
+	const const_buffer piece
+	{
+		data(content), std::min(size(content), length)
+	};
+
+	memcpy(buf, data(piece), size(piece));
+	tag.wrote_buffer(piece);
+	if(!tag.write_remaining())
+		*data_flags |= NGHTTP2_DATA_FLAG_EOF;
+
+	return size(piece);
+}
+
+void
+ircd::server::link::h2_open()
+{
+	h2 = std::make_unique<http2>(*this);
+	log.debug("peer(%p) link(%p) negotiated HTTP/2 with %s",
+	          peer,
+	          this,
+	          likely(peer)? string(peer->remote) : std::string{});
+
+	wait_readable();
+	h2_flush();
+}
+
+/// Translates the HTTP/1.1 request head the user composed into a stream.
+bool
+ircd::server::link::h2_submit(tag &tag)
+{
+	assert(tag.request);
+	const auto &req(*tag.request);
+	const string_view head
+	{
+		data(req.out.head), size(req.out.head)
+	};
+
+	const auto request_line
+	{
+		split(head, "\r\n"_sv)
+	};
+
+	const string_view method(token(request_line.first, ' ', 0));
+	const string_view path(token(request_line.first, ' ', 1));
+
+	std::deque<std::string> names;
+	std::vector<nghttp2_nv> nv;
+	nv.reserve(32);
+	const auto add{[&nv](const string_view &name, const string_view &value)
+	{
+		nv.emplace_back(nghttp2_nv
+		{
+			(uint8_t *)data(name), (uint8_t *)data(value), size(name), size(value), NGHTTP2_NV_FLAG_NONE
+		});
+	}};
+
+	string_view authority;
+	tokens(request_line.second, "\r\n", [&authority](const string_view &line)
+	{
+		const auto header(split(line, ':'));
+		if(iequals(header.first, "host"_sv))
+			authority = strip(header.second);
+	});
+
+	add(":method", method);
+	add(":scheme", "https");
+	add(":authority", authority);
+	add(":path", path);
+	tokens(request_line.second, "\r\n", [&names, &add](const string_view &line)
+	{
+		const auto header(split(line, ':'));
+		const string_view &name(header.first);
+		if(empty(name))
+			return;
+
+		// Connection-specific headers are prohibited in HTTP/2.
+		if(iequals(name, "host"_sv) ||
+		   iequals(name, "connection"_sv) ||
+		   iequals(name, "keep-alive"_sv) ||
+		   iequals(name, "proxy-connection"_sv) ||
+		   iequals(name, "transfer-encoding"_sv) ||
+		   iequals(name, "upgrade"_sv) ||
+		   iequals(name, "te"_sv))
+			return;
+
+		names.emplace_back(name);
+		std::transform(begin(names.back()), end(names.back()), begin(names.back()), ::tolower);
+		add(names.back(), strip(header.second));
+	});
+
+	nghttp2_priority_spec pri;
+	nghttp2_priority_spec_init(&pri, 0, std::clamp(16 - int(req.opt->priority), 1, 256), 0);
+
+	nghttp2_data_provider provider;
+	provider.source.ptr = &tag;
+	provider.read_callback = http2::read_content;
+
+	const int32_t id
+	{
+		nghttp2_submit_request(h2->session, &pri, nv.data(), nv.size(), size(req.out.content)? &provider : nullptr, nullptr)
+	};
+
+	if(unlikely(id < 0))
+		throw error
+		{
+			"HTTP/2 submit request :%s", nghttp2_strerror(id)
+		};
+
+	h2->streams[id].tag = &tag;
+	tag.wrote_buffer(req.out.head);
+	return true;
+}
+
+/// Writes as much of the session's output as the socket will take. When the
+/// socket would block the rest is kept for the next writable event.
+void
+ircd::server::link::h2_flush()
+{
+	assert(h2);
+	while(1)
+	{
+		if(h2->out_pos >= size(h2->out))
+		{
+			const uint8_t *buf;
+			const ssize_t len
+			{
+				nghttp2_session_mem_send(h2->session, &buf)
+			};
+
+			if(unlikely(len < 0))
+				throw error
+				{
+					"HTTP/2 send :%s", nghttp2_strerror(len)
+				};
+
+			h2->out.assign(reinterpret_cast<const char *>(buf), len);
+			h2->out_pos = 0;
+			if(!len)
+				break;
+		}
+
+		const const_buffer pending
+		{
+			data(h2->out) + h2->out_pos, size(h2->out) - h2->out_pos
+		};
+
+		const const_buffer written
+		{
+			process_write_next(pending)
+		};
+
+		h2->out_pos += size(written);
+		if(size(written) < size(pending))
+		{
+			wait_writable();
+			return;
+		}
+	}
+
+	if(!nghttp2_session_want_read(h2->session) && !nghttp2_session_want_write(h2->session))
+		close();
+}
+
+void
+ircd::server::link::h2_handle_writable()
+{
+	assert(h2);
+	auto it(begin(queue));
+	while(it != end(queue))
+	{
+		auto &tag{*it};
+		if((tag.abandoned() || tag.canceled()) && !tag.committed())
+		{
+			it = queue.erase(it);
+			continue;
+		}
+
+		// A canceled stream is reset rather than served to completion; the
+		// tag is removed when the stream closes.
+		if(tag.canceled() && tag.committed())
+		{
+			for(const auto &p : h2->streams)
+				if(p.second.tag == &tag && !p.second.done)
+					nghttp2_submit_rst_stream(h2->session, NGHTTP2_FLAG_NONE, p.first, NGHTTP2_CANCEL);
+
+			++it;
+			continue;
+		}
+
+		if(!tag.committed() && tag_committed() < tag_commit_max())
+			h2_submit(tag);
+
+		++it;
+	}
+
+	h2_flush();
+}
+
+void
+ircd::server::link::h2_handle_readable()
+{
+	assert(h2);
+	thread_local char buf[64_KiB];
+	while(1) try
+	{
+		const const_buffer received
+		{
+			read(buf)
+		};
+
+		const ssize_t ret
+		{
+			nghttp2_session_mem_recv(h2->session, reinterpret_cast<const uint8_t *>(data(received)), size(received))
+		};
+
+		if(unlikely(ret < 0))
+			throw error
+			{
+				"HTTP/2 receive :%s", nghttp2_strerror(ret)
+			};
+	}
+	catch(const boost::system::system_error &e)
+	{
+		using namespace boost::system::errc;
+
+		if(e.code().value() != resource_unavailable_try_again)
+			throw;
+
+		break;
+	}
+
+	// Acknowledgements and window updates for what was just received, as
+	// well as any requests for streams which have freed up.
+	h2_handle_writable();
+	if(op_fini)
+		return;
+
+	if(queue.empty())
+	{
+		assert(peer);
+		peer->handle_link_done(*this);
+		return;
+	}
+
+	wait_readable();
+}
+
+#else // !HAVE_LIBNGHTTP2
+
+struct ircd::server::link::http2
+{
+};
+
+void
+ircd::server::link::h2_open()
+{
+	assert(0);
+}
+
+bool
+ircd::server::link::h2_submit(tag &tag)
+{
+	assert(0);
+	return false;
+}
+
+void
+ircd::server::link::h2_flush()
+{
+}
+
+void
+ircd::server::link::h2_handle_writable()
+{
+	assert(0);
+}
+
+void
+ircd::server::link::h2_handle_readable()
+{
+	assert(0);
+}
+
+#endif
+
 //
 // link
 //
@@ -1148,6 +1978,7 @@ ircd::server::link::tag_commit_max_default
 
 ircd::server::link::link(server::peer &peer)
 :peer{&peer}
+,idle_since{now<steady_point>()}
 {
 }
 
@@ -1253,6 +2084,13 @@ ircd::server::link::handle_open(std::exception_ptr eptr)
 {
 	assert(op_init);
 	op_init = false;
+	idle_since = now<steady_point>();
+
+	if(!eptr && peer && peer->open_opts.handshake)
+		peer->handshakes(*socket);
+
+	if(!eptr && !op_fini && net::alpn(*socket) == "h2")
+		h2_open();
 
 	if(!eptr && !op_fini)
 		wait_writable();
@@ -1368,6 +2206,9 @@ catch(const std::exception &e)
 void
 ircd::server::link::handle_writable_success()
 {
+	if(h2)
+		return h2_handle_writable();
+
 	auto it(begin(queue));
 	while(it != end(queue))
 	{
@@ -1531,6 +2372,9 @@ catch(const std::exception &e)
 void
 ircd::server::link::handle_readable_success()
 {
+	if(h2)
+		return h2_handle_readable();
+
 	if(queue.empty())
 	{
 		discard_read();
@@ -1854,6 +2698,11 @@ size_t
 ircd::server::link::tag_commit_max()
 const
 {
+	#ifdef HAVE_LIBNGHTTP2
+	if(h2)
+		return std::min(size_t(http2_streams_max), size_t(nghttp2_session_get_remote_settings(h2->session, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS)));
+	#endif
+
 	return tag_commit_max_default;
 }
 
@@ -1864,6 +2713,26 @@ const
 	return tag_max_default;
 }
 
+/// The time a request submitted now would be expected to take: the link's
+/// average completion time (or fallback without history) for each request
+/// ahead of it and itself. Streams on an HTTP/2 link proceed concurrently.
+ircd::microseconds
+ircd::server::link::expected(const microseconds &fallback)
+const
+{
+	const auto &avg
+	{
+		rtt.count()? rtt : fallback
+	};
+
+	const size_t concurrent
+	{
+		h2? std::max(tag_commit_max(), size_t(1)) : size_t(1)
+	};
+
+	return avg * ((tag_count() + concurrent) / concurrent);
+}
+
 template<class F>
 size_t
 ircd::server::link::accumulate_tags(F&& closure)
@@ -2102,6 +2971,9 @@ ircd::server::tag::wrote_buffer(const const_buffer &buffer)
 {
 	assert(request);
 	const auto &req{*request};
+	if(!state.written)
+		state.started = now<steady_point>();
+
 	state.written += size(buffer);
 
 	if(state.written <= size(req.out.head))
@@ -2313,6 +3185,7 @@ ircd::server::tag::read_head(const const_buffer &buffer,
 	assert(pb.completed() == head_read);
 	state.status = http::status(head.status);
 	state.content_length = head.content_length;
+	state.head_recv = now<steady_point>();
 
 	// Proffer the HTTP head to the peer instance which owns the link working
 	// this tag so it can learn from any header data.
@@ -2458,9 +3331,19 @@ ircd::server::tag::read_content(const const_buffer &buffer,
 	assert(state.content_read <= state.content_length);
 
 	// Invoke the user's optional progress callback; this function
-	// should be marked noexcept for the time being.
+	// should be marked noexcept for the time being. When the content buffer
+	// is a window the view ends at the latest data in the window.
+	const size_t viewable
+	{
+		state.content_read <= size(content)?
+			state.content_read:
+		req.opt->content_window?
+			(state.content_read - 1) % size(content) + 1:
+			size(content)
+	};
+
 	if(req.in.progress)
-		req.in.progress(buffer, const_buffer{data(content), state.content_read});
+		req.in.progress(buffer, const_buffer{data(content), viewable});
 
 	if(state.content_read == size(content) + content_overflow())
 	{
@@ -2903,6 +3786,9 @@ const
 	if(state.chunk_length)
 		return make_read_chunk_content_buffer();
 
+	if(state.content_read >= size(request->in.content) && request->opt->content_window)
+		return make_read_window_buffer();
+
 	if(state.content_read >= size(request->in.content))
 		return make_read_discard_buffer();
 
@@ -3155,6 +4041,35 @@ const
 	};
 }
 
+/// The content buffer is reused from its start after it has been filled
+/// when the user requested a content window. The buffer returned never wraps
+/// and is never larger than the content remaining.
+ircd::mutable_buffer
+ircd::server::tag::make_read_window_buffer()
+const
+{
+	assert(request);
+	assert(request->opt->content_window);
+	const auto &content{request->in.content};
+	if(unlikely(empty(content)))
+		throw buffer_overrun
+		{
+			"Content window buffer required to read %zu bytes of content",
+			state.content_length
+		};
+
+	const size_t pos
+	{
+		state.content_read % size(content)
+	};
+
+	assert(content_remaining() > 0);
+	return
+	{
+		data(content) + pos, std::min(size(content) - pos, content_remaining())
+	};
+}
+
 size_t
 ircd::server::tag::content_remaining()
 const
@@ -0,0 +1,121 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2018 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#ifdef HAVE_LIBZ
+#include <RB_INC_ZLIB_H
+#endif
+
+#ifdef HAVE_LIBBROTLIENC
+#include <RB_INC_BROTLI_ENCODE_H
+#endif
+
+decltype(ircd::zip::has_gzip)
+ircd::zip::has_gzip
+{
+	#ifdef HAVE_LIBZ
+		true
+	#else
+		false
+	#endif
+};
+
+decltype(ircd::zip::has_brotli)
+ircd::zip::has_brotli
+{
+	#ifdef HAVE_LIBBROTLIENC
+		true
+	#else
+		false
+	#endif
+};
+
+#ifdef HAVE_LIBZ
+ircd::const_buffer
+ircd::zip::gzip(const mutable_buffer &out,
+                const const_buffer &in,
+                const int &level)
+{
+	::z_stream strm {0};
+	strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data(in)));
+	strm.avail_in = size(in);
+	strm.next_out = reinterpret_cast<Bytef *>(data(out));
+	strm.avail_out = size(out);
+
+	// Window bits of 15 + 16 selects the gzip wrapper rather than zlib's.
+	static const int window_bits{15 + 16}, mem_level{9};
+	if(unlikely(::deflateInit2(&strm, level, Z_DEFLATED, window_bits, mem_level, Z_DEFAULT_STRATEGY) != Z_OK))
+		throw error
+		{
+			"deflateInit2() :%s", strm.msg?: "failed"
+		};
+
+	const int ret
+	{
+		::deflate(&strm, Z_FINISH)
+	};
+
+	::deflateEnd(&strm);
+	if(ret != Z_STREAM_END)
+		return {};
+
+	return
+	{
+		data(out), size(out) - strm.avail_out
+	};
+}
+#else
+ircd::const_buffer
+ircd::zip::gzip(const mutable_buffer &out,
+                const const_buffer &in,
+                const int &level)
+{
+	return {};
+}
+#endif
+
+#ifdef HAVE_LIBBROTLIENC
+ircd::const_buffer
+ircd::zip::brotli(const mutable_buffer &out,
+                  const const_buffer &in,
+                  const int &quality)
+{
+	size_t len
+	{
+		size(out)
+	};
+
+	const auto ret
+	{
+		::BrotliEncoderCompress(quality,
+		                        BROTLI_DEFAULT_WINDOW,
+		                        BROTLI_DEFAULT_MODE,
+		                        size(in),
+		                        reinterpret_cast<const uint8_t *>(data(in)),
+		                        &len,
+		                        reinterpret_cast<uint8_t *>(data(out)))
+	};
+
+	if(ret != BROTLI_TRUE)
+		return {};
+
+	return
+	{
+		data(out), len
+	};
+}
+#else
+ircd::const_buffer
+ircd::zip::brotli(const mutable_buffer &out,
+                  const const_buffer &in,
+                  const int &quality)
+{
+	return {};
+}
+#endif
@@ -356,5 +356,6 @@ my_presence_changed
 	{
 		{ "_site",  "vm.notify"      },
 		{ "type",   "ircd.presence"  },
+		{ "_defer", true             },
 	}
 };
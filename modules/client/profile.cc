@@ -396,5 +396,6 @@ my_profile_changed
 	{
 		{ "_site",  "vm.notify"     },
 		{ "type",   "ircd.profile"  },
+		{ "_defer", true            },
 	}
 };
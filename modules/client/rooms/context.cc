@@ -49,6 +49,22 @@ get__context(client &client,
 		return std::min(ret, size_t(limit_max));
 	}()};
 
+	// 11.20.1.1 A RoomEventFilter to filter returned events with.
+	const auto &filter_query
+	{
+		request.query["filter"]
+	};
+
+	const unique_buffer<mutable_buffer> filter_buf
+	{
+		size(filter_query)
+	};
+
+	const m::filter_matcher filter
+	{
+		json::object{url::decode(filter_query, filter_buf)}
+	};
+
 	const m::room room
 	{
 		room_id, event_id
@@ -97,6 +113,7 @@ get__context(client &client,
 		ret, "event", event
 	};
 
+	m::visibility visibility{request.user_id};
 	m::event::id::buf start{event_id};
 	{
 		json::stack::member member{ret, "events_before"};
@@ -105,14 +122,23 @@ get__context(client &client,
 		if(before)
 			--before;
 
-		for(size_t i(0); i < limit && before; --before, ++i)
+		for(size_t i(0), miss(0); i < limit && before; --before)
 		{
 			const m::event &event{*before};
-			if(!visible(event, request.user_id))
+			if(!visibility(event, before.state_root()))
 				break;
 
 			start = at<"event_id"_>(event);
+			if(!filter(event))
+			{
+				if(++miss >= size_t(max_filter_miss))
+					break;
+
+				continue;
+			}
+
 			array.append(event);
+			++i;
 		}
 	}
 
@@ -129,14 +155,23 @@ get__context(client &client,
 		if(after)
 			++after;
 
-		for(size_t i(0); i < limit && after; ++after, ++i)
+		for(size_t i(0), miss(0); i < limit && after; ++after)
 		{
 			const m::event &event{*after};
-			if(!visible(event, request.user_id))
+			if(!visibility(event, after.state_root()))
 				break;
 
 			end = at<"event_id"_>(event);
+			if(!filter(event))
+			{
+				if(++miss >= size_t(max_filter_miss))
+					break;
+
+				continue;
+			}
+
 			array.append(event);
+			++i;
 		}
 	}
 
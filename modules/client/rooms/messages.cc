@@ -73,13 +73,21 @@ get__messages(client &client,
 		url::decode(filter_query, filter_buf)
 	};
 
-	const m::room_event_filter filter
+	const m::filter_matcher filter
 	{
 		filter_json.has("filter_json")?
 			json::object{filter_json.get("filter_json")}:
 			filter_json
 	};
 
+	// The filter's own limit can only narrow the request's.
+	const size_t limit
+	{
+		filter.limit > 0?
+			std::min(size_t(page.limit), size_t(filter.limit)):
+			size_t(page.limit)
+	};
+
 	const m::room room
 	{
 		room_id, page.from
@@ -125,6 +133,7 @@ get__messages(client &client,
 		++it;
 
 	size_t hit{0}, miss{0};
+	m::visibility visibility{request.user_id};
 	m::event::id::buf start, end;
 	{
 		json::stack::member chunk{ret, "chunk"};
@@ -132,7 +141,7 @@ get__messages(client &client,
 		for(; it; page.dir == 'b'? --it : ++it)
 		{
 			const m::event &event{*it};
-			if(!visible(event, request.user_id))
+			if(!visibility(event, it.state_root()))
 				break;
 
 			if(page.to && at<"event_id"_>(event) == page.to)
@@ -143,14 +152,14 @@ get__messages(client &client,
 				break;
 			}
 
-			if(empty(filter_json) || match(filter, event))
+			if(filter(event))
 			{
 				messages.append(event);
 				++hit;
 			}
 			else ++miss;
 
-			if(hit >= page.limit || miss >= size_t(max_filter_miss))
+			if(hit >= limit || miss >= size_t(max_filter_miss))
 			{
 				if(page.dir == 'b')
 					end = at<"event_id"_>(event);
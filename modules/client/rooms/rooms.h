@@ -15,6 +15,8 @@ extern ircd::resource rooms_resource;
 // messages.cc
 //
 
+extern ircd::conf::item<size_t> max_filter_miss;
+
 ircd::resource::response
 get__messages(ircd::client &,
               const ircd::resource::request &,
@@ -96,6 +96,13 @@ sync_flush_hiwat
 	{ "default",  long(24_KiB)                   },
 };
 
+conf::item<size_t>
+sync_max_filter_miss
+{
+	{ "name",     "ircd.client.sync.max_filter_miss" },
+	{ "default",  2048L                              },
+};
+
 syncargs::syncargs(const resource::request &request)
 :filter_id
 {
@@ -225,9 +232,23 @@ linear_sync(client &client,
 			json::get<"room_id"_>(event)
 		};
 
+		if(!sp.filter->room(room.room_id))
+			return true;
+
 		if(!room.membership(request.user_id))
 			return true;
 
+		// Everything here is delivered in the timeline, state events too.
+		const auto &matcher
+		{
+			empty(string_view{json::get<"prev_events"_>(event)})?
+				sp.filter->ephemeral:
+				sp.filter->timeline
+		};
+
+		if(!matcher(event))
+			return true;
+
 		auto it
 		{
 			r.lower_bound(room.room_id)
@@ -788,6 +809,9 @@ polylog_sync_rooms__membership(shortpoll &sp,
 		if(head_idx(std::nothrow, room) <= sp.since)
 			return;
 
+		if(!sp.filter->room(room.room_id))
+			return;
+
 		const m::room::id &room_id{room.room_id};
 		json::stack::member member{object, room_id};
 		json::stack::object object{member};
@@ -922,6 +946,9 @@ polylog_sync_room_state(shortpoll &sp,
 		if(event_idx < sp.since || event_idx >= sp.current)
 			return;
 
+		if(!sp.filter->state(event))
+			return;
+
 		array.append(event);
 		sp.committed = true;
 	});
@@ -988,20 +1015,35 @@ polylog_sync_room_timeline_events(shortpoll &sp,
 		},
 	};
 
+	const auto &filter
+	{
+		sp.filter->timeline
+	};
+
+	const ssize_t limit
+	{
+		filter.limit > 0? std::min(filter.limit, 10L) : 10L
+	};
+
 	// messages seeks to the newest event, but the client wants the oldest
 	// event first so we seek down first and then iterate back up. Due to
 	// an issue with rocksdb's prefix-iteration this iterator becomes
 	// toxic as soon as it becomes invalid. As a result we have to copy the
 	// event_id on the way down in case of renewing the iterator for the
 	// way back. This is not a big deal but rocksdb should fix their shit.
-	ssize_t i(0);
+	// Only events passing the filter count toward the limit; n counts all
+	// of the events walked so the way back up retraces the same window.
+	// Like /messages the walk gives up after too many events are filtered
+	// out, and the timeline is then limited.
+	ssize_t i(0), n(0);
+	size_t miss(0);
 	m::event::id::buf event_id;
 	m::room::messages it
 	{
 		room, &fopts
 	};
 
-	for(; it && i < 10; --it, ++i)
+	for(; it && i < limit; --it, ++n)
 	{
 		event_id = it.event_id();
 		if(it.event_idx() < sp.since)
@@ -1009,23 +1051,29 @@ polylog_sync_room_timeline_events(shortpoll &sp,
 
 		if(it.event_idx() >= sp.current)
 			break;
+
+		if(filter(*it))
+			++i;
+		else if(++miss >= size_t(sync_max_filter_miss))
+			break;
 	}
 
-	limited = i >= 10;
+	limited = i >= limit || miss >= size_t(sync_max_filter_miss);
 	sp.committed |= i > 0;
 
-	if(i > 0 && !it)
+	if(n > 0 && !it)
 		it.seek(event_id);
 
-	if(i > 0 && it)
+	if(n > 0 && it)
 	{
 		const m::event &event{*it};
 		sp.state_at = at<"depth"_>(event);
 	}
 
 	if(i > 0)
-		for(; it && i > -1; ++it, --i)
-			out.append(*it);
+		for(; it && n > -1; ++it, --n)
+			if(filter(*it))
+				out.append(*it);
 
 	return event_id;
 }
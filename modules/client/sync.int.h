@@ -58,16 +58,9 @@ struct shortpoll
 		request.user_id
 	};
 
-	const std::string filter_buf
+	const std::shared_ptr<const m::filter::compiled> filter
 	{
-		args.filter_id?
-			user.filter(std::nothrow, args.filter_id):
-			std::string{}
-	};
-
-	const m::filter filter
-	{
-		json::object{filter_buf}
+		m::filter::compiled::get(user, args.filter_id)
 	};
 
 	const m::user::room user_room
@@ -547,6 +547,38 @@ console_cmd__log__mark(opt &out, const string_view &line)
 	return true;
 }
 
+bool
+console_cmd__log__writer(opt &out, const string_view &line)
+{
+	const auto &stats
+	{
+		log::writer::stats
+	};
+
+	out << "running:        " << (log::writer::running()? "yes" : "no") << std::endl
+	    << "ring size:      " << stats.ring_size << std::endl
+	    << "ring used:      " << stats.ring_used << std::endl
+	    << "queued:         " << stats.queued << std::endl
+	    << "written:        " << stats.written << std::endl
+	    << "bytes:          " << stats.bytes << std::endl
+	    << "batches:        " << stats.batches << std::endl
+	    << "synced:         " << stats.synced << std::endl
+	    << "dropped:        " << stats.dropped << std::endl
+	    << "dropped bytes:  " << stats.dropped_bytes << std::endl
+	    << "errors:         " << stats.errors << std::endl
+	    ;
+
+	out << "synchronous:   ";
+	for_each<log::facility>([&out](const log::facility &fac)
+	{
+		if(log::writer::sync[fac])
+			out << " " << reflect(fac);
+	});
+
+	out << std::endl;
+	return true;
+}
+
 bool
 console_cmd__mark(opt &out, const string_view &line)
 {
@@ -720,6 +752,7 @@ console_cmd__hook__list(opt &out, const string_view &line)
 
 		for(const auto &hookp : site->hooks)
 			out << (hookp->registered? '+' : '-')
+			    << (hookp->defer? '*' : ' ')
 			    << " " << string_view{hookp->feature}
 			    << std::endl;
 
@@ -729,6 +762,34 @@ console_cmd__hook__list(opt &out, const string_view &line)
 	return true;
 }
 
+bool
+console_cmd__hook__defer(opt &out, const string_view &line)
+{
+	using m::hook::defer;
+
+	out << "pool:     " << defer::pool.size()
+	    << " (" << defer::pool.active() << " active)" << std::endl
+	    << "queued:   " << defer::queued << std::endl
+	    << "peak:     " << defer::peak << std::endl
+	    << "total:    " << defer::total << std::endl
+	    << std::endl;
+
+	for(const auto &hookp : m::hook::base::list)
+	{
+		if(!hookp->defer)
+			continue;
+
+		const auto &d(*hookp->defer);
+		out << std::setw(8) << std::right << d.queue.size() << " queued "
+		    << std::setw(10) << std::right << d.calls << " calls "
+		    << (d.running? "RUN " : "    ")
+		    << string_view{hookp->feature}
+		    << std::endl;
+	}
+
+	return true;
+}
+
 bool
 console_cmd__hook(opt &out, const string_view &line)
 {
@@ -917,6 +978,8 @@ console_cmd__ctx__list(opt &out, const string_view &line)
 	    << "LIMIT"
 	    << "     "
 	    << "PCT"
+	    << "    "
+	    << "COMMIT"
 	    << "   "
 	    << ":NAME"
 	    << std::endl;
@@ -970,12 +1033,478 @@ console_cmd__ctx__list(opt &out, const string_view &line)
 		    << std::setw(5) << std::right << std::fixed << std::setprecision(2) << (stack_pct * 100)
 		    << "% ";
 
+		out << "  "
+		    << std::setw(8) << std::right << stack_committed(ctx)
+		    << " ";
+
 		out << "  :"
 		    << name(ctx);
 
 		out << std::endl;
 	}
 
+	const auto &stacks
+	{
+		ctx::stacks::stats
+	};
+
+	out << std::endl
+	    << "stacks mapped: " << stacks.mapped
+	    << " active: " << stacks.active
+	    << " idle: " << stacks.idle
+	    << " reserved: " << stacks.reserved
+	    << " committed: " << ctx::stacks::committed()
+	    << " allocs: " << stacks.allocs
+	    << " reuses: " << stacks.reuses
+	    << " advised: " << stacks.advised
+	    << std::endl;
+
+	return true;
+}
+
+bool
+console_cmd__ctx__stacks__trim(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"keep"
+	}};
+
+	const size_t keep
+	{
+		param.at(0, 0UL)
+	};
+
+	const size_t unmapped
+	{
+		ctx::stacks::trim(keep)
+	};
+
+	out << "Unmapped " << unmapped << " idle stacks; "
+	    << ctx::stacks::stats.reserved << " bytes reserved."
+	    << std::endl;
+
+	return true;
+}
+
+static void
+ctx_bench_report(opt &out,
+                 const string_view &name,
+                 const size_t &switches,
+                 const util::timer &timer)
+{
+	const auto us
+	{
+		timer.get<microseconds>().count()
+	};
+
+	const long double rate
+	{
+		us > 0? switches / (us / 1000000.0L) : 0.0L
+	};
+
+	out << std::setw(10) << std::left << name
+	    << " " << std::setw(8) << std::right << switches << " switches in "
+	    << std::setw(9) << std::right << us << " us; "
+	    << std::setw(12) << std::right << std::fixed << std::setprecision(0) << rate
+	    << " switches/sec"
+	    << std::endl;
+}
+
+/// Runs `func` once with the timer-based scheduler and once with the ready
+/// queue so the two can be compared in the same process.
+static void
+ctx_bench_compare(opt &out,
+                  const std::function<size_t (util::timer &)> &func)
+{
+	thread_local char buf[16];
+	const std::string original
+	{
+		conf::get("ircd.ctx.sched.direct", buf)
+	};
+
+	const unwind restore{[&original]
+	{
+		conf::set("ircd.ctx.sched.direct", original);
+	}};
+
+	for(const auto &mode : {"false"_sv, "true"_sv})
+	{
+		conf::set("ircd.ctx.sched.direct", mode);
+		util::timer timer;
+		const size_t switches
+		{
+			func(timer)
+		};
+
+		timer.stop();
+		ctx_bench_report(out, mode == "true"? "ready" : "alarm", switches, timer);
+	}
+}
+
+bool
+console_cmd__ctx__bench__pingpong(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"count"
+	}};
+
+	const size_t count
+	{
+		param.at(0, 100000UL)
+	};
+
+	ctx_bench_compare(out, [&count](util::timer &timer)
+	{
+		ctx::dock dock;
+		size_t n(0);
+		bool turn(false);
+		const auto player{[&](const bool &me)
+		{
+			while(n < count)
+			{
+				dock.wait([&]
+				{
+					return turn == me || n >= count;
+				});
+
+				++n;
+				turn = !me;
+				dock.notify_all();
+			}
+		}};
+
+		timer = util::timer{};
+		context ping
+		{
+			"bench.ping", 64_KiB, std::bind(player, false)
+		};
+
+		context pong
+		{
+			"bench.pong", 64_KiB, std::bind(player, true)
+		};
+
+		ping.join();
+		pong.join();
+		return n;
+	});
+
+	return true;
+}
+
+bool
+console_cmd__ctx__bench__fanout(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"waiters", "rounds"
+	}};
+
+	const size_t waiters
+	{
+		param.at(0, 64UL)
+	};
+
+	const size_t rounds
+	{
+		param.at(1, 1000UL)
+	};
+
+	ctx_bench_compare(out, [&waiters, &rounds](util::timer &timer)
+	{
+		ctx::dock dock;
+		size_t round(0), seen(0), switches(0);
+		const auto waiter{[&]
+		{
+			for(size_t r(1); r <= rounds; ++r)
+			{
+				dock.wait([&]
+				{
+					return round >= r;
+				});
+
+				++switches;
+				if(++seen == waiters)
+					dock.notify_all();
+			}
+		}};
+
+		std::vector<context> ctxs;
+		ctxs.reserve(waiters);
+		timer = util::timer{};
+		for(size_t i(0); i < waiters; ++i)
+			ctxs.emplace_back("bench.fanout", 64_KiB, waiter);
+
+		for(size_t r(1); r <= rounds; ++r)
+		{
+			seen = 0;
+			round = r;
+			dock.notify_all();
+			dock.wait([&]
+			{
+				return seen >= waiters;
+			});
+
+			++switches;
+		}
+
+		for(auto &ctx : ctxs)
+			ctx.join();
+
+		return switches;
+	});
+
+	return true;
+}
+
+static uint64_t
+ctx_prof_key(const ctx::prof::stats &s,
+             const string_view &by)
+{
+	using ctx::prof::reason;
+
+	if(by == "max")
+		return s.slice_max;
+
+	if(by == "yields")
+		return std::accumulate(begin(s.yields), end(s.yields), uint64_t(0));
+
+	if(by == "io")
+		return s.waited.at(size_t(reason::IO));
+
+	if(by == "lock")
+		return s.waited.at(size_t(reason::LOCK));
+
+	if(by == "sleep")
+		return s.waited.at(size_t(reason::SLEEP));
+
+	if(by == "queue")
+		return s.queued;
+
+	if(by == "work")
+		return s.worked;
+
+	return s.cycles;
+}
+
+/// Top offenders by context name; sorted by cycles executed unless another
+/// key is given: max, yields, io, lock, sleep, queue, work
+bool
+console_cmd__ctx__prof(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"count", "by"
+	}};
+
+	const size_t count
+	{
+		param.at(0, 20UL)
+	};
+
+	const string_view by
+	{
+		!empty(param[1])? param[1] : "cycles"_sv
+	};
+
+	std::vector<std::pair<string_view, const ctx::prof::stats *>> top;
+	ctx::prof::for_each([&top](const string_view &name, const ctx::prof::stats &s)
+	{
+		top.emplace_back(name, &s);
+		return true;
+	});
+
+	std::sort(begin(top), end(top), [&by](const auto &a, const auto &b)
+	{
+		return ctx_prof_key(*a.second, by) > ctx_prof_key(*b.second, by);
+	});
+
+	out << std::setw(7) << std::right << "CTXS"
+	    << " " << std::setw(10) << std::right << "SLICES"
+	    << " " << std::setw(16) << std::right << "CYCLES"
+	    << " " << std::setw(7) << std::right << "PCT"
+	    << " " << std::setw(13) << std::right << "MAX"
+	    << " " << std::setw(10) << std::right << "YIELDS"
+	    << " " << std::setw(16) << std::right << "IO WAIT"
+	    << " " << std::setw(16) << std::right << "LOCK WAIT"
+	    << " " << std::setw(16) << std::right << "SLEEP WAIT"
+	    << " " << std::setw(8) << std::right << "JOBS"
+	    << " " << std::setw(13) << std::right << "QUEUE AVG"
+	    << " " << std::setw(13) << std::right << "WORK AVG"
+	    << "   :NAME"
+	    << std::endl;
+
+	const long double total_cyc(ctx::prof::total_slice_cycles());
+	for(size_t i(0); i < top.size() && i < count; ++i)
+	{
+		using ctx::prof::reason;
+
+		const auto &name(top[i].first);
+		const auto &s(*top[i].second);
+		const auto pct
+		{
+			total_cyc > 0.0? (s.cycles / total_cyc) : 0.0L
+		};
+
+		out << std::setw(7) << std::right << s.contexts
+		    << " " << std::setw(10) << std::right << s.slices
+		    << " " << std::setw(16) << std::right << s.cycles
+		    << " " << std::setw(6) << std::right << std::fixed << std::setprecision(2) << (pct * 100) << "%"
+		    << " " << std::setw(13) << std::right << s.slice_max
+		    << " " << std::setw(10) << std::right << ctx_prof_key(s, "yields")
+		    << " " << std::setw(16) << std::right << s.waited.at(size_t(reason::IO))
+		    << " " << std::setw(16) << std::right << s.waited.at(size_t(reason::LOCK))
+		    << " " << std::setw(16) << std::right << s.waited.at(size_t(reason::SLEEP))
+		    << " " << std::setw(8) << std::right << s.jobs
+		    << " " << std::setw(13) << std::right << (s.jobs? s.queued / s.jobs : 0UL)
+		    << " " << std::setw(13) << std::right << (s.jobs? s.worked / s.jobs : 0UL)
+		    << "   :" << name
+		    << std::endl;
+	}
+
+	return true;
+}
+
+static void
+ctx_prof_hist(opt &out,
+              const string_view &label,
+              const ctx::prof::stats::histogram &h)
+{
+	const uint64_t total
+	{
+		std::accumulate(begin(h), end(h), uint64_t(0))
+	};
+
+	if(!total)
+		return;
+
+	out << label << ":" << std::endl;
+	for(size_t i(0); i < h.size(); ++i)
+	{
+		if(!h[i])
+			continue;
+
+		out << "  >= 2^" << std::setw(2) << std::left << i
+		    << " " << std::setw(12) << std::right << h[i]
+		    << " " << std::setw(6) << std::right << std::fixed << std::setprecision(2)
+		    << (h[i] * 100.0L / total) << "% "
+		    << std::string(h[i] * 50 / total, '#')
+		    << std::endl;
+	}
+}
+
+/// Histograms (log2 of cycles) for contexts with the given name
+bool
+console_cmd__ctx__prof__hist(opt &out, const string_view &line)
+{
+	const string_view &name
+	{
+		line
+	};
+
+	const auto *const s
+	{
+		ctx::prof::find(name)
+	};
+
+	if(!s)
+	{
+		out << "No profile for contexts named '" << name << "'" << std::endl;
+		return true;
+	}
+
+	for(size_t i(0); i < num_of<ctx::prof::reason>(); ++i)
+		out << std::setw(6) << std::left << reflect(ctx::prof::reason(i))
+		    << " " << std::setw(10) << std::right << s->yields[i] << " yields "
+		    << " " << std::setw(16) << std::right << s->waited[i] << " cycles waited"
+		    << std::endl;
+
+	ctx_prof_hist(out, "slice", s->slice);
+	ctx_prof_hist(out, "queue", s->queue);
+	ctx_prof_hist(out, "work", s->work);
+	return true;
+}
+
+static void
+ctx_prof_json(json::stack::member &m,
+              const ctx::prof::stats::histogram &h)
+{
+	size_t n(h.size());
+	while(n && !h[n - 1])
+		--n;
+
+	json::stack::array a{m};
+	for(size_t i(0); i < n; ++i)
+		a.append(json::value(int64_t(h[i])));
+}
+
+bool
+console_cmd__ctx__prof__json(opt &out, const string_view &line)
+{
+	const unique_buffer<mutable_buffer> buf
+	{
+		2_MiB
+	};
+
+	json::stack st{buf};
+	{
+		json::stack::object top{st};
+		ctx::prof::for_each([&top](const string_view &name, const ctx::prof::stats &s)
+		{
+			json::stack::member m{top, name};
+			json::stack::object o{m};
+			json::stack::member{o, "contexts", json::value(int64_t(s.contexts))};
+			json::stack::member{o, "slices", json::value(int64_t(s.slices))};
+			json::stack::member{o, "cycles", json::value(int64_t(s.cycles))};
+			json::stack::member{o, "slice_max", json::value(int64_t(s.slice_max))};
+			{
+				json::stack::member ym{o, "yields"};
+				json::stack::object y{ym};
+				for(size_t i(0); i < s.yields.size(); ++i)
+					json::stack::member
+					{
+						y, reflect(ctx::prof::reason(i)), json::value(int64_t(s.yields[i]))
+					};
+			}
+			{
+				json::stack::member wm{o, "waited"};
+				json::stack::object w{wm};
+				for(size_t i(0); i < s.waited.size(); ++i)
+					json::stack::member
+					{
+						w, reflect(ctx::prof::reason(i)), json::value(int64_t(s.waited[i]))
+					};
+			}
+			json::stack::member{o, "jobs", json::value(int64_t(s.jobs))};
+			json::stack::member{o, "queued", json::value(int64_t(s.queued))};
+			json::stack::member{o, "worked", json::value(int64_t(s.worked))};
+			{
+				json::stack::member hm{o, "slice_hist"};
+				ctx_prof_json(hm, s.slice);
+			}
+			{
+				json::stack::member hm{o, "queue_hist"};
+				ctx_prof_json(hm, s.queue);
+			}
+			{
+				json::stack::member hm{o, "work_hist"};
+				ctx_prof_json(hm, s.work);
+			}
+			return true;
+		});
+	}
+
+	out << st.completed() << std::endl;
+	return true;
+}
+
+bool
+console_cmd__ctx__prof__reset(opt &out, const string_view &line)
+{
+	ctx::prof::reset();
+	out << "Context profile reset." << std::endl;
 	return true;
 }
 
@@ -2226,6 +2755,10 @@ console_cmd__peer(opt &out, const string_view &line)
 		    << " " << setw(9) << right << peer.read_size()      << " DN Q"
 		    << " " << setw(9) << right << peer.write_total()    << " UP"
 		    << " " << setw(9) << right << peer.read_total()     << " DN"
+		    << " " << setw(5) << right << peer.handshakes.full    << " HS"
+		    << " " << setw(5) << right << peer.handshakes.resumed << " HR"
+		    << " " << setw(6) << right << duration_cast<milliseconds>(peer.latency_percentile(50)).count() << " P50"
+		    << " " << setw(6) << right << duration_cast<milliseconds>(peer.latency_percentile(99)).count() << " P99"
 		    ;
 
 		if(peer.err_has() && peer.err_msg())
@@ -2259,6 +2792,17 @@ console_cmd__peer(opt &out, const string_view &line)
 		};
 
 		print(peer.hostname, peer);
+		out << peer.handshakes << std::endl;
+		out << "latency (ms)"
+		    << " ttfb:" << duration_cast<milliseconds>(peer.ttfb).count()
+		    << " rtt:" << duration_cast<milliseconds>(peer.rtt).count()
+		    << " p50:" << duration_cast<milliseconds>(peer.latency_percentile(50)).count()
+		    << " p90:" << duration_cast<milliseconds>(peer.latency_percentile(90)).count()
+		    << " p99:" << duration_cast<milliseconds>(peer.latency_percentile(99)).count()
+		    << " links:" << peer.link_min() << "-" << peer.link_max()
+		    << " concurrency:" << peer.concurrency
+		    << std::endl;
+
 		return true;
 	}
 
@@ -2584,6 +3128,22 @@ console_cmd__net__host__cache__SRV(opt &out, const string_view &line)
 	return true;
 }
 
+bool
+console_cmd__net__host__stats(opt &out, const string_view &line)
+{
+	const auto &stats(net::dns::stats);
+	out << "hits:        " << stats.hits << std::endl
+	    << "misses:      " << stats.misses << std::endl
+	    << "coalesced:   " << stats.coalesced << std::endl
+	    << "prefetched:  " << stats.prefetched << std::endl
+	    << "restored:    " << stats.restored << std::endl
+	    << "cached A:    " << net::dns::cache.A.size() << std::endl
+	    << "cached SRV:  " << net::dns::cache.SRV.size() << std::endl
+	    ;
+
+	return true;
+}
+
 bool
 console_cmd__net__host__prefetch(opt &out, const string_view &line)
 {
@@ -3516,21 +4076,93 @@ console_cmd__events__dump(opt &out, const string_view &line)
 			};
 		}
 
-		return true;
-	});
+		return true;
+	});
+
+	if(pos > data(buf))
+	{
+		const const_buffer cb{data(buf), pos};
+		foff += size(fs::append(file, cb));
+		++acount;
+	}
+
+	out << "Dumped " << ecount << " events"
+	    << " using " << foff << " bytes"
+	    << " in " << acount << " writes"
+	    << " to " << filename
+	    << " with " << errcount << " errors"
+	    << std::endl;
+
+	return true;
+}
+
+bool
+console_cmd__events__export(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"path", "[shards]"
+	}};
+
+	const auto &path
+	{
+		param.at(0)
+	};
+
+	const auto &shards
+	{
+		param.at<size_t>(1, 0)
+	};
+
+	using prototype = size_t (const string_view &, const size_t &);
+	static m::import<prototype> events__export
+	{
+		"m_events", "events__export"
+	};
+
+	const util::timer timer;
+	const size_t count
+	{
+		events__export(path, shards)
+	};
+
+	out << "Exported " << count << " events"
+	    << " to " << path
+	    << " in " << timer.at<milliseconds>().count() << " ms"
+	    << std::endl;
+
+	return true;
+}
 
-	if(pos > data(buf))
+bool
+console_cmd__events__import(opt &out, const string_view &line)
+{
+	using prototype = size_t (const string_view &);
+	static m::import<prototype> events__import
 	{
-		const const_buffer cb{data(buf), pos};
-		foff += size(fs::append(file, cb));
-		++acount;
-	}
+		"m_events", "events__import"
+	};
 
-	out << "Dumped " << ecount << " events"
-	    << " using " << foff << " bytes"
-	    << " in " << acount << " writes"
-	    << " to " << filename
-	    << " with " << errcount << " errors"
+	const util::timer timer;
+	size_t count(0);
+	tokens(line, ' ', [&out, &count]
+	(const string_view &path)
+	{
+		const size_t imported
+		{
+			events__import(path)
+		};
+
+		out << "Imported " << imported << " events"
+		    << " from " << path
+		    << std::endl;
+
+		count += imported;
+	});
+
+	out << "Imported " << count << " events"
+	    << " in " << timer.at<milliseconds>().count() << " ms"
+	    << "; sequence now " << m::vm::current_sequence
 	    << std::endl;
 
 	return true;
@@ -3750,6 +4382,7 @@ console_cmd__event__erase(opt &out, const string_view &line)
 	opts.event_idx = index(event);
 	m::dbs::write(txn, event, opts);
 	txn();
+	m::dbs::committed(event, opts);
 
 	out << "erased " << txn.size() << " cells"
 	    << " for " << event_id << std::endl;
@@ -4176,6 +4809,28 @@ console_cmd__rooms(opt &out, const string_view &line)
 // room
 //
 
+bool
+console_cmd__room__cache(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"[clear]"
+	}};
+
+	if(param[0] == "clear")
+		m::dbs::room_cache_clear();
+
+	const auto stats
+	{
+		m::dbs::room_cache_stats()
+	};
+
+	out << "rooms:  " << stats.first << std::endl
+	    << "bytes:  " << stats.second << std::endl;
+
+	return true;
+}
+
 bool
 console_cmd__room__top(opt &out, const string_view &line)
 {
@@ -4447,6 +5102,80 @@ console_cmd__room__depth(opt &out, const string_view &line)
 	return true;
 }
 
+bool
+console_cmd__room__depth__gaps(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"room_id"
+	}};
+
+	const auto &room_id
+	{
+		m::room_id(param.at(0))
+	};
+
+	const m::room room
+	{
+		room_id
+	};
+
+	int64_t above{-1};
+	m::dbs::room_depth_ranges(room_id, [&out, &room, &above]
+	(const int64_t &lo, const int64_t &hi)
+	{
+		if(above >= 0)
+			out << "GAP " << std::setw(20) << std::right << (hi + 1)
+			    << " to " << (above - 1)
+			    << " (" << (above - hi - 1) << ")"
+			    << " backfill from " << m::room::messages{room, uint64_t(above)}.event_id()
+			    << std::endl;
+
+		out << "RUN " << std::setw(20) << std::right << lo
+		    << " to " << hi
+		    << " (" << (hi - lo + 1) << ")"
+		    << std::endl;
+
+		above = lo;
+		return true;
+	});
+
+	return true;
+}
+
+bool
+console_cmd__room__depth__rebuild(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"room_id"
+	}};
+
+	const auto &room_id
+	{
+		m::room_id(param.at(0))
+	};
+
+	const m::room room
+	{
+		room_id
+	};
+
+	using prototype = size_t (const m::room &);
+	static m::import<prototype> depth__rebuild
+	{
+		"m_room", "depth__rebuild"
+	};
+
+	const size_t runs
+	{
+		depth__rebuild(room)
+	};
+
+	out << "done; " << runs << " runs" << std::endl;
+	return true;
+}
+
 bool
 console_cmd__room__visible(opt &out, const string_view &line)
 {
@@ -4816,6 +5545,34 @@ console_cmd__room__state__force(opt &out, const string_view &line)
 	return true;
 }
 
+static bool
+console_room_job(opt &out,
+                 const m::room::id &room_id,
+                 const string_view &op)
+{
+	using prototype = bool (const m::room::id &, const string_view &);
+	static m::import<prototype> room_job__start
+	{
+		"m_room", "room_job__start"
+	};
+
+	const bool started
+	{
+		room_job__start(room_id, op)
+	};
+
+	if(!started)
+		throw error
+		{
+			"A job is already running for %s", string_view{room_id}
+		};
+
+	out << "started " << op << " of " << room_id
+	    << "; see 'room job' for progress." << std::endl;
+
+	return true;
+}
+
 bool
 console_cmd__room__state__rebuild__present(opt &out, const string_view &line)
 {
@@ -4834,19 +5591,7 @@ console_cmd__room__state__rebuild__present(opt &out, const string_view &line)
 		room_id
 	};
 
-	using prototype = size_t (const m::room &);
-	static m::import<prototype> state__rebuild_present
-	{
-		"m_room", "state__rebuild_present"
-	};
-
-	const size_t count
-	{
-		state__rebuild_present(room)
-	};
-
-	out << "done " << count << std::endl;
-	return true;
+	return console_room_job(out, room.room_id, "rebuild_present");
 }
 
 bool
@@ -4867,19 +5612,7 @@ console_cmd__room__state__rebuild__history(opt &out, const string_view &line)
 		room_id
 	};
 
-	using prototype = size_t (const m::room &);
-	static m::import<prototype> state__rebuild_history
-	{
-		"m_room", "state__rebuild_history"
-	};
-
-	const size_t count
-	{
-		state__rebuild_history(room)
-	};
-
-	out << "done " << count << std::endl;
-	return true;
+	return console_room_job(out, room.room_id, "rebuild_history");
 }
 
 bool
@@ -4910,12 +5643,17 @@ console_cmd__room__count(opt &out, const string_view &line)
 		json::get<"limit"_>(filter)?: -1
 	};
 
+	const m::filter_matcher matcher
+	{
+		filter
+	};
+
 	size_t count{0};
 	m::room::messages it{room};
 	for(; it && limit; --it, --limit)
 	{
 		const m::event &event{*it};
-		count += match(filter, event);
+		count += matcher(event);
 	}
 
 	out << count << std::endl;
@@ -5335,11 +6073,65 @@ console_cmd__room__id(opt &out, const string_view &id)
 bool
 console_cmd__room__purge(opt &out, const string_view &line)
 {
+	const params param{line, " ",
+	{
+		"room_id"
+	}};
+
 	const auto &room_id
 	{
-		m::room_id(token(line, ' ', 0))
+		m::room_id(param.at(0))
+	};
+
+	return console_room_job(out, room_id, "purge");
+}
+
+bool
+console_cmd__room__job(opt &out, const string_view &line)
+{
+	using closure = bool (const string_view &, const string_view &, const size_t &, const bool &);
+	using prototype = void (const std::function<closure> &);
+	static m::import<prototype> room_job__for_each
+	{
+		"m_room", "room_job__for_each"
+	};
+
+	room_job__for_each([&out]
+	(const string_view &room_id, const string_view &op, const size_t &count, const bool &running)
+	{
+		out << std::left << std::setw(16) << op << " "
+		    << std::left << std::setw(10) << (running? "running" : "stopped") << " "
+		    << std::right << std::setw(10) << count << " "
+		    << room_id << std::endl;
+
+		return true;
+	});
+
+	return true;
+}
+
+bool
+console_cmd__room__job__cancel(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"room_id"
+	}};
+
+	const auto &room_id
+	{
+		m::room_id(param.at(0))
 	};
 
+	using prototype = bool (const m::room::id &);
+	static m::import<prototype> room_job__cancel
+	{
+		"m_room", "room_job__cancel"
+	};
+
+	out << (room_job__cancel(room_id)? "cancelled" : "no job for") << " "
+	    << room_id << std::endl;
+
 	return true;
 }
 
@@ -6765,7 +7557,7 @@ console_cmd__fed__state(opt &out, const string_view &line)
 		param[3]
 	};
 
-	if(!op && event_id == "eval")
+	if(!op && (event_id == "eval" || event_id == "verify"))
 		std::swap(op, event_id);
 
 	// Used for out.head, out.content, in.head, but in.content is dynamic
@@ -6796,6 +7588,51 @@ console_cmd__fed__state(opt &out, const string_view &line)
 		response["pdus"]
 	};
 
+	if(op == "verify")
+	{
+		std::vector<m::event> events;
+		events.reserve(size(pdus) + size(auth_chain));
+		for(const json::object &event : auth_chain)
+			events.emplace_back(event);
+
+		for(const json::object &event : pdus)
+			events.emplace_back(event);
+
+		const util::timer prefetch_timer{[&out, &events]
+		{
+			const size_t unavailable
+			{
+				m::keys::prefetch(vector_view<const m::event>(events))
+			};
+
+			out << unavailable << " keys unavailable" << std::endl;
+		}};
+
+		size_t valid(0), invalid(0);
+		const util::timer verify_timer{[&events, &valid, &invalid]
+		{
+			for(const auto &event : events) try
+			{
+				if(m::verify(event))
+					++valid;
+				else
+					++invalid;
+			}
+			catch(const std::exception &)
+			{
+				++invalid;
+			}
+		}};
+
+		out << "verified " << valid << " of " << events.size() << " events"
+		    << " (" << invalid << " failed)" << std::endl
+		    << "prefetch " << prefetch_timer.get<milliseconds>().count() << " ms"
+		    << "; verify " << verify_timer.get<milliseconds>().count() << " ms"
+		    << std::endl;
+
+		return true;
+	}
+
 	if(op != "eval")
 	{
 		if(op != "auth")
@@ -6834,6 +7671,7 @@ console_cmd__fed__state(opt &out, const string_view &line)
 
 	std::sort(begin(events), end(events));
 	events.erase(std::unique(begin(events), end(events)), end(events));
+	m::keys::prefetch(vector_view<const m::event>(events));
 	for(const auto &event : events)
 		eval(event);
 
@@ -7684,6 +8522,141 @@ console_cmd__file__download(opt &out, const string_view &line)
 	return true;
 }
 
+/// Writes and then reads back a file of the given size (MiB) through the
+/// media store, then reads the second half as a range. The content is a
+/// fixed pattern so later runs find their extents already present and only
+/// measure hashing and the file record. CPU time is the whole process.
+bool
+console_cmd__file__bench(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"MiB"
+	}};
+
+	const size_t mib
+	{
+		param.at(0, 64UL)
+	};
+
+	using room_id_prototype = m::room::id (m::room::id::buf &,
+	                                       const string_view &server,
+	                                       const string_view &file);
+
+	using write_prototype = size_t (const m::room &,
+	                                const m::user::id &,
+	                                const const_buffer &,
+	                                const string_view &);
+
+	using read_prototype = size_t (const m::room &,
+	                               const std::function<void (const const_buffer &)> &);
+
+	static m::import<room_id_prototype> file_room_id
+	{
+		"media_media", "file_room_id"
+	};
+
+	static m::import<write_prototype> write_file
+	{
+		"media_media", "write_file"
+	};
+
+	using range_prototype = size_t (const m::room &,
+	                                const size_t &,
+	                                const size_t &,
+	                                const std::function<void (const const_buffer &)> &);
+
+	static m::import<read_prototype> read_each_block
+	{
+		"media_media", "read_each_block"
+	};
+
+	static m::import<range_prototype> read_range
+	{
+		"media_media", "read_range"
+	};
+
+	const unique_buffer<mutable_buffer> content
+	{
+		mib * 1_MiB
+	};
+
+	uint64_t *const words(reinterpret_cast<uint64_t *>(data(content)));
+	for(size_t i(0); i < size(content) / sizeof(uint64_t); ++i)
+		words[i] = i;
+
+	m::room::id::buf room_id;
+	const m::room room
+	{
+		file_room_id(room_id, my_host(), "ircd.file.bench")
+	};
+
+	const auto report{[&out](const string_view &what,
+	                         const size_t &bytes,
+	                         const util::timer &timer,
+	                         const std::clock_t &cpu)
+	{
+		const auto us
+		{
+			timer.get<microseconds>().count()
+		};
+
+		const long double rate
+		{
+			us > 0? (bytes / (long double)1_MiB) / (us / 1000000.0L) : 0.0L
+		};
+
+		const long double cpu_ms
+		{
+			cpu * 1000.0L / CLOCKS_PER_SEC
+		};
+
+		out << std::setw(8) << std::left << what
+		    << " " << std::setw(12) << std::right << bytes << " bytes in "
+		    << std::setw(9) << std::right << us << " us; "
+		    << std::setw(9) << std::right << std::fixed << std::setprecision(2) << rate
+		    << " MiB/s; "
+		    << std::setw(9) << std::right << std::fixed << std::setprecision(2)
+		    << (bytes? cpu_ms / (bytes / (long double)1_GiB) : 0.0L)
+		    << " CPU ms/GiB"
+		    << std::endl;
+	}};
+
+	std::clock_t cpu(std::clock());
+	util::timer write_timer;
+	const size_t wrote
+	{
+		write_file(room, m::me.user_id, content, "application/octet-stream")
+	};
+
+	write_timer.stop();
+	report("upload", wrote, write_timer, std::clock() - cpu);
+
+	size_t got(0);
+	cpu = std::clock();
+	util::timer read_timer;
+	read_each_block(room, [&got](const const_buffer &extent)
+	{
+		got += size(extent);
+	});
+
+	read_timer.stop();
+	report("download", got, read_timer, std::clock() - cpu);
+
+	got = 0;
+	cpu = std::clock();
+	util::timer range_timer;
+	read_range(room, size(content) / 2, size(content) - size(content) / 2, [&got]
+	(const const_buffer &part)
+	{
+		got += size(part);
+	});
+
+	range_timer.stop();
+	report("range", got, range_timer, std::clock() - cpu);
+	return true;
+}
+
 //
 // vm
 //
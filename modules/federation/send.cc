@@ -136,8 +136,17 @@ handle_put(client &client,
 	for(const json::object &edu : edus)
 		handle_edu(client, request, txn_id, edu);
 
+	// The signing keys for the whole batch are resolved together rather than
+	// one at a time as each pdu is verified.
+	std::vector<m::event> events;
+	events.reserve(pdus.count());
 	for(const json::object &pdu : pdus)
-		handle_pdu(client, request, txn_id, pdu);
+		events.emplace_back(pdu);
+
+	m::keys::prefetch(vector_view<const m::event>(events));
+
+	for(const auto &event : events)
+		handle_pdu(client, request, txn_id, event);
 
 	return resource::response
 	{
@@ -0,0 +1,398 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2018 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+using namespace ircd;
+
+mapi::header
+IRCD_MODULE
+{
+	"Matrix events library; bulk export and import."
+};
+
+//
+// Event dump format
+//
+// A dump file starts with the 8 byte magic below and is followed by records
+// until the end of the file. Each record is the event_idx (8 bytes) and the
+// size of the JSON (4 bytes), both in network byte order, then the event
+// JSON as printed from the database. Records in a file ascend by event_idx.
+// An export over several shards writes one file per contiguous range of
+// event_idx; importing them in shard order reproduces the original order.
+//
+
+static const string_view
+dump_magic
+{
+	"IRCDEV01"
+};
+
+static constexpr const size_t
+dump_header_size
+{
+	sizeof(uint64_t) + sizeof(uint32_t)
+};
+
+extern conf::item<size_t> export_shards;
+extern conf::item<size_t> export_buffer_size;
+extern conf::item<size_t> import_buffer_size;
+
+decltype(export_shards)
+export_shards
+{
+	{ "name",     "ircd.m.events.export.shards" },
+	{ "default",  4L                            },
+};
+
+decltype(export_buffer_size)
+export_buffer_size
+{
+	{ "name",     "ircd.m.events.export.buffer_size" },
+	{ "default",  long(4_MiB)                        },
+};
+
+decltype(import_buffer_size)
+import_buffer_size
+{
+	{ "name",     "ircd.m.events.import.buffer_size" },
+	{ "default",  long(32_MiB)                       },
+};
+
+//
+// export
+//
+
+static size_t
+export_shard(const string_view &path,
+             const m::event::idx &lo,
+             const m::event::idx &hi)
+{
+	const fs::fd file
+	{
+		path, std::ios::out | std::ios::trunc
+	};
+
+	const unique_buffer<mutable_buffer> buf
+	{
+		std::max(size_t(export_buffer_size), m::event::MAX_SIZE + dump_header_size)
+	};
+
+	char *pos{data(buf)};
+	pos += copy(mutable_buffer{pos, size(dump_magic)}, dump_magic);
+
+	size_t count(0);
+	const auto flush{[&file, &buf, &pos]
+	{
+		fs::append(file, const_buffer{data(buf), pos});
+		pos = data(buf);
+	}};
+
+	m::events::for_each(lo, [&](const m::event::idx &event_idx, const m::event &event)
+	{
+		if(event_idx >= hi)
+			return false;
+
+		if(pos + dump_header_size + m::event::MAX_SIZE > data(buf) + size(buf))
+			flush();
+
+		const mutable_buffer body
+		{
+			pos + dump_header_size, m::event::MAX_SIZE
+		};
+
+		const uint64_t idx(hton(uint64_t(event_idx)));
+		const uint32_t len(hton(uint32_t(json::print(body, event))));
+		memcpy(pos, &idx, sizeof(idx));
+		memcpy(pos + sizeof(idx), &len, sizeof(len));
+		pos += dump_header_size + ntoh(len);
+		++count;
+		return true;
+	});
+
+	flush();
+	return count;
+}
+
+/// Writes every event to the dump format. The range of event_idx is split
+/// into shards which are written concurrently, each to its own file named
+/// with the shard number appended to the path (the path itself is used if
+/// there is only one shard). Returns the number of events written.
+extern "C" size_t
+events__export(const string_view &path,
+               const size_t &shards_)
+{
+	const size_t shards
+	{
+		std::max(shards_?: size_t(export_shards), size_t(1))
+	};
+
+	const m::event::idx top
+	{
+		m::vm::current_sequence + 1
+	};
+
+	const m::event::idx span
+	{
+		top / shards + 1
+	};
+
+	std::vector<std::string> paths(shards);
+	std::vector<size_t> counts(shards, 0);
+	std::vector<std::exception_ptr> eptrs(shards);
+	std::vector<ctx::context> workers;
+	workers.reserve(shards);
+	for(size_t i(0); i < shards; ++i)
+	{
+		paths[i] = shards > 1?
+			fmt::snstringf{fs::PATH_MAX, "%s.%zu", path, i}:
+			std::string(path);
+
+		workers.emplace_back("events export", 512_KiB, [&, i]
+		{
+			try
+			{
+				counts[i] = export_shard(paths[i], i * span, std::min((i + 1) * span, top));
+			}
+			catch(const std::exception &e)
+			{
+				eptrs[i] = std::current_exception();
+			}
+		});
+	}
+
+	for(auto &worker : workers)
+		worker.join();
+
+	for(const auto &eptr : eptrs)
+		if(eptr)
+			std::rethrow_exception(eptr);
+
+	size_t ret(0);
+	for(size_t i(0); i < shards; ++i)
+	{
+		log::info
+		{
+			"Exported %zu events to %s", counts[i], paths[i]
+		};
+
+		ret += counts[i];
+	}
+
+	return ret;
+}
+
+//
+// import
+//
+
+/// Writes one batch of events read from a dump. The event property columns
+/// and the event_idx column depend only on the event itself so each is
+/// built as a sorted table and ingested whole; the room indexes are then
+/// written with one transaction for the batch (in event_idx order, so the
+/// latest state wins). Heads, depth runs and the state tree history are
+/// not built here. Each event is given the next event_idx of the server's
+/// sequence in the order of the dump; the event_idx recorded in the dump
+/// only orders it. Events already in the database are skipped. Returns the
+/// number of events written.
+static size_t
+import_batch(const std::vector<std::pair<uint64_t, json::object>> &records)
+{
+	std::vector<m::event> events;
+	std::vector<m::event::idx> idxs;
+	std::set<string_view> seen;
+	events.reserve(records.size());
+	idxs.reserve(records.size());
+	for(const auto &record : records)
+	{
+		const m::event event
+		{
+			record.second
+		};
+
+		const m::event::id &event_id
+		{
+			at<"event_id"_>(event)
+		};
+
+		if(!seen.emplace(event_id).second || m::exists(event_id))
+			continue;
+
+		events.emplace_back(event);
+		idxs.emplace_back(++m::vm::current_sequence);
+	}
+
+	if(events.empty())
+		return 0;
+
+	std::array<std::vector<db::column::delta>, m::dbs::event_columns> deltas;
+	std::vector<db::column::delta> idx_deltas;
+	idx_deltas.reserve(events.size());
+	for(size_t i(0); i < events.size(); ++i)
+	{
+		const string_view key
+		{
+			byte_view<string_view>(idxs[i])
+		};
+
+		size_t c(0);
+		json::for_each(events[i], [&deltas, &key, &c]
+		(const auto &, auto&& val)
+		{
+			if(defined(json::value(val)))
+				deltas[c].emplace_back(db::op::SET, key, byte_view<string_view>{val});
+
+			++c;
+		});
+
+		idx_deltas.emplace_back(db::op::SET, at<"event_id"_>(events[i]), key);
+	}
+
+	for(size_t c(0); c < deltas.size(); ++c)
+		db::ingest(m::dbs::event_column.at(c), deltas[c]);
+
+	db::ingest(m::dbs::event_idx, idx_deltas);
+
+	db::txn txn
+	{
+		*m::dbs::events
+	};
+
+	char root[64] {0};
+	for(size_t i(0); i < events.size(); ++i)
+	{
+		const m::event &event(events[i]);
+		m::dbs::write_opts opts;
+		opts.event_idx = idxs[i];
+		opts.root_out = root;
+		opts.history = false;
+		opts.head = false;
+		opts.refs = false;
+
+		if(defined(json::get<"state_key"_>(event)))
+			m::dbs::_index_state(txn, event, opts);
+		else if(at<"type"_>(event) == "m.room.redaction")
+			m::dbs::_index_redact(txn, event, opts);
+		else
+			m::dbs::_index_ephem(txn, event, opts);
+	}
+
+	txn();
+	m::dbs::room_cache_clear();
+	return events.size();
+}
+
+/// Loads one dump file directly into the events database at the top of the
+/// server's sequence. Evals don't write while the import runs. Returns the
+/// number of events loaded, which excludes those already in the database.
+extern "C" size_t
+events__import(const string_view &path)
+{
+	const std::lock_guard<ctx::shared_mutex> sequence_lock
+	{
+		m::vm::sequence_lock
+	};
+
+	const fs::fd file
+	{
+		path, std::ios::in
+	};
+
+	const unique_buffer<mutable_buffer> buf
+	{
+		std::max(size_t(import_buffer_size), m::event::MAX_SIZE + dump_header_size)
+	};
+
+	const auto magic
+	{
+		fs::read(file, mutable_buffer{data(buf), size(dump_magic)})
+	};
+
+	if(string_view{magic} != dump_magic)
+		throw m::UNSUPPORTED
+		{
+			"%s is not an event dump", path
+		};
+
+	size_t ret(0), have(0);
+	off_t offset(size(dump_magic));
+	std::vector<std::pair<uint64_t, json::object>> records;
+	for(bool eof(false); !eof || have; )
+	{
+		if(!eof)
+		{
+			const mutable_buffer space
+			{
+				data(buf) + have, size(buf) - have
+			};
+
+			const auto got
+			{
+				fs::read(file, space, fs::read_opts{offset})
+			};
+
+			offset += size(got);
+			have += size(got);
+			eof = empty(got);
+		}
+
+		records.clear();
+		const char *pos(data(buf));
+		const char *const stop(data(buf) + have);
+		while(size_t(stop - pos) >= dump_header_size)
+		{
+			uint64_t idx;
+			uint32_t len;
+			memcpy(&idx, pos, sizeof(idx));
+			memcpy(&len, pos + sizeof(idx), sizeof(len));
+			if(size_t(stop - pos) < dump_header_size + ntoh(len))
+				break;
+
+			const json::object object
+			{
+				string_view{pos + dump_header_size, ntoh(len)}
+			};
+
+			records.emplace_back(ntoh(idx), object);
+			pos += dump_header_size + ntoh(len);
+		}
+
+		if(records.empty())
+		{
+			if(eof && have)
+				throw m::BAD_JSON
+				{
+					"Truncated record at offset %ld of %s", long(offset - have), path
+				};
+
+			if(have == size(buf))
+				throw m::BAD_JSON
+				{
+					"Record too large at offset %ld of %s", long(offset - have), path
+				};
+
+			continue;
+		}
+
+		ret += import_batch(records);
+
+		// Move the partial record at the end of the buffer to the front.
+		have = stop - pos;
+		memmove(data(buf), pos, have);
+	}
+
+	log::info
+	{
+		"Imported %zu events from %s; sequence now %lu",
+		ret,
+		path,
+		m::vm::current_sequence
+	};
+
+	return ret;
+}
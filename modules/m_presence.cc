@@ -42,6 +42,7 @@ _m_presence_eval
 	{
 		{ "_site",   "vm.eval"     },
 		{ "type",    "m.presence"  },
+		{ "_defer",  true          },
 	}
 };
 
@@ -29,6 +29,7 @@ _m_receipt_eval
 	{
 		{ "_site",   "vm.eval"    },
 		{ "type",    "m.receipt"  },
+		{ "_defer",  true         },
 	}
 };
 
@@ -10,10 +10,13 @@
 
 using namespace ircd;
 
+static void init_jobs();
+static void fini_jobs();
+
 mapi::header
 IRCD_MODULE
 {
-	"Matrix state library; modular components."
+	"Matrix state library; modular components.", init_jobs, fini_jobs
 };
 
 extern "C" void
@@ -76,25 +79,19 @@ make_prev(const m::room &room,
 	const auto top_head
 	{
 		need_tophead?
-			m::top(std::nothrow, room.room_id):
+			m::dbs::room_top_cached(room.room_id):
 			std::tuple<m::id::event::buf, int64_t, m::event::idx>{}
 	};
 
 	int64_t depth{-1};
-	m::event::fetch event;
-	const m::room::head head{room};
-	head.for_each(m::room::head::closure_bool{[&]
-	(const m::event::idx &idx, const m::event::id &event_id)
+	m::dbs::room_head_cached(room.room_id, [&]
+	(const m::event::idx &idx, const m::event::id &event_id, const int64_t &event_depth)
 	{
-		seek(event, idx, std::nothrow);
-		if(!event.valid)
-			return true;
-
 		if(need_tophead)
-			if(json::get<"event_id"_>(event) == std::get<0>(top_head))
+			if(event_id == std::get<0>(top_head))
 				need_tophead = false;
 
-		depth = std::max(json::get<"depth"_>(event), depth);
+		depth = std::max(event_depth, depth);
 		json::stack::array prev{out};
 		prev.append(event_id);
 		{
@@ -106,7 +103,7 @@ make_prev(const m::room &room,
 		}
 
 		return --limit - need_tophead > 0;
-	}});
+	});
 
 	if(need_tophead)
 	{
@@ -144,45 +141,95 @@ make_prev__buf(const m::room &room,
 	};
 }
 
-extern "C" std::pair<bool, int64_t>
-is_complete(const m::room &room)
+/// Rebuilds the room_depth runs of a room from a scan of its room_events
+/// keys and marks the room indexed. Rooms written before that column existed
+/// are indexed by this on their first query. Existing runs are replaced;
+/// evals of the room wait on the room_depth_lock until the txn is committed.
+extern "C" size_t
+depth__rebuild(const m::room &room)
 {
-	const m::room::state state
+	const m::dbs::room_depth_lock depth_lock
 	{
-		room
+		room.room_id
 	};
 
-	const auto create_id
+	std::vector<std::pair<int64_t, int64_t>> runs;
+	for(auto it(m::dbs::room_events.begin(room.room_id)); bool(it); ++it)
 	{
-		state.get("m.room.create")
-	};
+		// Keys visit the depths from the highest down.
+		const int64_t depth(m::dbs::room_events_key(it->first).first);
+		if(!runs.empty() && (depth == runs.back().first || depth + 1 == runs.back().first))
+			runs.back().first = depth;
+		else
+			runs.emplace_back(depth, depth);
+	}
 
-	static const m::event::fetch::opts fopts
+	db::txn txn
 	{
-		m::event::keys::include{"depth"},
-		{ db::get::NO_CACHE }
+		*m::dbs::events
 	};
 
-	m::room::messages it
+	char buf[m::dbs::ROOM_DEPTH_KEY_MAX_SIZE];
+	for(auto it(m::dbs::room_depth.begin(room.room_id)); bool(it); ++it)
+		db::txn::append
+		{
+			txn, m::dbs::room_depth,
+			{
+				db::op::DELETE,
+				m::dbs::room_depth_key(buf, room.room_id, m::dbs::room_depth_key(it->first))
+			}
+		};
+
+	for(const auto &run : runs)
+		db::txn::append
+		{
+			txn, m::dbs::room_depth,
+			{
+				db::op::SET,
+				m::dbs::room_depth_key(buf, room.room_id, run.first),
+				byte_view<string_view>(uint64_t(run.second))
+			}
+		};
+
+	db::txn::append
 	{
-		room, create_id, &fopts
+		txn, m::dbs::room_depth,
+		{
+			db::op::SET,
+			m::dbs::room_depth_key(buf, room.room_id, m::dbs::ROOM_DEPTH_INDEXED),
+			byte_view<string_view>(m::dbs::ROOM_DEPTH_INDEXED)
+		}
 	};
 
-	int64_t depth{0};
-	if(!it)
-		return {false, depth};
+	txn();
+	return runs.size();
+}
 
-	for(; it; ++it)
+/// A room is complete when its timeline is one run of depth from the
+/// create event up. Otherwise the depth returned is the top of the run
+/// rising from the create event (zero when that is missing).
+extern "C" std::pair<bool, int64_t>
+is_complete(const m::room &room)
+{
+	size_t runs{0};
+	std::pair<int64_t, int64_t> bottom{-1, -1};
+	const auto each{[&runs, &bottom]
+	(const int64_t &lo, const int64_t &hi)
 	{
-		const m::event &event{*it};
-		if(at<"depth"_>(event) == depth + 1)
-			++depth;
+		bottom = {lo, hi};
+		++runs;
+		return true;
+	}};
 
-		if(at<"depth"_>(event) != depth)
-			return {false, depth};
-	}
+	if(!m::dbs::room_depth_indexed(room.room_id))
+		depth__rebuild(room);
 
-	return {true, depth};
+	m::dbs::room_depth_ranges(room.room_id, each);
+
+	if(!runs || bottom.first > 1)
+		return {false, 0};
+
+	return {runs == 1, bottom.second};
 }
 
 extern "C" bool
@@ -211,145 +258,10 @@ state__force_present(const m::event &event)
 	m::dbs::_index__room_joined(txn, event, opts);
 
 	txn();
+	m::dbs::committed(event, opts);
 	return true;
 }
 
-extern "C" size_t
-state__rebuild_present(const m::room &room)
-{
-	size_t ret{0};
-	const m::room::state state
-	{
-		room
-	};
-
-	const auto create_id
-	{
-		state.get("m.room.create")
-	};
-
-	static const m::event::fetch::opts fopts
-	{
-		{ db::get::NO_CACHE }
-	};
-
-	m::room::messages it
-	{
-		room, create_id, &fopts
-	};
-
-	if(!it)
-		return ret;
-
-	db::txn txn
-	{
-		*m::dbs::events
-	};
-
-	for(; it; ++it)
-	{
-		const m::event &event{*it};
-		if(!defined(json::get<"state_key"_>(event)))
-			continue;
-
-		m::dbs::write_opts opts;
-		opts.event_idx = it.event_idx();
-		opts.present = true;
-		opts.history = false;
-		opts.head = false;
-		opts.refs = false;
-
-		m::dbs::_index__room_state(txn, event, opts);
-		m::dbs::_index__room_joined(txn, event, opts);
-		++ret;
-	}
-
-	txn();
-	return ret;
-}
-
-extern "C" size_t
-state__rebuild_history(const m::room &room)
-{
-	size_t ret{0};
-	const m::room::state state
-	{
-		room
-	};
-
-	const auto create_id
-	{
-		state.get("m.room.create")
-	};
-
-	static const m::event::fetch::opts fopts
-	{
-		{ db::get::NO_CACHE }
-	};
-
-	m::room::messages it
-	{
-		room, create_id, &fopts
-	};
-
-	if(!it)
-		return ret;
-
-	db::txn txn
-	{
-		*m::dbs::events
-	};
-
-	uint r(0);
-	char root[2][64] {0};
-	m::dbs::write_opts opts;
-	opts.root_in = root[++r % 2];
-	opts.root_out = root[++r % 2];
-	opts.present = false;
-	opts.history = true;
-	opts.head = false;
-	opts.refs = false;
-
-	int64_t depth{0};
-	for(; it; ++it)
-	{
-		const m::event &event{*it};
-		opts.event_idx = it.event_idx();
-		if(at<"depth"_>(event) == depth + 1)
-			++depth;
-
-		if(at<"depth"_>(event) != depth)
-			throw ircd::error
-			{
-				"Incomplete room history: gap between %ld and %ld [%s]",
-				depth,
-				at<"depth"_>(event),
-				string_view{at<"event_id"_>(event)}
-			};
-
-		if(at<"type"_>(event) == "m.room.redaction")
-		{
-			opts.root_in = m::dbs::_index_redact(txn, event, opts);
-			opts.root_out = root[++r % 2];
-			txn();
-			txn.clear();
-		}
-		else if(defined(json::get<"state_key"_>(event)))
-		{
-			opts.root_in = m::dbs::_index_state(txn, event, opts);
-			opts.root_out = root[++r % 2];
-			txn();
-			txn.clear();
-		}
-		else m::dbs::_index_ephem(txn, event, opts);
-
-		++ret;
-	}
-
-	txn();
-	return ret;
-}
-
 extern "C" size_t
 head__rebuild(const m::room &room)
 {
@@ -391,6 +303,7 @@ head__rebuild(const m::room &room)
 	}
 
 	txn();
+	m::dbs::room_cache_clear(room.room_id);
 	return ret;
 }
 
@@ -454,6 +367,7 @@ head__reset(const m::room &room)
 
 	// Commit txn
 	txn();
+	m::dbs::room_cache_clear(room.room_id);
 	return ret;
 }
 
@@ -482,6 +396,7 @@ head__modify(const m::event::id &event_id,
 
 	// Commit txn
 	txn();
+	m::dbs::committed(event, opts);
 }
 
 extern "C" size_t
@@ -593,3 +508,572 @@ room_herd(const m::room &room,
 		ctx::sleep(seconds(2));
 	}
 }
+
+//
+// Room maintenance jobs
+//
+// A rebuild or purge of a room works through the timeline in chunks of
+// bounded size; each chunk is its own transaction. Progress is checkpointed
+// to the !ircd room as ircd.room.job state (keyed by room_id) after every
+// chunk so a job interrupted by a restart picks up where it left off. Jobs
+// yield between chunks to hold a duty cycle and stand aside while the vm is
+// busy with foreground evaluation.
+//
+
+struct room_job
+{
+	std::string room_id;
+	std::string op;             // rebuild_present | rebuild_history | purge
+	std::string event_id;       // last event processed (rebuilds)
+	int64_t depth {0};          // last depth reached (rebuilds)
+	std::string root;           // state root reached (rebuild_history)
+	size_t count {0};           // events processed
+	size_t chunks {0};
+	ctx::context context;
+};
+
+static bool job_rebuild_present(room_job &);
+static bool job_rebuild_history(room_job &);
+static bool job_purge(room_job &);
+static void job_purge_range(db::index &, const string_view &begin, const string_view &end);
+static void job_throttle(const steady_point &started);
+static void job_save(const room_job &);
+static void job_worker(room_job &);
+static bool job_start(const string_view &room_id, const string_view &op, const json::object &checkpoint);
+static void init_jobs();
+
+extern conf::item<size_t> job_chunk;
+extern conf::item<size_t> job_duty;
+extern conf::item<size_t> job_load_max;
+extern conf::item<milliseconds> job_pause;
+extern std::map<std::string, std::unique_ptr<room_job>, std::less<>> jobs;
+
+decltype(job_chunk)
+job_chunk
+{
+	{ "name",     "ircd.m.room.job.chunk" },
+	{ "default",  4096L                   },
+};
+
+decltype(job_duty)
+job_duty
+{
+	{ "name",     "ircd.m.room.job.duty" },
+	{ "default",  50L                    },
+};
+
+decltype(job_load_max)
+job_load_max
+{
+	{ "name",     "ircd.m.room.job.load_max" },
+	{ "default",  8L                         },
+};
+
+decltype(job_pause)
+job_pause
+{
+	{ "name",     "ircd.m.room.job.pause" },
+	{ "default",  250L                    },
+};
+
+decltype(jobs)
+jobs;
+
+void
+init_jobs()
+{
+	m::room::state{m::my_room}.for_each("ircd.room.job", []
+	(const m::event &event)
+	{
+		const json::object &content
+		{
+			json::get<"content"_>(event)
+		};
+
+		const string_view &op
+		{
+			unquote(content.get("op"))
+		};
+
+		if(op)
+			job_start(at<"state_key"_>(event), op, content);
+	});
+}
+
+void
+fini_jobs()
+{
+	// Each context is interrupted and joined; the checkpoints remain.
+	jobs.clear();
+}
+
+extern "C" bool
+room_job__start(const m::room::id &room_id,
+                const string_view &op)
+{
+	if(op != "rebuild_present" && op != "rebuild_history" && op != "purge")
+		throw m::UNSUPPORTED
+		{
+			"Unknown room job '%s'", op
+		};
+
+	if(op == "purge" && room_id == m::my_room.room_id)
+		throw m::UNSUPPORTED
+		{
+			"Cannot purge %s", string_view{room_id}
+		};
+
+	return job_start(room_id, op, json::object{});
+}
+
+extern "C" bool
+room_job__cancel(const m::room::id &room_id)
+{
+	const auto it
+	{
+		jobs.find(room_id)
+	};
+
+	if(it != end(jobs))
+		jobs.erase(it);
+
+	const bool pending
+	{
+		m::room::state{m::my_room}.has("ircd.room.job", room_id)
+	};
+
+	if(pending)
+		send(m::my_room, m::me.user_id, "ircd.room.job", room_id, json::object{});
+
+	return it != end(jobs) || pending;
+}
+
+extern "C" void
+room_job__for_each(const std::function<bool (const string_view &room_id, const string_view &op, const size_t &count, const bool &running)> &closure)
+{
+	for(const auto &p : jobs)
+	{
+		const auto &job(*p.second);
+		if(!closure(job.room_id, job.op, job.count, !job.context.joined()))
+			break;
+	}
+}
+
+bool
+job_start(const string_view &room_id,
+          const string_view &op,
+          const json::object &checkpoint)
+{
+	auto it
+	{
+		jobs.lower_bound(room_id)
+	};
+
+	if(it != end(jobs) && it->first == room_id)
+	{
+		if(!it->second->context.joined())
+			return false;
+
+		it = jobs.erase(it);
+	}
+
+	auto job
+	{
+		std::make_unique<room_job>()
+	};
+
+	job->room_id = std::string(room_id);
+	job->op = std::string(op);
+	job->event_id = unquote(checkpoint.get("event_id"));
+	job->depth = checkpoint.get<int64_t>("depth");
+	job->root = unquote(checkpoint.get("root"));
+	job->count = checkpoint.get<size_t>("count");
+
+	auto &ref(*job);
+	jobs.emplace_hint(it, job->room_id, std::move(job));
+	ref.context = ctx::context
+	{
+		"room job", 512_KiB, std::bind(&job_worker, std::ref(ref)), ctx::context::POST
+	};
+
+	return true;
+}
+
+void
+job_worker(room_job &job)
+try
+{
+	log::notice
+	{
+		"Room job %s for %s starting with %zu events done",
+		job.op,
+		job.room_id,
+		job.count,
+	};
+
+	const auto &chunk
+	{
+		job.op == "purge"?
+			job_purge:
+		job.op == "rebuild_history"?
+			job_rebuild_history:
+			job_rebuild_present
+	};
+
+	job_save(job);
+	for(bool more(true); more; ++job.chunks)
+	{
+		const auto started
+		{
+			now<steady_point>()
+		};
+
+		more = chunk(job);
+		if(!more)
+			break;
+
+		job_save(job);
+		job_throttle(started);
+	}
+
+	send(m::my_room, m::me.user_id, "ircd.room.job", job.room_id, json::object{});
+	log::notice
+	{
+		"Room job %s for %s complete after %zu events in %zu chunks",
+		job.op,
+		job.room_id,
+		job.count,
+		job.chunks,
+	};
+}
+catch(const ctx::interrupted &e)
+{
+	log::dwarning
+	{
+		"Room job %s for %s interrupted after %zu events; it will resume.",
+		job.op,
+		job.room_id,
+		job.count,
+	};
+
+	throw;
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		"Room job %s for %s failed after %zu events :%s",
+		job.op,
+		job.room_id,
+		job.count,
+		e.what()
+	};
+}
+
+void
+job_save(const room_job &job)
+{
+	send(m::my_room, m::me.user_id, "ircd.room.job", job.room_id, json::members
+	{
+		{ "op",        string_view{job.op}        },
+		{ "event_id",  string_view{job.event_id}  },
+		{ "depth",     job.depth                  },
+		{ "root",      string_view{job.root}      },
+		{ "count",     long(job.count)            },
+	});
+}
+
+void
+job_throttle(const steady_point &started)
+{
+	const auto duty
+	{
+		std::clamp(size_t(job_duty), size_t(1), size_t(100))
+	};
+
+	const auto elapsed
+	{
+		std::chrono::duration_cast<milliseconds>(now<steady_point>() - started)
+	};
+
+	ctx::sleep(elapsed * (100 - duty) / duty);
+	while(size(m::vm::eval::list) > size_t(job_load_max))
+		ctx::sleep(milliseconds(job_pause));
+}
+
+/// Positions the iterator at the first event the job has not processed.
+static bool
+job_seek(const room_job &job,
+         m::room::messages &it)
+{
+	if(job.event_id.empty())
+	{
+		const m::room::state state
+		{
+			m::room{job.room_id}
+		};
+
+		return it.seek(state.get("m.room.create"));
+	}
+
+	if(!it.seek(m::event::id{job.event_id}))
+		throw ircd::error
+		{
+			"Checkpoint %s is no longer in %s", job.event_id, job.room_id
+		};
+
+	++it;
+	return bool(it);
+}
+
+bool
+job_rebuild_present(room_job &job)
+{
+	static const m::event::fetch::opts fopts
+	{
+		{ db::get::NO_CACHE }
+	};
+
+	m::room::messages it
+	{
+		m::room{job.room_id}, &fopts
+	};
+
+	if(!job_seek(job, it))
+		return false;
+
+	db::txn txn
+	{
+		*m::dbs::events
+	};
+
+	for(size_t i(0); it && i < size_t(job_chunk); ++it, ++i)
+	{
+		const m::event &event{*it};
+		job.event_id = at<"event_id"_>(event);
+		job.depth = at<"depth"_>(event);
+		++job.count;
+
+		if(!defined(json::get<"state_key"_>(event)))
+			continue;
+
+		m::dbs::write_opts opts;
+		opts.event_idx = it.event_idx();
+		opts.present = true;
+		opts.history = false;
+		opts.head = false;
+		opts.refs = false;
+
+		m::dbs::_index__room_state(txn, event, opts);
+		m::dbs::_index__room_joined(txn, event, opts);
+	}
+
+	txn();
+	m::dbs::room_cache_clear(m::room::id{job.room_id});
+	return bool(it);
+}
+
+bool
+job_rebuild_history(room_job &job)
+{
+	static const m::event::fetch::opts fopts
+	{
+		{ db::get::NO_CACHE }
+	};
+
+	m::room::messages it
+	{
+		m::room{job.room_id}, &fopts
+	};
+
+	if(!job_seek(job, it))
+		return false;
+
+	db::txn txn
+	{
+		*m::dbs::events
+	};
+
+	uint r(0);
+	char root[2][64] {0};
+	m::dbs::write_opts opts;
+	opts.root_in = strlcpy(root[r % 2], job.root);
+	opts.root_out = root[++r % 2];
+	opts.present = false;
+	opts.history = true;
+	opts.head = false;
+	opts.refs = false;
+
+	int64_t &depth(job.depth);
+	for(size_t i(0); it && i < size_t(job_chunk); ++it, ++i)
+	{
+		const m::event &event{*it};
+		opts.event_idx = it.event_idx();
+		if(at<"depth"_>(event) == depth + 1)
+			++depth;
+
+		if(at<"depth"_>(event) != depth)
+			throw ircd::error
+			{
+				"Incomplete room history: gap between %ld and %ld [%s]",
+				depth,
+				at<"depth"_>(event),
+				string_view{at<"event_id"_>(event)}
+			};
+
+		if(at<"type"_>(event) == "m.room.redaction")
+		{
+			opts.root_in = m::dbs::_index_redact(txn, event, opts);
+			opts.root_out = root[++r % 2];
+			txn();
+			txn.clear();
+		}
+		else if(defined(json::get<"state_key"_>(event)))
+		{
+			opts.root_in = m::dbs::_index_state(txn, event, opts);
+			opts.root_out = root[++r % 2];
+			txn();
+			txn.clear();
+		}
+		else m::dbs::_index_ephem(txn, event, opts);
+
+		job.event_id = at<"event_id"_>(event);
+		++job.count;
+	}
+
+	txn();
+	job.root = std::string(opts.root_in);
+	return bool(it);
+}
+
+/// Purging works down from the top of the room so no cursor is needed: each
+/// chunk deletes the data of the highest events and then the contiguous
+/// run of their room_events keys. Once the timeline is empty the room's keys
+/// in the other room columns are deleted too. State tree nodes are shared
+/// between rooms and are not touched. The events database has a row cache,
+/// with which RocksDB refuses range deletes, so every key is deleted singly.
+bool
+job_purge(room_job &job)
+{
+	const m::room::id &room_id
+	{
+		job.room_id
+	};
+
+	// The cached head and top are about to be deleted out from under it.
+	m::dbs::room_cache_clear(room_id);
+
+	m::room::messages it
+	{
+		m::room{room_id}
+	};
+
+	db::txn txn
+	{
+		*m::dbs::events
+	};
+
+	for(size_t i(0); it && i < size_t(job_chunk); --it, ++i)
+	{
+		const m::event &event{*it};
+		m::dbs::write_opts opts;
+		opts.op = db::op::DELETE;
+		opts.event_idx = it.event_idx();
+		if(json::get<"event_id"_>(event))
+			m::dbs::_index__event(txn, event, opts);
+
+		db::txn::append
+		{
+			txn, byte_view<string_view>(opts.event_idx), event, m::dbs::event_column, opts.op
+		};
+
+		++job.count;
+	}
+
+	txn();
+
+	char buf[2][m::dbs::ROOM_EVENTS_KEY_MAX_SIZE];
+	const auto next
+	{
+		it? m::dbs::room_events_key(it.it->first): std::pair<uint64_t, m::event::idx>{0, 0}
+	};
+
+	job_purge_range(m::dbs::room_events,
+	                m::dbs::room_events_key(buf[0], room_id, std::numeric_limits<uint64_t>::max()),
+	                m::dbs::room_events_key(buf[1], room_id, next.first, next.second));
+
+	if(it)
+		return true;
+
+	const std::string begin
+	{
+		std::string(room_id) + '\0'
+	};
+
+	const std::string end
+	{
+		std::string(room_id) + '\1'
+	};
+
+	job_purge_range(m::dbs::room_head, begin, end);
+	job_purge_range(m::dbs::room_depth, begin, end);
+	job_purge_range(m::dbs::room_joined, begin, end);
+	job_purge_range(m::dbs::room_state, begin, end);
+	m::dbs::room_cache_clear(room_id);
+	return false;
+}
+
+/// Deletes the keys [begin, end) of one room from an index column. The
+/// keys of both bounds must belong to the same room.
+void
+job_purge_range(db::index &index,
+                const string_view &begin,
+                const string_view &end)
+{
+	db::txn txn
+	{
+		*m::dbs::events
+	};
+
+	// The index iterator yields keys without the room_id prefix.
+	const string_view &room_id
+	{
+		split(begin, '\0').first
+	};
+
+	std::string key;
+	for(auto it(index.begin(begin)); bool(it); ++it)
+	{
+		key = std::string(room_id) + std::string(it->first);
+		if(key == end)
+			break;
+
+		db::txn::append
+		{
+			txn, index, db::column::delta
+			{
+				db::op::DELETE, key
+			}
+		};
+	}
+
+	txn();
+}
+
+extern "C" size_t
+state__rebuild_present(const m::room &room)
+{
+	room_job job;
+	job.room_id = std::string(room.room_id);
+	while(job_rebuild_present(job));
+	return job.count;
+}
+
+extern "C" size_t
+state__rebuild_history(const m::room &room)
+{
+	room_job job;
+	job.room_id = std::string(room.room_id);
+	while(job_rebuild_history(job));
+	return job.count;
+}
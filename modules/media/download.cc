@@ -37,6 +37,24 @@ get__download_local(client &client,
                     const string_view &file,
                     const m::room &room);
 
+static resource::response
+get__download_remote(client &client,
+                     const resource::request &request,
+                     const string_view &server,
+                     const string_view &file,
+                     const m::user::id &user_id,
+                     const m::room::id &room_id);
+
+static bool
+match_etag(const string_view &header,
+           const string_view &etag);
+
+static bool
+parse_range(const string_view &header,
+            const size_t &file_size,
+            size_t &off,
+            size_t &len);
+
 static resource::response
 get__download(client &client,
               const resource::request &request)
@@ -68,12 +86,97 @@ get__download(client &client,
 
 	const m::room::id::buf room_id
 	{
-		download(server, file, user_id)
+		file_room_id(server, file)
 	};
 
+	// A file not yet in the store is relayed to the client while it is being
+	// fetched. Conditional and partial requests wait for the whole file.
+	const bool relay
+	{
+		!exists(room_id) && !request.head.range && !request.head.if_none_match
+	};
+
+	if(relay)
+		return get__download_remote(client, request, server, file, user_id, room_id);
+
+	download(server, file, user_id, {}, room_id);
 	return get__download_local(client, request, server, file, room_id);
 }
 
+/// Sends the file to the client as its extents are stored by the fetch,
+/// starting as soon as the first one is available. The content-length is
+/// the one given by the remote; if the fetch fails after the head was sent
+/// the client is disconnected short of it.
+static resource::response
+get__download_remote(client &client,
+                     const resource::request &request,
+                     const string_view &server,
+                     const string_view &file,
+                     const m::user::id &user_id,
+                     const m::room::id &room_id)
+{
+	const auto fetch
+	{
+		fetch_attach(server, file, user_id, {}, room_id)
+	};
+
+	fetch->dock.wait([&fetch]
+	{
+		return fetch->finished || !fetch->extents.empty();
+	});
+
+	if(fetch->eptr)
+		std::rethrow_exception(fetch->eptr);
+
+	if(fetch->finished)
+		return get__download_local(client, request, server, file, room_id);
+
+	resource::response
+	{
+		client, http::OK, fetch->content_type, fetch->content_length,
+		"Accept-Ranges: bytes\r\n"_sv
+	};
+
+	size_t sent{0}, i{0};
+	while(sent < fetch->content_length)
+	{
+		fetch->dock.wait([&fetch, &i]
+		{
+			return fetch->finished || i < fetch->extents.size();
+		});
+
+		if(i >= fetch->extents.size())
+			break;
+
+		const std::string hash
+		{
+			fetch->extents.at(i++)
+		};
+
+		blocks(hash, [&client, &sent]
+		(const string_view &extent)
+		{
+			sent += client.write_all(extent);
+		});
+	}
+
+	if(unlikely(sent != fetch->content_length)) log::error
+	{
+		media_log, "File %s/%s [%s] relayed %zu of %zu bytes",
+		server,
+		file,
+		string_view{room_id},
+		sent,
+		fetch->content_length
+	};
+
+	// Have to kill client here after failing content length expectation.
+	if(unlikely(sent != fetch->content_length))
+		client.close(net::dc::RST, net::close_ignore);
+
+	return {};
+}
+
 static resource::response
 get__download_local(client &client,
                     const resource::request &request,
@@ -81,65 +184,167 @@ get__download_local(client &client,
                     const string_view &file,
                     const m::room &room)
 {
-	// Get the file's total size
-	size_t file_size{0};
-	room.get("ircd.file.stat", "size", [&file_size]
-	(const m::event &event)
+	// Get the file's total size and MIME type
+	char type_buf[64];
+	const auto stat
 	{
-		file_size = at<"content"_>(event).get<size_t>("value");
-	});
+		file_stat(type_buf, room)
+	};
 
-	// Get the MIME type
-	char type_buf[64];
-	string_view content_type
+	const size_t &file_size(stat.first);
+	const string_view &content_type(stat.second);
+
+	char etag_buf[64];
+	const string_view etag
 	{
-		"application/octet-stream"
+		file_etag(etag_buf, room)
 	};
 
-	room.get("ircd.file.stat", "type", [&type_buf, &content_type]
-	(const m::event &event)
+	char headers_buf[256];
+	size_t headers_len
 	{
-		const auto &value
+		fmt::sprintf
 		{
-			unquote(at<"content"_>(event).at("value"))
+			headers_buf, "ETag: \"%s\"\r\nAccept-Ranges: bytes\r\n", etag
+		}
+	};
+
+	if(match_etag(request.head.if_none_match, etag))
+		return resource::response
+		{
+			client, http::NOT_MODIFIED, content_type, 0UL,
+			string_view{headers_buf, headers_len}
 		};
 
-		content_type =
+	size_t off{0}, len{file_size};
+	const bool partial
+	{
+		parse_range(request.head.range, file_size, off, len)
+	};
+
+	if(partial)
+		headers_len += fmt::sprintf
 		{
-			type_buf, copy(type_buf, value)
+			mutable_buffer{headers_buf + headers_len, sizeof(headers_buf) - headers_len},
+			"Content-Range: bytes %zu-%zu/%zu\r\n", off, off + len - 1, file_size
 		};
-	});
 
 	// Send HTTP head to client
 	resource::response
 	{
-		client, http::OK, content_type, file_size
+		client, partial? http::PARTIAL_CONTENT : http::OK, content_type, len,
+		string_view{headers_buf, headers_len}
 	};
 
+	// Extents are written directly from their view in the database.
 	size_t sent{0}, read;
-	read = read_each_block(room, [&client, &sent]
-	(const string_view &block)
+	read = read_range(room, off, len, [&client, &sent]
+	(const const_buffer &block)
 	{
-		sent += write_all(*client.sock, block);
+		sent += client.write_all(block);
 	});
 
-	if(unlikely(read != file_size)) log::error
+	if(unlikely(read != len)) log::error
 	{
 		media_log, "File %s/%s [%s] size mismatch: expected %zu got %zu",
 		server,
 		file,
 		string_view{room.room_id},
-		file_size,
+		len,
 		read
 	};
 
 	// Have to kill client here after failing content length expectation.
-	if(unlikely(read != file_size))
+	if(unlikely(read != len))
 		client.close(net::dc::RST, net::close_ignore);
 
 	return {};
 }
 
+/// Tests an If-None-Match header against the ETag of a file. The weak
+/// comparison is used as required for If-None-Match.
+static bool
+match_etag(const string_view &header,
+           const string_view &etag)
+{
+	bool ret{false};
+	tokens(header, ',', [&ret, &etag]
+	(const string_view &token)
+	{
+		const string_view tag
+		{
+			lstrip(strip(token), "W/"_sv, 1)
+		};
+
+		ret |= tag == "*" || unquote(tag) == etag;
+	});
+
+	return ret;
+}
+
+/// Parses a single byte range from a Range header into off and len. Returns
+/// false if there is no range or it is not one that's supported (i.e. more
+/// than one range) in which case the entire file is sent. Throws 416 if the
+/// range can't be satisfied by a file of file_size.
+static bool
+parse_range(const string_view &header,
+            const size_t &file_size,
+            size_t &off,
+            size_t &len)
+{
+	if(!startswith(header, "bytes="))
+		return false;
+
+	const string_view spec
+	{
+		strip(lstrip(header, "bytes="_sv, 1))
+	};
+
+	if(has(spec, ','))
+		return false;
+
+	const auto bound
+	{
+		split(spec, '-')
+	};
+
+	const string_view first(strip(bound.first)), last(strip(bound.second));
+	if((!empty(first) && !try_lex_cast<size_t>(first)) || (!empty(last) && !try_lex_cast<size_t>(last)))
+		return false;
+
+	if(empty(first) && empty(last))
+		return false;
+
+	size_t start, stop;
+	if(empty(first))
+	{
+		// Suffix range: the final `last` bytes
+		const auto suffix(lex_cast<size_t>(last));
+		start = file_size - std::min(suffix, file_size);
+		stop = suffix? file_size : 0;
+	}
+	else
+	{
+		start = lex_cast<size_t>(first);
+		stop = empty(last)? file_size : std::min(lex_cast<size_t>(last) + 1, file_size);
+		if(!empty(last) && lex_cast<size_t>(last) < start)
+			return false;
+	}
+
+	if(start >= stop)
+		throw http::error
+		{
+			http::RANGE_NOT_SATISFIABLE, {}, fmt::snstringf
+			{
+				64, "Content-Range: bytes */%zu\r\n", file_size
+			}
+		};
+
+	off = start;
+	len = stop - start;
+	return true;
+}
+
 static resource::method
 method_get
 {
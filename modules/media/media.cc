@@ -20,8 +20,10 @@ media_blocks_descriptor
 	// explain
 	R"(
 	Key-value store of blocks belonging to files. The key is a hash of
-	the block. The key is plaintext sha256-b58 and the block is binary
-	up to 32768 bytes.
+	the block. The key is plaintext sha256-b58 and the block is binary.
+	Files written with a files record are stored in extents up to the
+	ircd.media.extent.size (1 MiB default); legacy files written as
+	ircd.file.block events have blocks up to 32768 bytes.
 	)",
 
 	// typing
@@ -36,12 +38,41 @@ media_blocks_descriptor
 	64_MiB,  // compressed cache size
 };
 
+// Files column
+const db::database::descriptor
+media_files_descriptor
+{
+	// name
+	"files",
+
+	// explain
+	R"(
+	Key-value store of file metadata. The key is the room_id of the file.
+	The value is a JSON object with the size and content type of the file
+	and an array of the b58 sha256 hashes of the extents which compose its
+	content in order. The extents are values in the blocks column; every
+	extent but the last has the length given by extent_size.
+	)",
+
+	// typing
+	{
+		typeid(string_view), typeid(string_view)
+	},
+
+	{},      // options
+	{},      // comparaor
+	{},      // prefix transform
+	16_MiB,  // cache size
+	0,       // compressed cache size
+};
+
 const db::database::description
 media_description
 {
 	{ "default" }, // requirement of RocksDB
 
 	media_blocks_descriptor,
+	media_files_descriptor,
 };
 
 mapi::header
@@ -53,13 +84,27 @@ IRCD_MODULE
 		static const std::string dbopts;
 		media = std::make_shared<database>("media", dbopts, media_description);
 		blocks = db::column{*media, "blocks"};
+		files = db::column{*media, "files"};
+		thumbnail_pool.add(1);
 	},
 	[] // fini
 	{
 		// The database close contains pthread_join()'s within RocksDB which
 		// deadlock under certain conditions when called during a dlclose()
 		// (i.e static destruction of this module). Therefor we must manually
-		// close the db here first.
+		// close the db here first. Any fetches and thumbnail jobs are
+		// interrupted and their contexts are allowed to unwind before that.
+		for(const auto &p : fetching)
+			if(p.second->worker)
+				ctx::interrupt(*p.second->worker);
+
+		fetching_dock.wait([]
+		{
+			return fetching.empty();
+		});
+
+		thumbnail_pool.interrupt();
+		thumbnail_pool.join();
 		media = std::shared_ptr<database>{};
 	}
 };
@@ -76,11 +121,52 @@ media;
 decltype(blocks)
 blocks;
 
-std::set<m::room::id>
-downloading;
+decltype(files)
+files;
+
+decltype(media_extent_size)
+media_extent_size
+{
+	{ "name",     "ircd.media.extent.size" },
+	{ "default",  long(1_MiB)              },
+};
+
+decltype(media_fetch_window)
+media_fetch_window
+{
+	{ "name",     "ircd.media.fetch.window" },
+	{ "default",  long(64_KiB)              },
+};
+
+decltype(media_fetch_buffer)
+media_fetch_buffer
+{
+	{ "name",     "ircd.media.fetch.buffer" },
+	{ "default",  long(4_MiB)               },
+};
 
-ctx::dock
-downloading_dock;
+decltype(media_fetch_timeout)
+media_fetch_timeout
+{
+	{ "name",     "ircd.media.fetch.timeout" },
+	{ "default",  10L                        },
+};
+
+/// Fetches in progress by the room_id of the file. The key is a view of the
+/// room_id in the fetch.
+decltype(fetching)
+fetching;
+
+/// Notified when a fetch is removed from the map.
+decltype(fetching_dock)
+fetching_dock;
+
+static void
+fetch_worker(fetch &,
+             const string_view &server,
+             const string_view &mediaid,
+             const m::user::id &user_id,
+             const net::hostport &remote);
 
 m::room::id::buf
 download(const string_view &server,
@@ -97,108 +183,153 @@ download(const string_view &server,
 	return room_id;
 }
 
+/// Ensures the file is in the store, fetching it from the remote if not.
+/// Yields until any fetch has finished and propagates its error.
 m::room
 download(const string_view &server,
          const string_view &mediaid,
          const m::user::id &user_id,
          const net::hostport &remote,
          const m::room::id &room_id)
-try
 {
-	auto iit
+	if(exists(room_id))
+		return room_id;
+
+	const auto fetch
 	{
-		downloading.emplace(room_id)
+		fetch_attach(server, mediaid, user_id, remote, room_id)
 	};
 
-	if(!iit.second)
+	fetch->dock.wait([&fetch]
 	{
-		do
-		{
-			downloading_dock.wait();
-		}
-		while(downloading.count(room_id));
-		return room_id;
-	}
+		return fetch->finished;
+	});
 
-	const unwind uw{[&iit]
-	{
-		downloading.erase(iit.first);
-		downloading_dock.notify_all();
-	}};
+	if(fetch->eptr)
+		std::rethrow_exception(fetch->eptr);
 
-	if(exists(room_id))
-		return room_id;
+	return room_id;
+}
 
-	const unique_buffer<mutable_buffer> buf
+/// Returns the fetch for the file, starting one if there is none. The fetch
+/// runs in its own context and continues even if everyone waiting on it goes
+/// away, so a client disconnecting doesn't waste what was already received.
+std::shared_ptr<fetch>
+fetch_attach(const string_view &server,
+             const string_view &mediaid,
+             const m::user::id &user_id,
+             const net::hostport &remote,
+             const m::room::id &room_id)
+{
+	const auto it
 	{
-		16_KiB
+		fetching.find(room_id)
 	};
 
-	const auto pair
-	{
-		download(buf, server, mediaid, remote)
-	};
+	if(it != end(fetching))
+		return it->second;
 
-	const auto &head
+	auto fetch
 	{
-		pair.first
+		std::make_shared<struct fetch>()
 	};
 
-	const const_buffer &content
+	fetch->room_id = room_id;
+	fetching.emplace(m::room::id{fetch->room_id}, fetch);
+	context
 	{
-		pair.second
+		"media fetch", 512_KiB, context::DETACH,
+		[fetch,
+		 server(std::string(server)),
+		 mediaid(std::string(mediaid)),
+		 user_id(std::string(user_id)),
+		 remote(remote? string(remote) : std::string(server))]
+		{
+			fetch->worker = &ctx::cur();
+			const unwind done{[&fetch]
+			{
+				fetch->finished = true;
+				fetch->worker = nullptr;
+				fetching.erase(fetch->room_id);
+				fetching_dock.notify_all();
+				fetch->dock.notify_all();
+			}};
+
+			fetch_worker(*fetch, server, mediaid, m::user::id{user_id}, net::hostport{remote});
+		}
 	};
 
-	char mime_type_buf[64];
-	const auto &content_type
-	{
-		magic::mime(mime_type_buf, content)
-	};
+	return fetch;
+}
 
-	if(content_type != head.content_type) log::warning
+/// Stores one extent of a file being fetched and appends its hash to the
+/// fetch. The first extent also determines the content type.
+static void
+fetch_store(fetch &fetch,
+            const const_buffer &content,
+            const net::hostport &remote,
+            const string_view &mediaid)
+{
+	if(fetch.extents.empty())
 	{
-		media_log, "Server %s claims thumbnail %s is '%s' but we think it is '%s'",
-		string(remote),
-		mediaid,
-		head.content_type,
-		content_type
-	};
+		char mime_type_buf[64];
+		const string_view &content_type
+		{
+			magic::mime(mime_type_buf, content)
+		};
 
-	m::vm::copts vmopts;
-	vmopts.history = false;
-	const m::room room
-	{
-		room_id, &vmopts
-	};
+		if(content_type != fetch.content_type) log::warning
+		{
+			media_log, "Server %s claims file %s is '%s' but we think it is '%s'",
+			string(remote),
+			mediaid,
+			fetch.content_type,
+			content_type
+		};
 
-	create(room, user_id, "file");
+		fetch.content_type = std::string(content_type);
+	}
 
-	const size_t written
+	char b58buf[b58encode_size(sha256::digest_size)];
+	const sha256::buf hash
 	{
-		write_file(room, user_id, content, content_type)
+		sha256{content}
 	};
 
-	return room;
-}
-catch(const ircd::server::unavailable &e)
-{
-	throw http::error
+	const string_view b58hash
 	{
-		http::BAD_GATEWAY, e.what()
+		b58encode(b58buf, hash)
 	};
+
+	if(!has(blocks, b58hash))
+		block_set(b58hash, content);
+
+	fetch.extents.emplace_back(b58hash);
+	fetch.stored += size(content);
+	fetch.dock.notify_all();
 }
 
-std::pair<http::response::head, unique_buffer<mutable_buffer>>
-download(const mutable_buffer &head_buf,
-         const string_view &server,
-         const string_view &mediaid,
-         net::hostport remote,
-         server::request::opts *const opts)
+/// Receives the file from the remote through a window no larger than
+/// ircd.media.fetch.window and stores it one extent at a time as the data
+/// arrives. The files record is written and the file room is created only
+/// once all of the content is stored; until then the file does not exist
+/// to anyone not attached to the fetch. No more than ircd.media.fetch.buffer
+/// is held waiting to be stored; a fetch which falls further behind the
+/// remote than that is abandoned.
+static void
+fetch_worker(fetch &fetch,
+             const string_view &server,
+             const string_view &mediaid,
+             const m::user::id &user_id,
+             const net::hostport &remote)
+try
 {
-	if(!remote)
-		remote = server;
+	const unique_buffer<mutable_buffer> buf
+	{
+		16_KiB
+	};
 
-	window_buffer wb{head_buf};
+	window_buffer wb{buf};
 	thread_local char uri[4_KiB];
 	http::request
 	{
@@ -216,85 +347,563 @@ download(const mutable_buffer &head_buf,
 	// Remaining space in buffer is used for received head
 	const mutable_buffer in_head
 	{
-		data(head_buf) + size(out_head), size(head_buf) - size(out_head)
+		data(buf) + size(out_head), size(buf) - size(out_head)
 	};
 
-	//TODO: --- This should use the progress callback to build blocks
-	// Null content buffer will cause dynamic allocation internally.
-	const mutable_buffer in_content{};
-	server::request remote_request
+	const unique_buffer<mutable_buffer> window
 	{
-		remote, { out_head }, { in_head, in_content }, opts
+		std::max(size_t(media_fetch_window), size_t(4_KiB))
 	};
 
-	//TODO: conf
-	if(!remote_request.wait(seconds(10), std::nothrow))
-		throw http::error
+	const size_t extent_size
+	{
+		std::max(size_t(media_extent_size), size_t(32_KiB))
+	};
+
+	// Content is handed from the server engine to this context through a
+	// queue of extents. The progress callback runs on the event loop outside
+	// of any context, so it only copies and notifies; hashing, sniffing and
+	// the database writes all happen on this context.
+	std::deque<std::string> staged;
+	std::string partial;
+	size_t staged_bytes{0}, received{0};
+	ctx::dock dock;
+
+	const size_t staged_max
+	{
+		std::max(size_t(media_fetch_buffer), 2 * extent_size)
+	};
+
+	bool headed{false}, failed{false}, overrun{false};
+	server::request::opts opts;
+	opts.content_window = true;
+	opts.http_exceptions = false;
+	server::request remote_request;
+	const auto progress{[&](const_buffer chunk, const const_buffer &) noexcept
+	{
+		if(failed)
+			return;
+
+		try
+		{
+			if(!headed)
+			{
+				headed = true;
+				parse::buffer pb{remote_request.in.head};
+				parse::capstan pc{pb};
+				pc.read += size(remote_request.in.head);
+				const http::response::head head{pc};
+				if(http::status(head.status) != http::OK)
+				{
+					failed = true;
+					return;
+				}
+
+				fetch.content_type = std::string(head.content_type);
+				fetch.content_length = head.content_length;
+			}
+
+			received += size(chunk);
+			staged_bytes += size(chunk);
+			while(!empty(chunk))
+			{
+				const size_t copied
+				{
+					std::min(size(chunk), extent_size - size(partial))
+				};
+
+				partial.append(data(chunk), copied);
+				consume(chunk, copied);
+				if(size(partial) == extent_size)
+				{
+					staged.emplace_back(std::move(partial));
+					partial = std::string{};
+					dock.notify_all();
+				}
+			}
+
+			if(staged_bytes > staged_max)
+			{
+				failed = true;
+				overrun = true;
+				dock.notify_all();
+			}
+		}
+		catch(...)
+		{
+			failed = true;
+			fetch.eptr = std::current_exception();
+			dock.notify_all();
+		}
+	}};
+
+	remote_request = server::request
+	{
+		remote, { out_head }, { in_head, window, progress }, &opts
+	};
+
+	// Wakes this context when the request completes or fails outright,
+	// which the progress callback never sees.
+	remote_request.state().then = [&dock](ctx::shared_state_base &)
+	{
+		dock.notify_all();
+	};
+
+	const auto pending{[&remote_request]
+	{
+		return ctx::is(remote_request.state(), ctx::future_state::PENDING);
+	}};
+
+	// The request only times out when nothing has been received for the
+	// duration; a large file on a slow link is allowed to take its time.
+	size_t last{0};
+	while(pending() || !staged.empty())
+	{
+		const bool woke
 		{
-			http::REQUEST_TIMEOUT
+			dock.wait_for(seconds(media_fetch_timeout), [&]
+			{
+				return !staged.empty() || overrun || fetch.eptr || !pending();
+			})
 		};
 
-	const auto &code
+		if(fetch.eptr)
+			std::rethrow_exception(fetch.eptr);
+
+		if(overrun)
+			throw http::error
+			{
+				http::SERVICE_UNAVAILABLE, fmt::snstringf
+				{
+					256, "Fetch from %s fell behind the remote",
+					string(remote)
+				}
+			};
+
+		if(!woke && received == last)
+			throw http::error
+			{
+				http::REQUEST_TIMEOUT
+			};
+
+		last = received;
+		while(!staged.empty())
+		{
+			const std::string extent
+			{
+				std::move(staged.front())
+			};
+
+			staged.pop_front();
+			staged_bytes -= size(extent);
+			fetch_store(fetch, extent, remote, mediaid);
+		}
+	}
+
+	// A non-2xx from the remote is relayed to the client as-is.
+	const http::code code
 	{
 		remote_request.get()
 	};
 
 	if(code != http::OK)
-		return {};
+		throw http::error
+		{
+			code, fmt::snstringf
+			{
+				256, "Remote %s responded with %u",
+				string(remote),
+				uint(code)
+			}
+		};
+
+	if(fetch.eptr)
+		std::rethrow_exception(fetch.eptr);
+
+	if(!empty(partial))
+		fetch_store(fetch, partial, remote, mediaid);
+
+	if(unlikely(failed || fetch.stored != fetch.content_length))
+		throw http::error
+		{
+			http::BAD_GATEWAY, fmt::snstringf
+			{
+				256, "Received %zu of %zu bytes from %s",
+				fetch.stored,
+				fetch.content_length,
+				string(remote)
+			}
+		};
+
+	std::vector<json::value> hashes(fetch.extents.size());
+	std::transform(begin(fetch.extents), end(fetch.extents), begin(hashes), []
+	(const std::string &hash)
+	{
+		return json::value{string_view{hash}, json::STRING};
+	});
+
+	const json::strung record
+	{
+		json::members
+		{
+			{ "size",         long(fetch.content_length)                  },
+			{ "type",         fetch.content_type                          },
+			{ "extent_size",  long(extent_size)                           },
+			{ "extents",      json::value{hashes.data(), hashes.size()}   },
+		}
+	};
+
+	write(files, fetch.room_id, record);
+
+	m::vm::copts vmopts;
+	vmopts.history = false;
+	const m::room room
+	{
+		fetch.room_id, &vmopts
+	};
 
-	parse::buffer pb{remote_request.in.head};
-	parse::capstan pc{pb};
-	pc.read += size(remote_request.in.head);
-	return
+	create(room, user_id, "file");
+}
+catch(const ircd::server::unavailable &e)
+{
+	fetch.eptr = std::make_exception_ptr(http::error
 	{
-		http::response::head{pc}, std::move(remote_request.in.dynamic)
+		http::BAD_GATEWAY, e.what()
+	});
+}
+catch(const std::exception &e)
+{
+	log::derror
+	{
+		media_log, "Fetching %s/%s from %s :%s",
+		server,
+		mediaid,
+		string(remote),
+		e.what()
 	};
+
+	fetch.eptr = std::current_exception();
 }
 
+/// Writes the content of a file as extents in the blocks column and a
+/// record of the file in the files column, all in a single transaction.
+/// Returns the number of bytes of content.
 size_t
 write_file(const m::room &room,
            const m::user::id &user_id,
            const const_buffer &content,
            const string_view &content_type)
 {
-	//TODO: TXN
-	send(room, user_id, "ircd.file.stat", "size",
+	return write_record(room.room_id, content, content_type);
+}
+
+/// Writes content as extents in the blocks column and a record under `key`
+/// in the files column. Extents are content-addressed so one which already
+/// exists is not written again. Returns the number of bytes of content.
+size_t
+write_record(const string_view &key,
+             const const_buffer &content,
+             const string_view &content_type)
+{
+	static constexpr const auto hashsz
 	{
-		{ "value", long(size(content)) }
-	});
+		b58encode_size(sha256::digest_size)
+	};
 
-	//TODO: TXN
-	send(room, user_id, "ircd.file.stat", "type",
+	const size_t extent_size
 	{
-		{ "value", content_type }
-	});
+		std::max(size_t(media_extent_size), size_t(32_KiB))
+	};
+
+	const size_t extents
+	{
+		(size(content) + extent_size - 1) / extent_size
+	};
+
+	std::vector<json::value> hashes(extents);
+	const unique_buffer<mutable_buffer> hashbuf
+	{
+		std::max(extents * hashsz, size_t(1))
+	};
 
-	size_t off{0}, wrote{0};
-	while(off < size(content))
+	db::txn txn
 	{
-		const size_t blksz
+		*media
+	};
+
+	size_t off{0}, i{0};
+	for(; off < size(content); ++i)
+	{
+		const size_t extsz
 		{
-			std::min(size(content) - off, size_t(32_KiB))
+			std::min(size(content) - off, extent_size)
 		};
 
-		const const_buffer &block
+		const const_buffer extent
 		{
-			data(content) + off, blksz
+			data(content) + off, extsz
 		};
 
-		block_set(room, user_id, block);
-		wrote += size(block);
-		off += blksz;
+		const sha256::buf hash
+		{
+			sha256{extent}
+		};
+
+		const string_view b58hash
+		{
+			b58encode(mutable_buffer{data(hashbuf) + i * hashsz, hashsz}, hash)
+		};
+
+		if(!has(blocks, b58hash))
+			db::txn::append
+			{
+				txn, blocks, db::column::delta
+				{
+					db::op::SET, b58hash, extent
+				}
+			};
+
+		hashes.at(i) = json::value{b58hash, json::STRING};
+		off += extsz;
 	}
 
 	assert(off == size(content));
-	assert(wrote == off);
-	return wrote;
+	assert(i == extents);
+	const json::strung record
+	{
+		json::members
+		{
+			{ "size",         long(size(content))                         },
+			{ "type",         content_type                                },
+			{ "extent_size",  long(extent_size)                           },
+			{ "extents",      json::value{hashes.data(), hashes.size()}   },
+		}
+	};
+
+	db::txn::append
+	{
+		txn, files, db::column::delta
+		{
+			db::op::SET, key, record
+		}
+	};
+
+	txn();
+	return off;
 }
 
+/// Content of a file is passed to the closure in order, one extent (or one
+/// block for a legacy file) at a time. Returns the number of bytes read.
 size_t
 read_each_block(const m::room &room,
                 const std::function<void (const const_buffer &)> &closure)
+{
+	bool found;
+	const std::string record
+	{
+		read(files, room.room_id, found)
+	};
+
+	if(!found)
+		return read_each_block_legacy(room, closure);
+
+	return read_each_extent(record, closure);
+}
+
+/// Content of the file described by a files record is passed to the closure
+/// in order one extent at a time. The extent is viewed directly out of the
+/// database for the duration of the closure. Returns the number of bytes.
+size_t
+read_each_extent(const json::object &file,
+                 const std::function<void (const const_buffer &)> &closure)
+{
+	const size_t extent_size
+	{
+		file.get<size_t>("extent_size")
+	};
+
+	const size_t file_size
+	{
+		file.get<size_t>("size")
+	};
+
+	size_t ret{0};
+	for(const string_view &hash : json::array(file["extents"]))
+		blocks(unquote(hash), [&](const string_view &extent)
+		{
+			const size_t expect
+			{
+				std::min(extent_size, file_size - ret)
+			};
+
+			if(unlikely(size(extent) != expect)) throw error
+			{
+				"Extent [%s] size %zu != %zu",
+				unquote(hash),
+				size(extent),
+				expect
+			};
+
+			ret += size(extent);
+			closure(extent);
+		});
+
+	return ret;
+}
+
+/// Content of a file from byte offset `off` for up to `len` bytes is passed
+/// to the closure in order. Extents are viewed directly out of the database
+/// without copying and extents before `off` are not read at all. Legacy
+/// files are read through read_each_block_legacy() and trimmed to the range.
+/// Returns the number of bytes passed to the closure.
+size_t
+read_range(const m::room &room,
+           const size_t &off,
+           const size_t &len,
+           const std::function<void (const const_buffer &)> &closure)
+{
+	bool found;
+	const std::string record
+	{
+		read(files, room.room_id, found)
+	};
+
+	size_t ret{0}, pos{0};
+	const auto sink{[&off, &len, &closure, &ret, &pos]
+	(const const_buffer &block)
+	{
+		const size_t base(pos);
+		pos += size(block);
+
+		const size_t start(std::max(off, base));
+		const size_t stop(std::min(off + len, pos));
+		if(start >= stop)
+			return;
+
+		const const_buffer part
+		{
+			data(block) + (start - base), stop - start
+		};
+
+		ret += size(part);
+		closure(part);
+	}};
+
+	if(!found)
+	{
+		read_each_block_legacy(room, sink);
+		return ret;
+	}
+
+	const json::object file
+	{
+		record
+	};
+
+	const size_t extent_size
+	{
+		file.get<size_t>("extent_size")
+	};
+
+	size_t i{0};
+	pos = (off / extent_size) * extent_size;
+	for(const string_view &hash : json::array(file["extents"]))
+	{
+		if(i++ < off / extent_size)
+			continue;
+
+		if(pos >= off + len)
+			break;
+
+		blocks(unquote(hash), sink);
+	}
+
+	return ret;
+}
+
+/// Strong entity tag for the content of a file. For files with a record this
+/// is a hash of the ordered extent hashes; legacy files are immutable and
+/// identified by their room.
+string_view
+file_etag(const mutable_buffer &out,
+          const m::room &room)
+{
+	bool found;
+	const std::string record
+	{
+		read(files, room.room_id, found)
+	};
+
+	const string_view &content
+	{
+		found?
+			json::object{record}.get("extents"):
+			string_view{room.room_id}
+	};
+
+	const sha256::buf hash
+	{
+		sha256{content}
+	};
+
+	return b58encode(out, hash);
+}
+
+/// Size and content type of a file. The type is copied into typebuf; a file
+/// without a type is application/octet-stream.
+std::pair<size_t, string_view>
+file_stat(const mutable_buffer &typebuf,
+          const m::room &room)
+{
+	std::pair<size_t, string_view> ret
+	{
+		0, "application/octet-stream"
+	};
+
+	bool found;
+	const std::string record
+	{
+		read(files, room.room_id, found)
+	};
+
+	if(!found)
+	{
+		room.get(std::nothrow, "ircd.file.stat", "size", [&ret]
+		(const m::event &event)
+		{
+			ret.first = at<"content"_>(event).get<size_t>("value");
+		});
+
+		room.get(std::nothrow, "ircd.file.stat", "type", [&typebuf, &ret]
+		(const m::event &event)
+		{
+			const auto &value
+			{
+				unquote(at<"content"_>(event).at("value"))
+			};
+
+			ret.second = { data(typebuf), copy(typebuf, value) };
+		});
+
+		return ret;
+	}
+
+	const json::object file
+	{
+		record
+	};
+
+	ret.first = file.get<size_t>("size");
+	if(file.has("type"))
+		ret.second = { data(typebuf), copy(typebuf, unquote(file["type"])) };
+
+	return ret;
+}
+
+/// Reader for files written as an ircd.file.block event for each block.
+size_t
+read_each_block_legacy(const m::room &room,
+                       const std::function<void (const const_buffer &)> &closure)
 {
 	// Block buffer
 	const unique_buffer<mutable_buffer> buf
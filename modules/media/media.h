@@ -14,6 +14,9 @@ extern mapi::header IRCD_MODULE;
 extern log::log media_log;
 extern std::shared_ptr<db::database> media;
 extern db::column blocks;
+extern db::column files;
+extern conf::item<size_t> media_extent_size;
+extern ctx::pool thumbnail_pool;
 
 extern "C" m::room::id
 file_room_id(m::room::id::buf &out,
@@ -45,18 +48,84 @@ extern "C" size_t
 read_each_block(const m::room &,
                 const std::function<void (const const_buffer &)> &);
 
+size_t
+read_each_extent(const json::object &file,
+                 const std::function<void (const const_buffer &)> &);
+
+size_t
+read_each_block_legacy(const m::room &,
+                       const std::function<void (const const_buffer &)> &);
+
+extern "C" size_t
+read_range(const m::room &,
+           const size_t &off,
+           const size_t &len,
+           const std::function<void (const const_buffer &)> &);
+
+std::pair<size_t, string_view>
+file_stat(const mutable_buffer &typebuf,
+          const m::room &);
+
+string_view
+file_etag(const mutable_buffer &out,
+          const m::room &);
+
 extern "C" size_t
 write_file(const m::room &,
            const m::user::id &,
            const const_buffer &content,
            const string_view &content_type);
 
-std::pair<http::response::head, unique_buffer<mutable_buffer>>
-download(const mutable_buffer &head_buf,
-         const string_view &server,
-         const string_view &mediaid,
-         net::hostport remote = {},
-         server::request::opts *const opts = nullptr);
+size_t
+write_record(const string_view &key,
+             const const_buffer &content,
+             const string_view &content_type);
+
+string_view
+thumbnail_key(const mutable_buffer &out,
+              const m::room::id &,
+              const magick::dimensions &,
+              const string_view &method);
+
+bool
+thumbnail_generate(const m::room &,
+                   const magick::dimensions &,
+                   const string_view &method);
+
+void
+thumbnail_pregenerate(const m::room &);
+
+/// State of a remote file being fetched into the store. There is at most one
+/// for any file; everyone requesting the file while it is being fetched
+/// attaches to it rather than making another request to the remote. Extents
+/// are stored as they are received and their hashes are appended here so a
+/// waiter can relay content before the fetch has finished. The dock is
+/// notified for every extent and when the fetch finishes.
+struct fetch
+{
+	m::room::id::buf room_id;
+	std::string content_type;
+	size_t content_length {0};
+	size_t stored {0};
+	std::vector<std::string> extents;
+	std::exception_ptr eptr;
+	ctx::ctx *worker {nullptr};
+	bool finished {false};
+	ctx::dock dock;
+};
+
+extern std::map<m::room::id, std::shared_ptr<fetch>> fetching;
+extern ctx::dock fetching_dock;
+extern conf::item<size_t> media_fetch_window;
+extern conf::item<size_t> media_fetch_buffer;
+extern conf::item<seconds> media_fetch_timeout;
+
+std::shared_ptr<fetch>
+fetch_attach(const string_view &server,
+             const string_view &mediaid,
+             const m::user::id &user_id,
+             const net::hostport &remote,
+             const m::room::id &room_id);
 
 m::room
 download(const string_view &server,
@@ -8,12 +8,6 @@
 // copyright notice and this permission notice is present in all copies. The
 // full license for this software is available in the LICENSE file.
 
-#include <boost/gil/image.hpp>
-#include <boost/gil/typedefs.hpp>
-// #include <boost/gil/extension/io/jpeg_io.hpp>
-// #include <boost/gil/extension/numeric/sampler.hpp>
-// #include <boost/gil/extension/numeric/resample.hpp>
-
 #include "media.h"
 
 resource
@@ -43,6 +37,43 @@ get__thumbnail_local(client &client,
                      const string_view &file,
                      const m::room &room);
 
+static resource::response
+get__thumbnail_cached(client &client,
+                      const resource::request &request,
+                      const string_view &key);
+
+static magick::dimensions
+thumbnail_dimensions(const magick::dimensions &);
+
+conf::item<std::string>
+thumbnail_sizes
+{
+	{ "name",     "ircd.media.thumbnail.sizes"      },
+	{ "default",  "32x32 96x96 320x240 640x480 800x600" },
+};
+
+conf::item<std::string>
+thumbnail_pregenerate_sizes
+{
+	{ "name",     "ircd.media.thumbnail.pregenerate" },
+	{ "default",  "32x32 96x96"                      },
+};
+
+/// Derived images generated outside of a request (i.e pregeneration after an
+/// upload) are made here so no client request context is held for them.
+ctx::pool
+thumbnail_pool
+{
+	"media.thumb", 1_MiB
+};
+
+conf::item<size_t>
+thumbnail_maxsize
+{
+	{ "name",     "ircd.media.thumbnail.maxsize" },
+	{ "default",  long(32_MiB)                   },
+};
+
 resource::response
 get__thumbnail(client &client,
                const resource::request &request)
@@ -105,34 +136,67 @@ get__thumbnail_local(client &client,
                      const string_view &mediaid,
                      const m::room &room)
 {
-	// Get the file's total size
-	size_t file_size{0};
-	room.get("ircd.file.stat", "size", [&file_size]
-	(const m::event &event)
+	const magick::dimensions dim
 	{
-		file_size = at<"content"_>(event).get<size_t>("value");
-	});
+		thumbnail_dimensions(
+		{
+			request.query.get<uint16_t>("width", 96),
+			request.query.get<uint16_t>("height", 96),
+		})
+	};
 
-	// Get the MIME type
-	char type_buf[64];
-	string_view content_type
+	const string_view &method
 	{
-		"application/octet-stream"
+		request.query["method"] == "crop"? "crop"_sv : "scale"_sv
 	};
 
-	room.get("ircd.file.stat", "type", [&type_buf, &content_type]
-	(const m::event &event)
+	char keybuf[256];
+	const string_view key
 	{
-		const auto &value
-		{
-			unquote(at<"content"_>(event).at("value"))
-		};
+		thumbnail_key(keybuf, room.room_id, dim, method)
+	};
+
+	// The derived image is generated on the first request for it; if it
+	// can't be generated for any reason the original is served instead.
+	bool cached
+	{
+		has(files, key)
+	};
 
-		content_type =
+	if(!cached) try
+	{
+		cached = thumbnail_generate(room, dim, method);
+	}
+	catch(const ctx::interrupted &)
+	{
+		throw;
+	}
+	catch(const std::exception &e)
+	{
+		log::derror
 		{
-			type_buf, copy(type_buf, value)
+			media_log, "Thumbnail %s/%s %ux%u %s :%s",
+			hostname,
+			mediaid,
+			dim.width,
+			dim.height,
+			method,
+			e.what()
 		};
-	});
+	}
+
+	if(cached)
+		return get__thumbnail_cached(client, request, key);
+
+	// Get the file's total size and MIME type
+	char type_buf[64];
+	const auto stat
+	{
+		file_stat(type_buf, room)
+	};
+
+	const size_t &file_size(stat.first);
+	const string_view &content_type(stat.second);
 
 	// Send HTTP head to client
 	const resource::response response
@@ -169,3 +233,205 @@ get__thumbnail_local(client &client,
 	assert(read_size == sent_size);
 	return response;
 }
+
+static resource::response
+get__thumbnail_cached(client &client,
+                      const resource::request &request,
+                      const string_view &key)
+{
+	const std::string record
+	{
+		read(files, key)
+	};
+
+	const json::object file
+	{
+		record
+	};
+
+	const size_t &file_size
+	{
+		file.get<size_t>("size")
+	};
+
+	const resource::response response
+	{
+		client, http::OK, unquote(file.get("type")), file_size
+	};
+
+	size_t sent_size{0};
+	const size_t read_size
+	{
+		read_each_extent(file, [&client, &sent_size]
+		(const const_buffer &extent)
+		{
+			sent_size += client.write_all(extent);
+		})
+	};
+
+	if(unlikely(read_size != file_size))
+		client.close(net::dc::RST, net::close_ignore);
+
+	return response;
+}
+
+/// Generates the derived image of a file and stores it in the files column
+/// under its thumbnail_key(). The decode, resize and encode are offloaded
+/// to a worker thread. Returns false if the file isn't an image which can
+/// be thumbnailed.
+bool
+thumbnail_generate(const m::room &room,
+                   const magick::dimensions &dim,
+                   const string_view &method)
+{
+	char type_buf[64];
+	const auto stat
+	{
+		file_stat(type_buf, room)
+	};
+
+	const size_t &file_size(stat.first);
+	const string_view &content_type(stat.second);
+	if(!startswith(content_type, "image/") || file_size > size_t(thumbnail_maxsize))
+		return false;
+
+	const unique_buffer<mutable_buffer> buf
+	{
+		file_size
+	};
+
+	size_t copied{0};
+	read_each_block(room, [&buf, &copied]
+	(const const_buffer &block)
+	{
+		copied += copy(mutable_buffer{data(buf) + copied, size(buf) - copied}, block);
+	});
+
+	const const_buffer content
+	{
+		data(buf), copied
+	};
+
+	// Photographs stay JPEG; everything else (i.e with transparency) is PNG.
+	const bool jpeg
+	{
+		content_type == "image/jpeg"
+	};
+
+	std::string out;
+	const auto result{[&out](const const_buffer &image)
+	{
+		out.assign(data(image), size(image));
+	}};
+
+	ctx::offload([&content, &dim, &method, &jpeg, &result]
+	{
+		const string_view format
+		{
+			jpeg? "JPEG"_sv : "PNG"_sv
+		};
+
+		if(method == "crop")
+			magick::crop(content, dim, format, result);
+		else
+			magick::scale(content, dim, format, result);
+	});
+
+	char keybuf[256];
+	write_record(thumbnail_key(keybuf, room.room_id, dim, method), out, jpeg? "image/jpeg" : "image/png");
+	return true;
+}
+
+/// Generates the derived images listed in ircd.media.thumbnail.pregenerate
+/// (cropped, i.e avatars) for a newly stored file. Errors are logged.
+void
+thumbnail_pregenerate(const m::room &room)
+{
+	tokens(thumbnail_pregenerate_sizes, ' ', [&room]
+	(const string_view &token)
+	{
+		const auto wh
+		{
+			split(token, 'x')
+		};
+
+		if(!try_lex_cast<uint16_t>(wh.first) || !try_lex_cast<uint16_t>(wh.second))
+			return;
+
+		const magick::dimensions dim
+		{
+			thumbnail_dimensions({lex_cast<uint16_t>(wh.first), lex_cast<uint16_t>(wh.second)})
+		};
+
+		try
+		{
+			thumbnail_generate(room, dim, "crop");
+		}
+		catch(const ctx::interrupted &)
+		{
+			throw;
+		}
+		catch(const std::exception &e)
+		{
+			log::derror
+			{
+				media_log, "Thumbnail pregenerate %s for %s :%s",
+				token,
+				string_view{room.room_id},
+				e.what()
+			};
+		}
+	});
+}
+
+string_view
+thumbnail_key(const mutable_buffer &out,
+              const m::room::id &room_id,
+              const magick::dimensions &dim,
+              const string_view &method)
+{
+	return fmt::sprintf
+	{
+		out, "%s/thumbnail/%ux%u/%s",
+		string_view{room_id},
+		dim.width,
+		dim.height,
+		method
+	};
+}
+
+/// The requested dimensions are snapped to the smallest size in
+/// ircd.media.thumbnail.sizes which is at least as large in both axes (or
+/// the largest size) so the number of derived images per file is bounded.
+static magick::dimensions
+thumbnail_dimensions(const magick::dimensions &want)
+{
+	magick::dimensions ret, largest;
+	tokens(thumbnail_sizes, ' ', [&want, &ret, &largest]
+	(const string_view &token)
+	{
+		const auto wh
+		{
+			split(token, 'x')
+		};
+
+		if(!try_lex_cast<uint16_t>(wh.first) || !try_lex_cast<uint16_t>(wh.second))
+			return;
+
+		const magick::dimensions dim
+		{
+			lex_cast<uint16_t>(wh.first), lex_cast<uint16_t>(wh.second)
+		};
+
+		if(uint(dim.width) * dim.height > uint(largest.width) * largest.height)
+			largest = dim;
+
+		if(dim.width < want.width || dim.height < want.height)
+			return;
+
+		if(!ret.width || uint(dim.width) * dim.height < uint(ret.width) * ret.height)
+			ret = dim;
+	});
+
+	return ret.width? ret : largest.width? largest : want;
+}
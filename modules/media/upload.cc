@@ -100,13 +100,22 @@ post__upload(client &client,
 		filename
 	};
 
-	return resource::response
+	resource::response response
 	{
 		client, http::CREATED, json::members
 		{
 			{ "content_uri", content_uri }
 		}
 	};
+
+	// Avatar sizes are generated after the client has its response.
+	if(startswith(content_type, "image/"))
+		thumbnail_pool([room_id(m::room::id::buf{room.room_id})]
+		{
+			thumbnail_pregenerate(m::room{room_id});
+		});
+
+	return response;
 }
 
 static const struct resource::method::opts
@@ -0,0 +1,311 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2018 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+using namespace ircd;
+
+static void save();
+static void load();
+static void persist_worker();
+static void init();
+static void fini();
+
+extern conf::item<bool> persist_enable;
+extern conf::item<seconds> persist_interval;
+extern std::shared_ptr<db::database> dns_db;
+extern db::column dns_cache;
+extern std::unique_ptr<ctx::context> persist_context;
+
+mapi::header
+IRCD_MODULE
+{
+	"Domain Name System cache persistence", init, fini
+};
+
+decltype(persist_enable)
+persist_enable
+{
+	{ "name",     "ircd.net.dns.cache.persist" },
+	{ "default",  true                         },
+};
+
+decltype(persist_interval)
+persist_interval
+{
+	{ "name",     "ircd.net.dns.cache.persist_interval" },
+	{ "default",  300L                                  },
+};
+
+// Cache column
+const db::database::descriptor
+dns_cache_descriptor
+{
+	// name
+	"cache",
+
+	// explain
+	R"(
+	Key-value store of the DNS cache so it survives a restart. The key is
+	the record type, a space, and the cache key: the hostname for A records
+	and the full service name for SRV records. The value is a JSON array of
+	the records with their absolute expiration time as the ttl; expired
+	records are not restored.
+	)",
+
+	// typing
+	{
+		typeid(string_view), typeid(string_view)
+	},
+
+	{},      // options
+	{},      // comparaor
+	{},      // prefix transform
+	1_MiB,   // cache size
+	0,       // compressed cache size
+};
+
+const db::database::description
+dns_description
+{
+	{ "default" }, // requirement of RocksDB
+
+	dns_cache_descriptor,
+};
+
+decltype(dns_db)
+dns_db;
+
+decltype(dns_cache)
+dns_cache;
+
+decltype(persist_context)
+persist_context;
+
+void
+init()
+{
+	if(!persist_enable)
+		return;
+
+	static const std::string dbopts;
+	dns_db = std::make_shared<db::database>("dns", dbopts, dns_description);
+	dns_cache = db::column{*dns_db, "cache"};
+	load();
+
+	persist_context = std::make_unique<ctx::context>
+	(
+		"dns persist", 256_KiB, &persist_worker, ctx::context::POST
+	);
+}
+
+void
+fini()
+{
+	if(!dns_db)
+		return;
+
+	persist_context.reset();
+	save();
+
+	// Close the database here rather than during static destruction; see
+	// the media module.
+	dns_cache = {};
+	dns_db = std::shared_ptr<db::database>{};
+}
+
+void
+persist_worker()
+{
+	while(1)
+	{
+		ctx::sleep(seconds(persist_interval));
+		save();
+	}
+}
+
+/// Writes every unexpired entry in the cache.
+void
+save()
+try
+{
+	const auto now(ircd::time());
+	db::txn txn
+	{
+		*dns_db
+	};
+
+	// The cache is a multimap so each key's run of records is gathered
+	// into one array.
+	std::vector<json::strung> records;
+	const auto append{[&txn, &records](const string_view &type,
+	                                   const string_view &key)
+	{
+		if(records.empty())
+			return;
+
+		std::vector<json::value> values;
+		values.reserve(records.size());
+		for(const auto &record : records)
+			values.emplace_back(record, json::OBJECT);
+
+		const json::strung array
+		{
+			json::value{values.data(), values.size()}
+		};
+
+		thread_local char buf[512];
+		const string_view cellkey
+		{
+			fmt::sprintf{buf, "%s %s", type, key}
+		};
+
+		db::txn::append
+		{
+			txn, dns_cache, db::column::delta
+			{
+				db::op::SET, cellkey, array
+			}
+		};
+	}};
+
+	const auto &A(net::dns::cache.A);
+	for(auto it(begin(A)); it != end(A); )
+	{
+		const auto &key(it->first);
+		for(records.clear(); it != end(A) && it->first == key; ++it)
+			if(it->second.ttl > now)
+				records.emplace_back(json::members
+				{
+					{ "ttl",  long(it->second.ttl)  },
+					{ "ip4",  long(it->second.ip4)  },
+				});
+
+		append("A", key);
+	}
+
+	const auto &SRV(net::dns::cache.SRV);
+	for(auto it(begin(SRV)); it != end(SRV); )
+	{
+		const auto &key(it->first);
+		for(records.clear(); it != end(SRV) && it->first == key; ++it)
+			if(it->second.ttl > now)
+				records.emplace_back(json::members
+				{
+					{ "ttl",       long(it->second.ttl)       },
+					{ "priority",  long(it->second.priority)  },
+					{ "weight",    long(it->second.weight)    },
+					{ "port",      long(it->second.port)      },
+					{ "tgt",       it->second.tgt             },
+				});
+
+		append("SRV", key);
+	}
+
+	txn();
+	log::debug
+	{
+		"Saved %zu DNS cache keys", txn.size()
+	};
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		"Failed to save the DNS cache :%s", e.what()
+	};
+}
+
+/// Restores unexpired entries into the cache and erases the rest.
+void
+load()
+{
+	const auto now(ircd::time());
+	db::txn txn
+	{
+		*dns_db
+	};
+
+	size_t count(0);
+	for(auto it(dns_cache.begin()); bool(it); ++it)
+	{
+		const auto &type(token(it->first, ' ', 0));
+		const auto &key(tokens_after(it->first, ' ', 0));
+		const json::array records
+		{
+			it->second
+		};
+
+		// Entries resolved since startup are newer than what was saved.
+		if(net::dns::cache.A.count(key) || net::dns::cache.SRV.count(key))
+			continue;
+
+		size_t live(0);
+		for(const json::object record : records)
+		{
+			const time_t ttl
+			{
+				record.get<time_t>("ttl")
+			};
+
+			if(ttl <= now)
+				continue;
+
+			if(type == "A")
+			{
+				auto &rr
+				{
+					net::dns::cache.A.emplace(std::piecewise_construct,
+					                          std::forward_as_tuple(key),
+					                          std::forward_as_tuple())->second
+				};
+
+				rr.type = 1;
+				rr.ttl = ttl;
+				rr.ip4 = record.get<uint32_t>("ip4");
+			}
+			else if(type == "SRV")
+			{
+				auto &rr
+				{
+					net::dns::cache.SRV.emplace(std::piecewise_construct,
+					                            std::forward_as_tuple(key),
+					                            std::forward_as_tuple())->second
+				};
+
+				rr.type = 33;
+				rr.ttl = ttl;
+				rr.priority = record.get<uint16_t>("priority");
+				rr.weight = record.get<uint16_t>("weight");
+				rr.port = record.get<uint16_t>("port");
+				rr.tgt = { rr.tgtbuf, copy(rr.tgtbuf, unquote(record.get("tgt"))) };
+			}
+			else continue;
+
+			++live;
+		}
+
+		if(!live)
+			db::txn::append
+			{
+				txn, dns_cache, db::column::delta
+				{
+					db::op::DELETE, it->first, string_view{}
+				}
+			};
+
+		count += live;
+	}
+
+	txn();
+	net::dns::stats.restored += count;
+	log::info
+	{
+		"Restored %zu DNS cache records", count
+	};
+}
@@ -12,10 +12,14 @@ using namespace ircd;
 
 static bool cache_get(const string_view &server, const string_view &key_id, const m::keys::closure &);
 static size_t cache_set(const json::object &);
+static bool pk_cache_get(const string_view &server, const string_view &key_id, const m::keys::pk_closure &);
+static size_t pk_cache_set(const json::object &);
 
 extern "C" bool verify__keys(const m::keys &) noexcept;
 extern "C" void get__keys(const string_view &server, const string_view &key_id, const m::keys::closure &);
 extern "C" bool query__keys(const string_view &query_server, const m::keys::queries &, const m::keys::closure_bool &);
+extern "C" void public_key__keys(const string_view &server, const string_view &key_id, const m::keys::pk_closure &);
+extern "C" size_t prefetch__keys(const m::keys::queries &);
 
 static void create_my_key(const m::event &);
 
@@ -342,7 +346,7 @@ try
 	opts.dynamic = true;
 	const unique_buffer<mutable_buffer> buf
 	{
-		16_KiB
+		16_KiB + queries.size() * 256
 	};
 
 	m::v1::key::query request
@@ -400,6 +404,10 @@ catch(const ctx::timeout &e)
 	};
 }
 
+//
+// get
+//
+
 conf::item<milliseconds>
 get_keys_timeout
 {
@@ -482,6 +490,154 @@ catch(const ctx::timeout &e)
 	};
 }
 
+//
+// prefetch
+//
+
+conf::item<std::string>
+prefetch_keys_notary
+{
+	{ "name",     "ircd.keys.prefetch.notary" },
+	{ "default",  "matrix.org"                },
+};
+
+/// Ensures every (server, key_id) in the list is available for verification
+/// before a batch of events is evaluated. Keys already in memory or in their
+/// node room are skipped; the rest are requested from the notary in a single
+/// query and any it could not provide are then fetched directly from each
+/// server in parallel, one request per server. Returns the number of keys
+/// which are still not available afterward.
+size_t
+prefetch__keys(const m::keys::queries &queries)
+{
+	std::vector<m::v1::key::server_key> missing;
+	missing.reserve(queries.size());
+	for(const auto &query : queries)
+	{
+		if(query.first == my_host())
+			continue;
+
+		if(pk_cache_get(query.first, query.second, [](const auto &) {}))
+			continue;
+
+		if(cache_get(query.first, query.second, pk_cache_set))
+			continue;
+
+		missing.emplace_back(query);
+	}
+
+	std::sort(begin(missing), end(missing));
+	missing.erase(std::unique(begin(missing), end(missing)), end(missing));
+	if(missing.empty())
+		return 0;
+
+	const auto received{[](const json::object &keys)
+	{
+		cache_set(keys);
+		pk_cache_set(keys);
+		return true;
+	}};
+
+	const string_view &notary
+	{
+		prefetch_keys_notary
+	};
+
+	if(notary) try
+	{
+		query__keys(notary, vector_view<const m::v1::key::server_key>(missing), received);
+	}
+	catch(const std::exception &e)
+	{
+		log::derror
+		{
+			m::log, "Failed to prefetch %zu keys from notary '%s' :%s",
+			missing.size(),
+			notary,
+			e.what()
+		};
+	}
+
+	std::vector<m::v1::key::server_key> direct;
+	direct.reserve(missing.size());
+	for(const auto &query : missing)
+		if(!pk_cache_get(query.first, query.second, [](const auto &) {}))
+			direct.emplace_back(query);
+
+	// A server's response carries all of its keys; direct is sorted so each
+	// server is only requested once.
+	std::vector<unique_buffer<mutable_buffer>> bufs;
+	std::vector<m::v1::key::keys> requests;
+	bufs.reserve(direct.size());
+	requests.reserve(direct.size());
+	for(auto it(begin(direct)); it != end(direct); ++it) try
+	{
+		if(it != begin(direct) && std::prev(it)->first == it->first)
+			continue;
+
+		m::v1::key::opts opts;
+		bufs.emplace_back(16_KiB);
+		requests.emplace_back(it->first, bufs.back(), std::move(opts));
+	}
+	catch(const std::exception &e)
+	{
+		log::derror
+		{
+			m::log, "Failed to request keys for '%s' :%s",
+			it->first,
+			e.what()
+		};
+	}
+
+	const auto deadline
+	{
+		now<steady_point>() + milliseconds(get_keys_timeout)
+	};
+
+	for(auto &request : requests) try
+	{
+		if(!request.wait_until(deadline, std::nothrow))
+			continue;
+
+		request.get();
+		const json::object &keys
+		{
+			request
+		};
+
+		if(verify__keys(keys))
+			received(keys);
+	}
+	catch(const std::exception &e)
+	{
+		log::derror
+		{
+			m::log, "Failed to prefetch keys :%s", e.what()
+		};
+	}
+
+	const size_t unavailable
+	{
+		size_t(std::count_if(begin(missing), end(missing), [](const auto &query)
+		{
+			return !pk_cache_get(query.first, query.second, [](const auto &) {});
+		}))
+	};
+
+	log::debug
+	{
+		m::log, "Prefetched %zu of %zu keys; %zu from the notary, %zu direct from %zu servers; %zu unavailable",
+		missing.size() - unavailable,
+		missing.size(),
+		missing.size() - direct.size(),
+		direct.size(),
+		requests.size(),
+		unavailable
+	};
+
+	return unavailable;
+}
+
 bool
 verify__keys(const m::keys &keys)
 noexcept try
@@ -631,3 +787,179 @@ cache_get(const string_view &server_name,
 		node_room.get(std::nothrow, "ircd.key", reclosure):
 		node_room.get(std::nothrow, "ircd.key", key_id, reclosure);
 }
+
+//
+// public key
+//
+
+conf::item<size_t>
+pk_cache_max
+{
+	{ "name",     "ircd.keys.cache.max" },
+	{ "default",  8192L                 },
+};
+
+struct pk_cache_entry
+{
+	ed25519::pk pk;
+	time_t valid_until_ts;
+	std::list<string_view>::iterator lru;
+};
+
+/// Decoded ed25519 public keys indexed by "server_name key_id" so the hot
+/// path of event verification doesn't read and base64-decode the node room
+/// for every signature. Entries are only kept until their valid_until_ts;
+/// after that the lookup falls back to the node room and network as before.
+static std::map<std::string, pk_cache_entry, std::less<>>
+pk_cache;
+
+/// The keys of pk_cache from the least to the most recently used; these are
+/// views of the keys in the map. The least recently used entry is evicted
+/// when the cache is full.
+static std::list<string_view>
+pk_cache_lru;
+
+static void
+pk_cache_erase(const decltype(pk_cache)::iterator &it)
+{
+	pk_cache_lru.erase(it->second.lru);
+	pk_cache.erase(it);
+}
+
+void
+public_key__keys(const string_view &server_name,
+                 const string_view &key_id,
+                 const m::keys::pk_closure &closure)
+{
+	if(pk_cache_get(server_name, key_id, closure))
+		return;
+
+	get__keys(server_name, key_id, [&closure, &key_id]
+	(const json::object &keys)
+	{
+		pk_cache_set(keys);
+
+		const json::object &vks
+		{
+			keys.at("verify_keys")
+		};
+
+		const json::object &vkk
+		{
+			vks.at(key_id)
+		};
+
+		const ed25519::pk pk
+		{
+			[&vkk](auto &buf)
+			{
+				b64decode(buf, unquote(vkk.at("key")));
+			}
+		};
+
+		closure(pk);
+	});
+}
+
+size_t
+pk_cache_set(const json::object &keys)
+{
+	const time_t &valid_until_ts
+	{
+		keys.get<time_t>("valid_until_ts", 0)
+	};
+
+	if(valid_until_ts < ircd::time<milliseconds>())
+		return 0;
+
+	const string_view &server_name
+	{
+		unquote(keys.at("server_name"))
+	};
+
+	const json::object &vks
+	{
+		keys.at("verify_keys")
+	};
+
+	size_t ret{0};
+	for(const auto &member : vks)
+	{
+		// Expired entries are dropped by pk_cache_get() when they're next
+		// looked up; one which is never looked up again ages out of the LRU.
+		if(pk_cache.size() >= size_t(pk_cache_max))
+			pk_cache_erase(pk_cache.find(pk_cache_lru.front()));
+
+		const json::object &vkk
+		{
+			member.second
+		};
+
+		const ed25519::pk pk
+		{
+			[&vkk](auto &buf)
+			{
+				b64decode(buf, unquote(vkk.at("key")));
+			}
+		};
+
+		const auto key
+		{
+			std::string{server_name} + ' ' + std::string{unquote(member.first)}
+		};
+
+		auto it
+		{
+			pk_cache.lower_bound(key)
+		};
+
+		if(it == end(pk_cache) || it->first != key)
+		{
+			it = pk_cache.emplace_hint(it, key, pk_cache_entry{pk, valid_until_ts});
+			it->second.lru = pk_cache_lru.emplace(end(pk_cache_lru), it->first);
+		}
+		else
+		{
+			it->second.pk = pk;
+			it->second.valid_until_ts = valid_until_ts;
+			pk_cache_lru.splice(end(pk_cache_lru), pk_cache_lru, it->second.lru);
+		}
+
+		++ret;
+	}
+
+	return ret;
+}
+
+bool
+pk_cache_get(const string_view &server_name,
+             const string_view &key_id,
+             const m::keys::pk_closure &closure)
+{
+	thread_local char buf[512];
+	const string_view key
+	{
+		fmt::sprintf
+		{
+			buf, "%s %s", server_name, key_id
+		}
+	};
+
+	const auto it
+	{
+		pk_cache.find(key)
+	};
+
+	if(it == end(pk_cache))
+		return false;
+
+	if(it->second.valid_until_ts < ircd::time<milliseconds>())
+	{
+		pk_cache_erase(it);
+		return false;
+	}
+
+	pk_cache_lru.splice(end(pk_cache_lru), pk_cache_lru, it->second.lru);
+	closure(it->second.pk);
+	return true;
+}
@@ -679,6 +679,12 @@ ircd::m::vm::_eval_pdu(eval &eval,
 	if(!opts.write)
 		return fault::ACCEPT;
 
+	// Held through the commit; the bulk importer excludes it.
+	const std::shared_lock<ctx::shared_mutex> sequence_lock
+	{
+		vm::sequence_lock
+	};
+
 	db::txn txn
 	{
 		*dbs::events, db::txn::opts
@@ -695,6 +701,13 @@ ircd::m::vm::_eval_pdu(eval &eval,
 		eval.txn = nullptr;
 	}};
 
+	// Held until committed; write() composes the depth runs against the
+	// room's current runs.
+	const dbs::room_depth_lock depth_lock
+	{
+		room_id
+	};
+
 	// Preliminary write_opts
 	m::dbs::write_opts wopts;
 	wopts.present = opts.present;
@@ -719,6 +732,7 @@ ircd::m::vm::_eval_pdu(eval &eval,
 	}
 
 	write_commit(eval);
+	dbs::committed(event, wopts);
 	return fault::ACCEPT;
 }
 
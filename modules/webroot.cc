@@ -10,7 +10,22 @@
 
 using namespace ircd;
 
-std::map<std::string, std::string, iless> files;
+/// A file in the webroot. Files no larger than ircd.webroot.cache.file_max
+/// are loaded into memory with their compressed variants when the module is
+/// loaded; others are read from disk on each request. The map is not
+/// modified after the module is loaded.
+struct file
+{
+	std::string path;
+	std::string type;
+	std::string etag;
+	std::string content;
+	std::string gzip;
+	std::string brotli;
+	bool cached {false};
+};
+
+std::map<std::string, file, iless> files;
 
 static string_view
 content_type(const mutable_buffer &out, const string_view &filename, const string_view &content);
@@ -18,9 +33,36 @@ content_type(const mutable_buffer &out, const string_view &filename, const strin
 resource::response
 get_root(client &client, const resource::request &request);
 
+static resource::response
+get_file(client &client, const resource::request &request, const file &);
+
+static bool
+compressible(const string_view &type);
+
 static void
 init_files();
 
+conf::item<std::string>
+webroot_path
+{
+	{ "name",     "ircd.webroot.path"                                        },
+	{ "default",  "/home/jason/charybdis/charybdis/deps/riot-web/webapp/"   },
+};
+
+conf::item<size_t>
+webroot_file_max
+{
+	{ "name",     "ircd.webroot.cache.file_max" },
+	{ "default",  long(8_MiB)                   },
+};
+
+conf::item<seconds>
+webroot_max_age
+{
+	{ "name",     "ircd.webroot.cache.max_age" },
+	{ "default",  86400L                       },
+};
+
 mapi::header
 IRCD_MODULE
 {
@@ -47,25 +89,86 @@ root_get
 void
 init_files()
 {
-	// TODO: XXX
-	for(const auto &file : fs::ls_recursive("/home/jason/charybdis/charybdis/deps/riot-web/webapp/"))
+	const string_view &root
 	{
-		const auto name(tokens_after(file, '/', 6));
-		files.emplace(std::string(name), file);
-	}
-/*
-	for(const auto &file : fs::ls_recursive("/home/jason/charybdis/charybdis/modules/static/"))
+		webroot_path
+	};
+
+	if(empty(root) || !fs::exists(root))
+		return;
+
+	size_t total{0}, cached{0};
+	for(const auto &path : fs::ls_recursive(root))
 	{
-		const auto name(tokens_after(file, '/', 5));
-		files.emplace(std::string(name), file);
+		const string_view name
+		{
+			lstrip(lstrip(path, root, 1), '/')
+		};
+
+		struct file entry;
+		entry.path = path;
+		if(fs::size(path) > size_t(webroot_file_max))
+		{
+			char type_buf[64];
+			entry.type = std::string(content_type(type_buf, path, {}));
+			files.emplace(std::string(name), std::move(entry));
+			continue;
+		}
+
+		entry.content = fs::read(path);
+		entry.cached = true;
+		const string_view content
+		{
+			entry.content
+		};
+
+		char type_buf[64];
+		entry.type = std::string(content_type(type_buf, path, content));
+
+		char etag_buf[64];
+		entry.etag = std::string(b58encode(etag_buf, sha256::buf{sha256{content}}));
+
+		// Compressed variants are only kept when they are smaller.
+		if(compressible(entry.type))
+		{
+			const unique_buffer<mutable_buffer> buf
+			{
+				size(content)
+			};
+
+			const const_buffer gzip
+			{
+				zip::gzip(buf, content)
+			};
+
+			entry.gzip.assign(data(gzip), size(gzip));
+
+			const const_buffer brotli
+			{
+				zip::brotli(buf, content)
+			};
+
+			entry.brotli.assign(data(brotli), size(brotli));
+		}
+
+		total += size(entry.content) + size(entry.gzip) + size(entry.brotli);
+		++cached;
+		files.emplace(std::string(name), std::move(entry));
 	}
-*/
+
+	log::info
+	{
+		"Webroot %s has %zu files; %zu cached in %zu bytes",
+		root,
+		files.size(),
+		cached,
+		total
+	};
 }
 
 resource::response
 get_root(client &client,
          const resource::request &request)
-try
 {
 	const auto &path
 	{
@@ -84,11 +187,125 @@ try
 	if(it == end(files))
 		throw http::error{http::NOT_FOUND};
 
-	const auto &file_name
+	const auto &file
 	{
 		it->second
 	};
 
+	if(!file.cached)
+		return get_file(client, request, file);
+
+	// The entity tag of each encoding differs by a suffix; a match on any of
+	// them is a match for If-None-Match's weak comparison.
+	bool match{false};
+	tokens(request.head.if_none_match, ',', [&file, &match]
+	(const string_view &token)
+	{
+		const string_view tag
+		{
+			split(unquote(lstrip(strip(token), "W/"_sv, 1)), '-').first
+		};
+
+		match |= tag == "*" || tag == file.etag;
+	});
+
+	bool gzip{false}, brotli{false};
+	tokens(request.head.accept_encoding, ',', [&gzip, &brotli]
+	(const string_view &token)
+	{
+		const auto coding
+		{
+			split(strip(token), ';')
+		};
+
+		if(strip(coding.second) == "q=0")
+			return;
+
+		gzip |= iequals(strip(coding.first), "gzip"_sv);
+		brotli |= iequals(strip(coding.first), "br"_sv);
+	});
+
+	const string_view &encoding
+	{
+		brotli && !empty(file.brotli)? "br"_sv:
+		gzip && !empty(file.gzip)? "gzip"_sv:
+		string_view{}
+	};
+
+	const string_view &content
+	{
+		encoding == "br"? file.brotli:
+		encoding == "gzip"? file.gzip:
+		file.content
+	};
+
+	// Documents are always revalidated so a new deployment is picked up; the
+	// assets they reference can be cached for ircd.webroot.cache.max_age.
+	const bool document
+	{
+		startswith(file.type, "text/html")
+	};
+
+	char max_age[48];
+	const string_view cache_control
+	{
+		document?
+			"no-cache"_sv:
+			string_view{fmt::sprintf
+			{
+				max_age, "public, max-age=%ld", seconds(webroot_max_age).count()
+			}}
+	};
+
+	char headers_buf[384];
+	size_t headers_len
+	{
+		fmt::sprintf
+		{
+			headers_buf, "ETag: \"%s%s\"\r\nVary: Accept-Encoding\r\nCache-Control: %s\r\n",
+			file.etag,
+			encoding == "br"? "-br"_sv : encoding == "gzip"? "-gz"_sv : string_view{},
+			cache_control
+		}
+	};
+
+	if(encoding && !match)
+		headers_len += fmt::sprintf
+		{
+			mutable_buffer{headers_buf + headers_len, sizeof(headers_buf) - headers_len},
+			"Content-Encoding: %s\r\n", encoding
+		};
+
+	const string_view headers
+	{
+		headers_buf, headers_len
+	};
+
+	if(match)
+		return resource::response
+		{
+			client, http::NOT_MODIFIED, file.type, 0UL, headers
+		};
+
+	// The head and content are sent with a single gathered write.
+	return resource::response
+	{
+		client, http::OK, file.type, size(content), headers, content
+	};
+}
+
+/// Serves a file which isn't cached by reading it from disk.
+static resource::response
+get_file(client &client,
+         const resource::request &request,
+         const file &file)
+try
+{
+	const auto &file_name
+	{
+		file.path
+	};
+
 	const fs::fd fd
 	{
 		file_name
@@ -154,6 +371,18 @@ catch(const fs::filesystem_error &e)
 	};
 }
 
+static bool
+compressible(const string_view &type)
+{
+	return startswith(type, "text/") ||
+	       startswith(type, "application/javascript") ||
+	       startswith(type, "application/json") ||
+	       startswith(type, "image/svg+xml") ||
+	       startswith(type, "image/x-icon") ||
+	       startswith(type, "application/vnd.ms-fontobject") ||
+	       startswith(type, "application/font-sfnt");
+}
+
 string_view
 content_type(const mutable_buffer &out,
              const string_view &filename,